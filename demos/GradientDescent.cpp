@@ -9,12 +9,13 @@
 
 // To run the demo please type:
 // path/to/clang  -Xclang -add-plugin -Xclang clad -Xclang -load -Xclang \
-// path/to/libclad.so  -I../include/ -x c++ -lstdc++ -lm GradientDescent.cpp
+// path/to/libclad.so  -I../include/ -x c++ -lstdc++ -lm -pthread \
+// GradientDescent.cpp
 //
 // A typical invocation would be:
 // ../../../../obj/Debug+Asserts/bin/clang  -Xclang -add-plugin -Xclang clad \
 // -Xclang -load -Xclang ../../../../obj/Debug+Asserts/lib/libclad.dylib     \
-// -I../include/ -x c++ -lstdc++ -lm GradientDescent.cpp
+// -I../include/ -x c++ -lstdc++ -lm -pthread GradientDescent.cpp
 //
 // To plot the results install gnuplot and type:
 // gnuplot -e "plot 'dataset_gd.dat' with points pt 7; replot 'out_gd.dat' \
@@ -69,17 +70,16 @@ struct Dataset {
 // Function to perform a minimization step
 // theta_x are the hypothesis parameters, t is the generated dataset and
 // clad_grad is the gradient function generated by Clad
+// The gradients of all the samples are computed in parallel and summed into
+// result by execute_batch.
 template <typename T>
 void performStep(double& theta_0, double& theta_1, Dataset dt, T clad_grad) {
-  double J_theta[4], result[2] = {0, 0};
-  for (size_t i = 0; i < dt.size; i++) {
-    J_theta[0] = J_theta[1] = J_theta[2] = J_theta[3] = 0;
-    clad_grad.execute(theta_0, theta_1, dt.x[i], dt.y[i], &J_theta[0],
-                      &J_theta[1], &J_theta[2], &J_theta[3]);
-
-    result[0] += J_theta[0];
-    result[1] += J_theta[1];
-  }
+  double result[2] = {0, 0}, unused[2] = {0, 0};
+  clad_grad.execute_batch(dt.size, theta_0, theta_1, clad::batch(dt.x.data()),
+                          clad::batch(dt.y.data()), clad::batch_sum(&result[0]),
+                          clad::batch_sum(&result[1]),
+                          clad::batch_sum(&unused[0]),
+                          clad::batch_sum(&unused[1]));
 
   theta_0 -= dt.learning_rate * result[0] / (2 * dt.size);
   theta_1 -= dt.learning_rate * result[1] / (2 * dt.size);
@@ -1,29 +1,186 @@
 #ifndef CLANG_ARRAY_H
 #define CLANG_ARRAY_H
 
+#include "clad/Differentiator/ArrayKernels.h"
 #include "clad/Differentiator/CladConfig.h"
 
+#include <new>
 #include <type_traits>
 
 namespace clad {
+#ifndef __CUDACC__
+  namespace detail {
+    /// The buffers of the destroyed clad::array objects of type T in this
+    /// thread, kept for the next arrays of the same size class. The size
+    /// classes are the powers of two up to 2^(NumClasses - 1) elements, the
+    /// larger arrays are not pooled.
+    template <typename T> struct array_storage_cache {
+      static constexpr unsigned NumClasses = 13;
+      static constexpr unsigned Depth = 4;
+      void* buffers[NumClasses][Depth] = {};
+      unsigned count[NumClasses] = {};
+      ~array_storage_cache() {
+        for (unsigned c = 0; c < NumClasses; ++c)
+          for (unsigned i = 0; i < count[c]; ++i)
+            ::operator delete(buffers[c][i]);
+      }
+    };
+
+    template <typename T> array_storage_cache<T>& get_array_storage_cache() {
+      static thread_local array_storage_cache<T> cache;
+      return cache;
+    }
+
+    /// \returns the size class of arrays of the given size, i.e. the
+    /// smallest c such that size <= 2^c.
+    inline unsigned array_size_class(std::size_t size) {
+      unsigned c = 0;
+      while ((std::size_t(1) << c) < size)
+        ++c;
+      return c;
+    }
+  } // namespace detail
+#endif
+
   /// This class is not meant to be used by user. It is used by clad internally
-  /// only
-  template <typename T> class array {
+  /// only. clad::array<T, N> stores N elements inline and is used when the
+  /// size is known when generating the derivative, clad::array<T> is sized
+  /// at runtime.
+  template <typename T, std::size_t N = 0> class array {
+  private:
+    /// The underlying array
+    T m_arr[N];
+
+  public:
+    /// Constructor to create a zero-initialized array
+    CUDA_HOST_DEVICE array() : m_arr{} {}
+
+    /// Returns the size of the underlying array
+    CUDA_HOST_DEVICE std::size_t size() { return N; }
+    /// Returns the ptr of the underlying array
+    CUDA_HOST_DEVICE T* ptr() { return m_arr; }
+    /// Returns the reference to the location at the index of the underlying
+    /// array
+    CUDA_HOST_DEVICE T& operator[](std::size_t i) { return m_arr[i]; }
+    /// Returns the reference to the underlying array
+    CUDA_HOST_DEVICE T& operator*() { return *m_arr; }
+
+    // Arithmetic overloads
+    /// Divides the number from every element in the array
+    CUDA_HOST_DEVICE array<T, N>& operator/=(T n) {
+      kernels::apply_scalar<kernels::div>(m_arr, n, N);
+      return *this;
+    }
+    /// Multiplies the number to every element in the array
+    CUDA_HOST_DEVICE array<T, N>& operator*=(T n) {
+      kernels::apply_scalar<kernels::mul>(m_arr, n, N);
+      return *this;
+    }
+    /// Adds the number to every element in the array
+    CUDA_HOST_DEVICE array<T, N>& operator+=(T n) {
+      kernels::apply_scalar<kernels::add>(m_arr, n, N);
+      return *this;
+    }
+    /// Subtracts the number from every element in the array
+    CUDA_HOST_DEVICE array<T, N>& operator-=(T n) {
+      kernels::apply_scalar<kernels::sub>(m_arr, n, N);
+      return *this;
+    }
+  };
+
+  /// The array sized at runtime. The storage of the arrays of trivial types
+  /// is recycled through a per-thread pool, so that the arrays created for
+  /// every call of a derived function, e.g. in a loop, do not allocate.
+  template <typename T> class array<T, 0> {
   private:
     /// The pointer to the underlying array
     T* m_arr = nullptr;
     /// The size of the array
     std::size_t m_size = 0;
 
+    /// The storage of trivial types is pooled and zeroed by hand, other
+    /// types are value-initialized by new[].
+    static constexpr bool IsPooled = std::is_trivial<T>::value;
+
+    template <bool Pooled = IsPooled>
+    CUDA_HOST_DEVICE static typename std::enable_if<Pooled, T*>::type
+    allocate(std::size_t size) {
+      if (!size)
+        return nullptr;
+      void* data = nullptr;
+#ifndef __CUDACC__
+      using cache_t = detail::array_storage_cache<T>;
+      unsigned c = detail::array_size_class(size);
+      cache_t& cache = detail::get_array_storage_cache<T>();
+      if (c < cache_t::NumClasses) {
+        if (cache.count[c])
+          data = cache.buffers[c][--cache.count[c]];
+        else
+          data = ::operator new(sizeof(T) << c);
+      }
+#endif
+      if (!data)
+        data = ::operator new(size * sizeof(T));
+      T* arr = static_cast<T*>(data);
+      for (std::size_t i = 0; i < size; ++i)
+        arr[i] = T();
+      return arr;
+    }
+    template <bool Pooled = IsPooled>
+    CUDA_HOST_DEVICE static typename std::enable_if<!Pooled, T*>::type
+    allocate(std::size_t size) {
+      return new T[size]{};
+    }
+
+    template <bool Pooled = IsPooled>
+    CUDA_HOST_DEVICE static typename std::enable_if<Pooled>::type
+    deallocate(T* arr, std::size_t size) {
+      if (!arr)
+        return;
+#ifndef __CUDACC__
+      using cache_t = detail::array_storage_cache<T>;
+      unsigned c = detail::array_size_class(size);
+      cache_t& cache = detail::get_array_storage_cache<T>();
+      if (c < cache_t::NumClasses && cache.count[c] < cache_t::Depth) {
+        cache.buffers[c][cache.count[c]++] = arr;
+        return;
+      }
+#endif
+      ::operator delete(arr);
+    }
+    template <bool Pooled = IsPooled>
+    CUDA_HOST_DEVICE static typename std::enable_if<!Pooled>::type
+    deallocate(T* arr, std::size_t) {
+      delete[] arr;
+    }
+
   public:
     /// Delete default constructor
     array() = delete;
     /// Constructor to create an array of the specified size
     CUDA_HOST_DEVICE array(std::size_t size)
-        : m_arr(new T[size]{static_cast<T>(0)}), m_size(size) {}
+        : m_arr(allocate(size)), m_size(size) {}
+    /// The arrays own their storage, they can be moved but not copied.
+    array(const array<T>&) = delete;
+    array<T>& operator=(const array<T>&) = delete;
+    CUDA_HOST_DEVICE array(array<T>&& other)
+        : m_arr(other.m_arr), m_size(other.m_size) {
+      other.m_arr = nullptr;
+      other.m_size = 0;
+    }
+    CUDA_HOST_DEVICE array<T>& operator=(array<T>&& other) {
+      if (this != &other) {
+        deallocate(m_arr, m_size);
+        m_arr = other.m_arr;
+        m_size = other.m_size;
+        other.m_arr = nullptr;
+        other.m_size = 0;
+      }
+      return *this;
+    }
 
-    /// Destructor to delete the array if it was created by array_ref
-    CUDA_HOST_DEVICE ~array() { delete[] m_arr; }
+    /// Destructor to release the storage of the array
+    CUDA_HOST_DEVICE ~array() { deallocate(m_arr, m_size); }
 
     /// Returns the size of the underlying array
     CUDA_HOST_DEVICE std::size_t size() { return m_size; }
@@ -38,26 +195,22 @@ namespace clad {
     // Arithmetic overloads
     /// Divides the number from every element in the array
     CUDA_HOST_DEVICE array<T>& operator/=(T n) {
-      for (std::size_t i = 0; i < m_size; i++)
-        m_arr[i] /= n;
+      kernels::apply_scalar<kernels::div>(m_arr, n, m_size);
       return *this;
     }
     /// Multiplies the number to every element in the array
     CUDA_HOST_DEVICE array<T>& operator*=(T n) {
-      for (std::size_t i = 0; i < m_size; i++)
-        m_arr[i] *= n;
+      kernels::apply_scalar<kernels::mul>(m_arr, n, m_size);
       return *this;
     }
     /// Adds the number to every element in the array
     CUDA_HOST_DEVICE array<T>& operator+=(T n) {
-      for (std::size_t i = 0; i < m_size; i++)
-        m_arr[i] += n;
+      kernels::apply_scalar<kernels::add>(m_arr, n, m_size);
       return *this;
     }
     /// Subtracts the number from every element in the array
     CUDA_HOST_DEVICE array<T>& operator-=(T n) {
-      for (std::size_t i = 0; i < m_size; i++)
-        m_arr[i] -= n;
+      kernels::apply_scalar<kernels::sub>(m_arr, n, m_size);
       return *this;
     }
   };
@@ -0,0 +1,183 @@
+#ifndef CLAD_ARRAY_KERNELS_H
+#define CLAD_ARRAY_KERNELS_H
+
+#include "clad/Differentiator/CladConfig.h"
+
+#include <cstddef>
+
+// The kernels are compiled for several instruction sets and the widest one
+// supported by the CPU is chosen at runtime. This needs the target attribute
+// and __builtin_cpu_supports, otherwise only the baseline kernels are used.
+#if !defined(__CUDACC__) && (defined(__x86_64__) || defined(__i386__)) &&     \
+    (defined(__GNUC__) || defined(__clang__))
+#define CLAD_KERNELS_X86_DISPATCH 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CLAD_KERNEL_INLINE inline __attribute__((always_inline))
+#define CLAD_RESTRICT __restrict__
+#elif defined(_MSC_VER)
+#define CLAD_KERNEL_INLINE __forceinline
+#define CLAD_RESTRICT __restrict
+#else
+#define CLAD_KERNEL_INLINE inline
+#define CLAD_RESTRICT
+#endif
+
+namespace clad {
+  /// Element-wise kernels used by the arithmetic of clad::array and
+  /// clad::array_ref. The loops are written so that the compiler vectorizes
+  /// them: the arrays are marked as not aliasing and the operation is a
+  /// template parameter rather than a runtime value.
+  namespace kernels {
+    struct add {
+      template <typename T> CUDA_HOST_DEVICE static T apply(T a, T b) {
+        return a + b;
+      }
+    };
+    struct sub {
+      template <typename T> CUDA_HOST_DEVICE static T apply(T a, T b) {
+        return a - b;
+      }
+    };
+    struct mul {
+      template <typename T> CUDA_HOST_DEVICE static T apply(T a, T b) {
+        return a * b;
+      }
+    };
+    struct div {
+      template <typename T> CUDA_HOST_DEVICE static T apply(T a, T b) {
+        return a / b;
+      }
+    };
+
+    namespace detail {
+      template <class Op, typename T>
+      CUDA_HOST_DEVICE CLAD_KERNEL_INLINE void
+      binary_loop(T* CLAD_RESTRICT a, const T* CLAD_RESTRICT b,
+                  std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+          a[i] = Op::apply(a[i], b[i]);
+      }
+
+      template <class Op, typename T>
+      CUDA_HOST_DEVICE CLAD_KERNEL_INLINE void
+      scalar_loop(T* CLAD_RESTRICT a, T s, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+          a[i] = Op::apply(a[i], s);
+      }
+
+      template <typename T>
+      CUDA_HOST_DEVICE CLAD_KERNEL_INLINE void
+      axpy_loop(T* CLAD_RESTRICT y, T a, const T* CLAD_RESTRICT x,
+                std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i)
+          y[i] += a * x[i];
+      }
+
+#ifdef CLAD_KERNELS_X86_DISPATCH
+      // Instantiates the loops above for the instruction set TARGET.
+#define CLAD_KERNELS_DEFINE_TARGET(ISA, TARGET)                                \
+  template <class Op, typename T>                                              \
+  __attribute__((target(TARGET))) void binary_##ISA(                           \
+      T* CLAD_RESTRICT a, const T* CLAD_RESTRICT b, std::size_t n) {           \
+    binary_loop<Op>(a, b, n);                                                  \
+  }                                                                            \
+  template <class Op, typename T>                                              \
+  __attribute__((target(TARGET))) void scalar_##ISA(T* CLAD_RESTRICT a, T s,   \
+                                                    std::size_t n) {           \
+    scalar_loop<Op>(a, s, n);                                                  \
+  }                                                                            \
+  template <typename T>                                                        \
+  __attribute__((target(TARGET))) void axpy_##ISA(                             \
+      T* CLAD_RESTRICT y, T a, const T* CLAD_RESTRICT x, std::size_t n) {      \
+    axpy_loop(y, a, x, n);                                                     \
+  }
+
+      CLAD_KERNELS_DEFINE_TARGET(avx2, "avx2")
+      CLAD_KERNELS_DEFINE_TARGET(avx512, "avx512f")
+#undef CLAD_KERNELS_DEFINE_TARGET
+
+      enum class isa { baseline, avx2, avx512 };
+
+      /// \returns the widest instruction set supported by the CPU. The
+      /// baseline is SSE2 on x86-64.
+      inline isa detected_isa() {
+        if (__builtin_cpu_supports("avx512f"))
+          return isa::avx512;
+        if (__builtin_cpu_supports("avx2"))
+          return isa::avx2;
+        return isa::baseline;
+      }
+#endif // CLAD_KERNELS_X86_DISPATCH
+
+      /// \returns true if the arrays of size n starting at a and b overlap.
+      template <typename T>
+      CUDA_HOST_DEVICE bool overlap(const T* a, const T* b, std::size_t n) {
+        return a < b + n && b < a + n;
+      }
+    } // namespace detail
+
+    /// Computes `a[i] = Op::apply(a[i], b[i])` for every i < n.
+    template <class Op, typename T>
+    CUDA_HOST_DEVICE void apply(T* a, const T* b, std::size_t n) {
+      // The arrays may overlap, e.g. for `x += x`, the vectorized kernels
+      // cannot be used then.
+      if (detail::overlap(a, b, n)) {
+        for (std::size_t i = 0; i < n; ++i)
+          a[i] = Op::apply(a[i], b[i]);
+        return;
+      }
+#if defined(CLAD_KERNELS_X86_DISPATCH)
+      switch (detail::detected_isa()) {
+      case detail::isa::avx512:
+        return detail::binary_avx512<Op>(a, b, n);
+      case detail::isa::avx2:
+        return detail::binary_avx2<Op>(a, b, n);
+      case detail::isa::baseline:
+        break;
+      }
+#endif
+      detail::binary_loop<Op>(a, b, n);
+    }
+
+    /// Computes `a[i] = Op::apply(a[i], s)` for every i < n.
+    template <class Op, typename T>
+    CUDA_HOST_DEVICE void apply_scalar(T* a, T s, std::size_t n) {
+#if defined(CLAD_KERNELS_X86_DISPATCH)
+      switch (detail::detected_isa()) {
+      case detail::isa::avx512:
+        return detail::scalar_avx512<Op>(a, s, n);
+      case detail::isa::avx2:
+        return detail::scalar_avx2<Op>(a, s, n);
+      case detail::isa::baseline:
+        break;
+      }
+#endif
+      detail::scalar_loop<Op>(a, s, n);
+    }
+
+    /// Computes `y[i] += a * x[i]` for every i < n in a single pass.
+    template <typename T>
+    CUDA_HOST_DEVICE void axpy(T* y, T a, const T* x, std::size_t n) {
+      if (detail::overlap(y, x, n)) {
+        for (std::size_t i = 0; i < n; ++i)
+          y[i] += a * x[i];
+        return;
+      }
+#if defined(CLAD_KERNELS_X86_DISPATCH)
+      switch (detail::detected_isa()) {
+      case detail::isa::avx512:
+        return detail::axpy_avx512(y, a, x, n);
+      case detail::isa::avx2:
+        return detail::axpy_avx2(y, a, x, n);
+      case detail::isa::baseline:
+        break;
+      }
+#endif
+      detail::axpy_loop(y, a, x, n);
+    }
+  } // namespace kernels
+} // namespace clad
+
+#endif // CLAD_ARRAY_KERNELS_H
@@ -29,7 +29,8 @@ namespace clad {
     /// store their addresses
     CUDA_HOST_DEVICE array_ref(T* a) : m_arr(a), m_size(1) {}
     /// Constructor for clad::array types
-    CUDA_HOST_DEVICE array_ref(array<T>& a)
+    template <std::size_t N>
+    CUDA_HOST_DEVICE array_ref(array<T, N>& a)
         : m_arr(a.ptr()), m_size(a.size()) {}
 
     /// Returns the size of the underlying array
@@ -53,32 +54,36 @@ namespace clad {
     CUDA_HOST_DEVICE array_ref<T>& operator/=(array_ref<T>& Ar) {
       assert(m_size == Ar.size() && "Size of both the array_refs must be equal "
                                     "for carrying out addition assignment");
-      for (std::size_t i = 0; i < m_size; i++)
-        m_arr[i] /= Ar[i];
+      kernels::apply<kernels::div>(m_arr, Ar.m_arr, m_size);
       return *this;
     }
     /// Multiplies the arrays element wise
     CUDA_HOST_DEVICE array_ref<T>& operator*=(array_ref<T>& Ar) {
       assert(m_size == Ar.size() && "Size of both the array_refs must be equal "
                                     "for carrying out addition assignment");
-      for (std::size_t i = 0; i < m_size; i++)
-        m_arr[i] *= Ar[i];
+      kernels::apply<kernels::mul>(m_arr, Ar.m_arr, m_size);
       return *this;
     }
     /// Adds the arrays element wise
     CUDA_HOST_DEVICE array_ref<T>& operator+=(array_ref<T>& Ar) {
       assert(m_size == Ar.size() && "Size of both the array_refs must be equal "
                                     "for carrying out addition assignment");
-      for (std::size_t i = 0; i < m_size; i++)
-        m_arr[i] += Ar[i];
+      kernels::apply<kernels::add>(m_arr, Ar.m_arr, m_size);
       return *this;
     }
     /// Subtracts the arrays element wise
     CUDA_HOST_DEVICE array_ref<T>& operator-=(array_ref<T>& Ar) {
       assert(m_size == Ar.size() && "Size of both the array_refs must be equal "
                                     "for carrying out addition assignment");
-      for (std::size_t i = 0; i < m_size; i++)
-        m_arr[i] -= Ar[i];
+      kernels::apply<kernels::sub>(m_arr, Ar.m_arr, m_size);
+      return *this;
+    }
+    /// Adds the array multiplied by a number element wise, i.e. computes
+    /// `(*this)[i] += a * Ar[i]` in a single pass
+    CUDA_HOST_DEVICE array_ref<T>& axpy(T a, array_ref<T>& Ar) {
+      assert(m_size == Ar.size() && "Size of both the array_refs must be equal "
+                                    "for carrying out addition assignment");
+      kernels::axpy(m_arr, a, Ar.m_arr, m_size);
       return *this;
     }
   };
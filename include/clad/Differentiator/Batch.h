@@ -0,0 +1,168 @@
+#ifndef CLAD_BATCH_H
+#define CLAD_BATCH_H
+
+#include "clad/Differentiator/ArrayRef.h"
+#include "clad/Differentiator/CladCore.h"
+#include "clad/Differentiator/TaskGroup.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+namespace clad {
+  /// The value of a batch argument for a single point, converts to a
+  /// reference to the first element, a pointer to it or an array_ref to all
+  /// the elements of the point.
+  template <typename T> class batch_element {
+    T* m_Ptr;
+    std::size_t m_Size;
+
+  public:
+    batch_element(T* ptr, std::size_t size) : m_Ptr(ptr), m_Size(size) {}
+    operator T&() const { return *m_Ptr; }
+    operator T*() const { return m_Ptr; }
+    operator array_ref<T>() const { return array_ref<T>(m_Ptr, m_Size); }
+  };
+
+  /// An argument of CladFunction::execute_batch that takes a different value
+  /// for every point, see clad::batch.
+  template <typename T> struct batch_arg {
+    T* ptr;
+    std::size_t stride;
+  };
+
+  /// An argument of CladFunction::execute_batch whose values are summed over
+  /// all the points, see clad::batch_sum.
+  template <typename T> struct batch_sum_arg {
+    T* result;
+    std::size_t size;
+    /// The sum of the values of the points of each chunk.
+    std::vector<T> partials;
+    /// The value of the point currently executed in each chunk.
+    std::vector<T> temps;
+  };
+
+  /// Marks an argument of CladFunction::execute_batch stored as a structure
+  /// of arrays. The value of point i is the `stride` elements starting at
+  /// ptr[i * stride]. It can be used for inputs as well as for outputs, e.g.
+  /// the gradient of each point.
+  template <typename T>
+  batch_arg<T> batch(T* ptr, std::size_t stride = 1) {
+    return {ptr, stride};
+  }
+
+  /// Marks an output argument of CladFunction::execute_batch of `size`
+  /// elements, e.g. a gradient, that is summed over all the points and added
+  /// to result. The sum is deterministic, it does not depend on the number
+  /// of threads nor on the order in which the points were executed.
+  template <typename T>
+  batch_sum_arg<T> batch_sum(T* result, std::size_t size = 1) {
+    return {result, size, {}, {}};
+  }
+
+  namespace detail {
+    /// \returns the number of chunks the points of a batch are split into.
+    /// It only depends on the number of points to keep the sums of
+    /// batch_sum arguments deterministic.
+    inline std::size_t batch_num_chunks(std::size_t count) {
+      const std::size_t maxChunks = 256;
+      return count < maxChunks ? count : maxChunks;
+    }
+
+    // Arguments which are not marked as batch arguments are passed unchanged
+    // to every point.
+    template <typename T> void batch_prepare(T&, std::size_t) {}
+    template <typename T> void batch_begin_point(T&, std::size_t) {}
+    template <typename T> void batch_end_point(T&, std::size_t) {}
+    template <typename T> void batch_finish(T&) {}
+    template <typename T> T& batch_at(T& arg, std::size_t, std::size_t) {
+      return arg;
+    }
+
+    template <typename T>
+    batch_element<T> batch_at(batch_arg<T>& arg, std::size_t point,
+                              std::size_t) {
+      return batch_element<T>(arg.ptr + point * arg.stride, arg.stride);
+    }
+
+    template <typename T>
+    void batch_prepare(batch_sum_arg<T>& arg, std::size_t numChunks) {
+      arg.partials.assign(numChunks * arg.size, T());
+      arg.temps.assign(numChunks * arg.size, T());
+    }
+    template <typename T>
+    void batch_begin_point(batch_sum_arg<T>& arg, std::size_t chunk) {
+      for (std::size_t i = 0; i < arg.size; ++i)
+        arg.temps[chunk * arg.size + i] = T();
+    }
+    template <typename T>
+    batch_element<T> batch_at(batch_sum_arg<T>& arg, std::size_t,
+                              std::size_t chunk) {
+      return batch_element<T>(&arg.temps[chunk * arg.size], arg.size);
+    }
+    template <typename T>
+    void batch_end_point(batch_sum_arg<T>& arg, std::size_t chunk) {
+      for (std::size_t i = 0; i < arg.size; ++i)
+        arg.partials[chunk * arg.size + i] += arg.temps[chunk * arg.size + i];
+    }
+    template <typename T> void batch_finish(batch_sum_arg<T>& arg) {
+      for (std::size_t c = 0; c * arg.size < arg.partials.size(); ++c)
+        for (std::size_t i = 0; i < arg.size; ++i)
+          arg.result[i] += arg.partials[c * arg.size + i];
+    }
+
+    /// Stores the value returned by the derived function for each point if
+    /// results are requested.
+    template <typename R> struct batch_result {
+      template <typename Fn>
+      static void store(R* results, std::size_t point, Fn fn) {
+        if (results)
+          results[point] = fn();
+        else
+          fn();
+      }
+    };
+    template <> struct batch_result<void> {
+      template <typename Fn> static void store(void*, std::size_t, Fn fn) {
+        fn();
+      }
+    };
+
+    /// Splits the points in chunks executed in parallel, every chunk
+    /// accumulates the clad::batch_sum arguments of its points separately
+    /// and the chunks are summed in order at the end.
+    template <typename F, typename FunctorT>
+    struct batch_executor<CladFunction<F, FunctorT>> {
+      template <class R, class... Args>
+      static void execute(CladFunction<F, FunctorT>& fn, R* results,
+                          std::size_t count, Args&... args) {
+        if (!fn.m_Function) {
+          printf("CladFunction is invalid\n");
+          return;
+        }
+        std::size_t numChunks = batch_num_chunks(count);
+        int prepare[] = {0, (batch_prepare(args, numChunks), 0)...};
+        (void)prepare;
+        parallel_for(numChunks, [&](std::size_t chunk) {
+          tape_reuse_scope reuse;
+          std::size_t begin = chunk * count / numChunks;
+          std::size_t end = (chunk + 1) * count / numChunks;
+          for (std::size_t i = begin; i < end; ++i) {
+            int init[] = {0, (batch_begin_point(args, chunk), 0)...};
+            (void)init;
+            batch_result<R>::store(results, i, [&]() {
+              return fn.execute_helper(fn.m_Function,
+                                       batch_at(args, i, chunk)...);
+            });
+            int acc[] = {0, (batch_end_point(args, chunk), 0)...};
+            (void)acc;
+          }
+        });
+        int finish[] = {0, (batch_finish(args), 0)...};
+        (void)finish;
+      }
+    };
+  } // namespace detail
+} // namespace clad
+
+#endif // CLAD_BATCH_H
@@ -3,10 +3,14 @@
 #ifndef CLAD_UTILS_CLADUTILS_H
 #define CLAD_UTILS_CLADUTILS_H
 
+#include "llvm/ADT/StringRef.h"
+
 #include <string>
 
 namespace clang {
+  class ASTContext;
   class FunctionDecl;
+  class StringLiteral;
 }
 
 namespace clad {
@@ -16,6 +20,11 @@ namespace clad {
     /// Otherwise if `FD` is an ordinary function, returns the name of the
     /// function `FD`.
     std::string ComputeEffectiveFnName(const clang::FunctionDecl* FD);
+
+    /// Converts the string `str` into a StringLiteral, e.g. to build the
+    /// `args` of nested differentiation requests.
+    const clang::StringLiteral* CreateStringLiteral(clang::ASTContext& C,
+                                                    llvm::StringRef str);
   }
 }
 
@@ -14,6 +14,8 @@
 #include "clang/AST/Stmt.h"
 #include "clang/Basic/Version.h"
 #include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PreprocessorOptions.h"
 #include "clang/Sema/Sema.h"
 
 namespace clad_compat {
@@ -522,6 +524,12 @@ Sema_ActOnStartOfSwitchStmt(Sema& SemaRef, Stmt* initStmt,
 #define CLAD_COMPAT_llvm_sys_fs_Append llvm::sys::fs::OF_Append
 #endif
 
+#if LLVM_VERSION_MAJOR < 13
+#define CLAD_COMPAT_llvm_sys_fs_Text llvm::sys::fs::F_Text
+#elif LLVM_VERSION_MAJOR >= 13
+#define CLAD_COMPAT_llvm_sys_fs_Text llvm::sys::fs::OF_Text
+#endif
+
 #if CLANG_VERSION_MAJOR > 8
 static inline Qualifiers CXXMethodDecl_getMethodQualifiers(const CXXMethodDecl* MD) {
    return MD->getMethodQualifiers();
@@ -535,6 +543,58 @@ static inline Qualifiers CXXMethodDecl_getMethodQualifiers(const CXXMethodDecl*
    return Qualifiers::fromFastMask(MD->getTypeQualifiers());
 }
 #endif
+
+/// Clang >= 9 added a parameter to `Preprocessor::EnterTokenStream` telling if
+/// the tokens were already lexed once.
+static inline void Preprocessor_EnterTokenStream(Preprocessor& PP,
+                                                 std::unique_ptr<Token[]> Toks,
+                                                 unsigned NumToks,
+                                                 bool DisableMacroExpansion) {
+#if CLANG_VERSION_MAJOR < 9
+  PP.EnterTokenStream(std::move(Toks), NumToks, DisableMacroExpansion);
+#elif CLANG_VERSION_MAJOR >= 9
+  PP.EnterTokenStream(std::move(Toks), NumToks, DisableMacroExpansion,
+                      /*IsReinject=*/false);
+#endif
+}
+/// Creates a preprocessor sharing the sources, the headers and the
+/// diagnostics of PP, but with a state of its own. Clang >= 9 removed the
+/// MemoryBufferCache parameter of the constructor.
+static inline std::unique_ptr<Preprocessor>
+Preprocessor_CreateSibling(Preprocessor& PP, LangOptions& LangOpts) {
+  auto PPOpts = std::make_shared<PreprocessorOptions>();
+#if CLANG_VERSION_MAJOR < 9
+  return std::unique_ptr<Preprocessor>(new Preprocessor(
+      PPOpts, PP.getDiagnostics(), LangOpts, PP.getSourceManager(),
+      PP.getPCMCache(), PP.getHeaderSearchInfo(), PP.getModuleLoader()));
+#elif CLANG_VERSION_MAJOR >= 9
+  return std::unique_ptr<Preprocessor>(
+      new Preprocessor(PPOpts, PP.getDiagnostics(), LangOpts,
+                       PP.getSourceManager(), PP.getHeaderSearchInfo(),
+                       PP.getModuleLoader()));
+#endif
+}
+/// Discards the value of the initializer of VD which Sema evaluated, so that
+/// it is evaluated again once the initializer was modified. Clang >= 12
+/// renamed the ICE flags and records whether the initialization is constant.
+static inline void VarDecl_ResetEvaluatedInit(VarDecl* VD) {
+  EvaluatedStmt* Eval = VD->getEvaluatedStmt();
+  if (!Eval)
+    return;
+  Eval->WasEvaluated = false;
+  Eval->Evaluated = APValue();
+#if CLANG_VERSION_MAJOR < 12
+  Eval->CheckedICE = false;
+  Eval->IsICE = false;
+#elif CLANG_VERSION_MAJOR >= 12
+  Eval->CheckedForICEInit = false;
+  Eval->HasICEInit = false;
+  if (VD->getASTContext().getLangOpts().CPlusPlus) {
+    SmallVector<PartialDiagnosticAt, 8> Notes;
+    VD->checkForConstantInitialization(Notes);
+  }
+#endif
+}
 } // namespace clad_compat
 
 #endif //CLAD_COMPATIBILITY
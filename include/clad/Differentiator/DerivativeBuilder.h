@@ -10,8 +10,11 @@
 #include "Compatibility.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/AST/StmtVisitor.h"
+#include "clang/Sema/Lookup.h"
 #include "clang/Sema/Sema.h"
 
+#include "llvm/ADT/Optional.h"
+
 #include <array>
 #include <stack>
 #include <unordered_map>
@@ -21,6 +24,7 @@ namespace clang {
   class CXXOperatorCallExpr;
   class DeclRefExpr;
   class FunctionDecl;
+  class FunctionTemplateDecl;
   class MemberExpr;
   class NamespaceDecl;
   class Scope;
@@ -33,6 +37,7 @@ namespace clad {
     class StmtClone;
   }
   struct DiffRequest;
+  class Profiler;
   namespace plugin {
     class CladPlugin;
     clang::FunctionDecl* ProcessDiffRequest(CladPlugin& P,
@@ -58,8 +63,9 @@ namespace clad {
 namespace clad {
   class ErrorEstimationHandler;
   class FPErrorEstimationModel;
-  // A pointer to a the handler to be used for estimation requests.
-  extern std::unique_ptr<ErrorEstimationHandler> errorEstHandler;
+  // A pointer to a the handler to be used for estimation requests. Each thread
+  // differentiating a translation unit has its own, see clad-gen.
+  extern thread_local std::unique_ptr<ErrorEstimationHandler> errorEstHandler;
 
   /// A pair of FunctionDecl and potential enclosing context, e.g. a function
   /// in nested namespaces.
@@ -86,13 +92,17 @@ namespace clad {
   private:
     friend class VisitorBase;
     friend class ForwardModeVisitor;
+    friend class GenericFPVisitor;
     friend class ReverseModeVisitor;
     friend class HessianModeVisitor;
     friend class JacobianModeVisitor;
+    friend class TaylorModeVisitor;
 
     clang::Sema& m_Sema;
     plugin::CladPlugin& m_CladPlugin;
     clang::ASTContext& m_Context;
+    /// Measures the phases of the differentiation, see -fprofile-report.
+    Profiler& m_Profiler;
     std::unique_ptr<utils::StmtClone> m_NodeCloner;
     clang::NamespaceDecl* m_BuiltinDerivativesNSD;
     /// A reference to the model to use for error estimation (if any).
@@ -101,6 +111,21 @@ namespace clad {
     /// A flag to keep track of whether error diagnostics are requested by user
     /// for numerical differentiation.
     bool m_PrintNumericalDiffErrorDiag = false;
+    /// The declarations of the clad runtime used by the visitors, looked up
+    /// once per translation unit.
+    struct CladRuntimeDecls {
+      clang::NamespaceDecl* Namespace = nullptr;
+      clang::TemplateDecl* Tape = nullptr;
+      clang::TemplateDecl* ArrayRef = nullptr;
+      clang::TemplateDecl* Array = nullptr;
+      clang::TemplateDecl* Taylor = nullptr;
+      clang::TemplateDecl* HessianSeries = nullptr;
+      clang::TemplateDecl* HessianDiagonalSeries = nullptr;
+      clang::QualType TaskGroup;
+      llvm::Optional<clang::LookupResult> TapePush;
+      llvm::Optional<clang::LookupResult> TapePop;
+      llvm::Optional<clang::LookupResult> TapeBack;
+    } m_RuntimeDecls;
     DeclWithContext cloneFunction(const clang::FunctionDecl* FD,
                                   clad::VisitorBase VB, clang::DeclContext* DC,
                                   clang::Sema& m_Sema,
@@ -119,6 +144,7 @@ namespace clad {
     /// \param[in] namespaceShouldExist A flag to enforce assertion failure
     /// if the overload function namespace was not found. If false and
     /// the function containing namespace was not found, nullptr is returned.
+    /// The custom derivatives are opt-in, so their namespace may be missing.
     ///
     /// \returns The call expression if a suitable function overload was found,
     /// null otherwise.
@@ -126,7 +152,11 @@ namespace clad {
     findOverloadedDefinition(clang::DeclarationNameInfo DNI,
                              llvm::SmallVectorImpl<clang::Expr*>& CallArgs,
                              bool forCustomDerv = true,
-                             bool namespaceShouldExist = true);
+                             bool namespaceShouldExist = false);
+    /// \returns false if the namespace of the custom derivatives is not
+    /// declared, i.e. clad/Differentiator/BuiltinDerivatives.h is not included
+    /// and the translation unit defines no custom derivative.
+    bool hasCustomDerivatives();
     bool noOverloadExists(clang::Expr* UnresolvedLookup,
                           llvm::MutableArrayRef<clang::Expr*> ARargs);
     /// Shorthand to issues a warning or error.
@@ -142,7 +172,7 @@ namespace clad {
     }
 
   public:
-    DerivativeBuilder(clang::Sema& S, plugin::CladPlugin& P);
+    DerivativeBuilder(clang::Sema& S, plugin::CladPlugin& P, Profiler& Prof);
     ~DerivativeBuilder();
     /// Reset the model use for error estimation (if any).
     /// \param[in] estModel The error estimation model, can be either
@@ -172,6 +202,28 @@ namespace clad {
     ///
     OverloadedDeclWithContext Derive(const clang::FunctionDecl* FD,
                                      const DiffRequest& request);
+    ///\brief Produces a function template over the floating-point type
+    /// from the derivative of request.Function, see clad::opts::generic_fp.
+    ///
+    ///\param[in] Derivative - the derivative of request.Function.
+    ///
+    ///\returns The templated function and potentially created enclosing
+    /// context, or null if the derivative cannot be rewritten.
+    DeclWithContext DeriveGenericFP(const clang::FunctionDecl* Derivative,
+                                    const DiffRequest& request);
+    ///\brief Instantiates a function template produced by DeriveGenericFP
+    /// for another floating-point type.
+    ///
+    ///\param[in] Template - the function template over the floating-point
+    /// type.
+    ///\param[in] FPType - the floating-point type of the specialization.
+    ///\param[in] Loc - the point of instantiation.
+    ///
+    ///\returns The defined specialization, or null if the template could not
+    /// be instantiated.
+    clang::FunctionDecl*
+    InstantiateGenericFP(clang::FunctionTemplateDecl* Template,
+                         clang::QualType FPType, clang::SourceLocation Loc);
   };
 
 } // end namespace clad
@@ -0,0 +1,84 @@
+// This file defines the options that can be passed to the clad API functions
+// as template arguments, e.g. clad::differentiate<3, clad::opts::taylor>(f).
+// It is shared between the runtime headers and the plugin.
+
+#ifndef CLAD_DIFF_OPTIONS_H
+#define CLAD_DIFF_OPTIONS_H
+
+namespace clad {
+  namespace opts {
+    /// Bit-masked options accepted by the clad API functions.
+    enum : unsigned {
+      /// Computes all derivatives up to the requested order in a single
+      /// generated function by propagating truncated Taylor series.
+      taylor = 1u << 0,
+      /// Computes the Jacobian matrix in forward mode, one column per
+      /// independent parameter, e.g. clad::jacobian<clad::opts::
+      /// jacobian_forward>(f). Preferable if f has few inputs and many
+      /// outputs.
+      jacobian_forward = 1u << 1,
+      /// Computes the Jacobian matrix in reverse mode, one row per output.
+      jacobian_reverse = 1u << 2,
+      /// Computes the Jacobian matrix in reverse mode by executing the
+      /// forward sweep once and replaying the reverse sweep once per output
+      /// over the same stored intermediates.
+      jacobian_replay = 1u << 3,
+      /// Computes only the structurally nonzero entries of the Jacobian
+      /// matrix, detected from the function body. Independent parameters
+      /// which never affect the same output share a forward mode sweep. The
+      /// entries are stored in row-major order, together with their row and
+      /// column indices.
+      jacobian_sparse = 1u << 4,
+      /// Computes the Hessian matrix in a single generated function which
+      /// executes the primal once and propagates the second order series
+      /// w.r.t. all the independent parameters, instead of generating two
+      /// derivatives per column. Each operation on a series costs O(n^2) for
+      /// n independent variables, against O(n) per column otherwise, so it
+      /// pays off for a few variables and an expensive primal only. At most
+      /// HessianSeriesMaxVariables variables are supported.
+      hessian_fused = 1u << 5,
+      /// Computes the Hessian matrix as with `hessian_fused` but stores only
+      /// its upper triangle, row by row, in n(n+1)/2 entries. The entry (i, j),
+      /// i <= j, is at index i * n - i * (i - 1) / 2 + (j - i).
+      hessian_packed = 1u << 6,
+      /// Computes only the structurally nonzero entries of the Hessian matrix,
+      /// detected from the function body. The independent parameters are
+      /// star colored and each color is computed by one Hessian-vector
+      /// product. The entries are stored in row-major order, together with
+      /// their row and column indices.
+      hessian_sparse = 1u << 7,
+      /// Computes the columns of the Hessian matrix in parallel, see
+      /// clad::task_group. Each column writes its own part of the matrix.
+      /// Only affects the default mode, which generates one derivative per
+      /// column.
+      hessian_parallel = 1u << 8,
+      /// Additionally emits the derivative as a function template over the
+      /// floating-point type of the original function, e.g.
+      /// `template <typename T> void f_grad(T x, clad::array_ref<T> _d_x)`.
+      /// Literals, locals, tapes and the calls to the derivatives of the
+      /// called functions are expressed in terms of T, so the template can be
+      /// instantiated with SIMD vector types. Supported by clad::gradient and
+      /// clad::differentiate.
+      generic_fp = 1u << 9,
+    };
+  } // namespace opts
+
+  /// The largest number of independent variables of the Hessians computed
+  /// with `opts::hessian_fused` or `opts::hessian_packed`, see
+  /// clad::hessian_series.
+  constexpr unsigned HessianSeriesMaxVariables = 32;
+
+  /// \returns the bitwise or of all the options.
+  constexpr unsigned GetBitMaskedOpts() { return 0; }
+  template <typename... Opts>
+  constexpr unsigned GetBitMaskedOpts(unsigned first, Opts... opts) {
+    return first | GetBitMaskedOpts(opts...);
+  }
+
+  /// \returns true if all the bits of `option` are set in `bitmask`.
+  constexpr bool HasOption(unsigned bitmask, unsigned option) {
+    return (bitmask & option) == option;
+  }
+} // namespace clad
+
+#endif // CLAD_DIFF_OPTIONS_H
@@ -1,5 +1,7 @@
 #include "clang/AST/RecursiveASTVisitor.h"
 
+#include "clad/Differentiator/DiffOptions.h"
+
 #include "llvm/ADT/SmallSet.h"
 
 namespace clang {
@@ -22,7 +24,10 @@ namespace clad {
     reverse,
     hessian,
     jacobian,
-    error_estimation
+    error_estimation,
+    taylor,
+    hessian_vector_product,
+    hessian_diagonal
   };
 
   /// A struct containing information about request to differentiate a function.
@@ -39,10 +44,36 @@ namespace clad {
     /// Context in which the function is being called, or a call to
     /// clad::gradient/differentiate, where function is the first arg.
     clang::CallExpr* CallContext = nullptr;
+    /// The variable initialized by CallContext, if any, e.g. `f_grad` in
+    /// `auto f_grad = clad::gradient(f);`.
+    clang::VarDecl* CallContextVar = nullptr;
     /// Args provided to the call to clad::gradient/differentiate.
     const clang::Expr* Args = nullptr;
     /// Requested differentiation mode, forward or reverse.
     DiffMode Mode = DiffMode::unknown;
+    /// Bitmask of the clad::opts passed as template arguments to the
+    /// clad::differentiate/gradient/... call.
+    unsigned BitMaskedOpts = 0;
+    /// If non-zero, the forward mode derivative is a column of the Jacobian
+    /// matrix of a vector-valued function, stored in its last parameter, and
+    /// the matrix has this many columns. See JacobianModeVisitor.
+    unsigned JacobianNumColumns = 0;
+    /// The index of the Jacobian column computed if JacobianNumColumns is set.
+    unsigned JacobianColumn = 0;
+    /// If non-zero, the reverse mode Jacobian replays the reverse sweep for
+    /// this many outputs over a single recording of the forward sweep.
+    unsigned JacobianNumRows = 0;
+    /// If not empty, the forward mode derivative is a compressed column of a
+    /// sparse Jacobian: all the parameters in Args are seeded at once and the
+    /// derivative of output[i] is stored at index JacobianSparseEntries[i] of
+    /// the values of the matrix, or discarded if the index is negative. The
+    /// column is named BaseFunctionName + "_col" + JacobianColumn.
+    std::vector<int> JacobianSparseEntries;
+    /// If set, the forward mode derivative is the directional derivative
+    /// along a direction passed in extra parameters, one per parameter in
+    /// Args, e.g. double f_dvec(double x, double y, double _dir_x,
+    /// double _dir_y).
+    bool DirectionalDerivative = false;
     /// If function appears in the call to clad::gradient/differentiate,
     /// the call must be updated and the first arg replaced by the derivative.
     bool CallUpdateRequired = false;
@@ -61,14 +92,27 @@ namespace clad {
   };
 
   using DiffSchedule = llvm::SmallVector<DiffRequest, 16>;
+  /// The disjoint source ranges where clad is enabled, in translation unit
+  /// order. The last one may be open.
   using DiffInterval = std::vector<clang::SourceRange>;
   using DerivativesSet = llvm::SmallSet<const clang::Decl*, 16>;
+  /// The expansion locations of the macros whose definitions spell a call
+  /// to clad, in translation unit order.
+  using CladMacroExpansions = std::vector<clang::SourceLocation>;
+
+  /// \returns true if the identifier is `clad` or the name of one of the
+  /// differentiation functions, e.g. `gradient`.
+  bool isCladAPIIdentifier(llvm::StringRef Name);
 
   class DiffCollector: public clang::RecursiveASTVisitor<DiffCollector> {
     /// The source interval where clad was activated.
     ///
     DiffInterval& m_Interval;
 
+    /// The macros which may expand to a call to clad.
+    ///
+    const CladMacroExpansions& m_MacroExpansions;
+
     /// The list of already generated derivatives. There is no need to collect
     /// calls as there are none.
     ///
@@ -82,15 +126,29 @@ namespace clad {
     /// add them for implicit diff.
     ///
     const clang::FunctionDecl* m_TopMostFD = nullptr;
+    /// The innermost variable whose declaration is being visited.
+    ///
+    clang::VarDecl* m_CurrentVar = nullptr;
     clang::Sema& m_Sema;
 
   public:
     DiffCollector(clang::DeclGroupRef DGR, DiffInterval& Interval,
+                  const CladMacroExpansions& MacroExpansions,
                   const DerivativesSet& Derivatives,
                   DiffSchedule& plans, clang::Sema& S);
     bool VisitCallExpr(clang::CallExpr* E);
+    bool TraverseVarDecl(clang::VarDecl* VD);
 
   private:
     bool isInInterval(clang::SourceLocation Loc) const;
+    /// \returns true if the range [Begin, End] intersects one of the
+    /// intervals where clad is enabled.
+    bool isInInterval(clang::SourceLocation Begin,
+                      clang::SourceLocation End) const;
+    /// \returns false if the declaration cannot contain a call to clad: it
+    /// lies outside of the intervals where clad is enabled, or its source
+    /// neither spells one of the clad API identifiers nor expands a macro
+    /// which does.
+    bool mayCallClad(const clang::Decl* D) const;
   };
 }
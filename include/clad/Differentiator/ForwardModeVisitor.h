@@ -16,6 +16,7 @@
 #include <array>
 #include <stack>
 #include <unordered_map>
+#include <vector>
 
 namespace clad {
   /// A visitor for processing the function code in forward mode.
@@ -28,6 +29,28 @@ namespace clad {
     unsigned m_IndependentVarIndex = ~0;
     unsigned m_DerivativeOrder = ~0;
     unsigned m_ArgIndex = ~0;
+    /// The vector output parameter of the function if the derivative is a
+    /// column of its Jacobian matrix, see DiffRequest::JacobianNumColumns.
+    const clang::ValueDecl* m_VectorOutput = nullptr;
+    /// Reference to the Jacobian matrix parameter, row-major.
+    clang::Expr* m_JacobianMatrix = nullptr;
+    unsigned m_JacobianColumn = 0;
+    unsigned m_JacobianNumColumns = 0;
+    /// The indices of the values of a sparse Jacobian matrix, see
+    /// DiffRequest::JacobianSparseEntries.
+    std::vector<int> m_JacobianSparseEntries;
+    /// Reference to the variable receiving the derivatives of the outputs
+    /// which are structurally zero in a compressed column.
+    clang::Expr* m_JacobianZero = nullptr;
+    /// The parameters holding the direction of a directional derivative, see
+    /// DiffRequest::DirectionalDerivative, and for arrays the interval of
+    /// indices the direction covers.
+    std::unordered_map<const clang::ValueDecl*,
+                       std::pair<const clang::ParmVarDecl*, IndexInterval>>
+        m_Directions;
+    /// Set if the derivatives of the called functions are also generated as
+    /// function templates, see clad::opts::generic_fp.
+    bool m_GenericFP = false;
 
   public:
     ForwardModeVisitor(DerivativeBuilder& builder);
@@ -98,6 +121,22 @@ namespace clad {
     /// \return active switch case label after processing `stmt`
     clang::SwitchCase* DeriveSwitchStmtBodyHelper(const clang::Stmt* stmt,
                                                   clang::SwitchCase* activeSC);
+
+    /// Builds the `jacobianMatrix[idx * numColumns + column]` expression
+    /// holding the derivative of `output[idx]` w.r.t. the independent
+    /// variable. For a compressed column of a sparse Jacobian it is the
+    /// entry of the values given by m_JacobianSparseEntries instead.
+    clang::Expr* BuildJacobianEntry(clang::Expr* idx);
+    /// Returns the type of the direction parameter of a directional
+    /// derivative w.r.t. a parameter of type T, i.e. T itself for scalars and
+    /// a pointer to the const elements for arrays.
+    clang::QualType GetDirectionType(clang::QualType T);
+    /// Builds the derivative of `array[idx]` in a directional derivative,
+    /// i.e. the element of the direction for the index, or 0 if the index is
+    /// outside of the interval.
+    clang::Expr* BuildDirectionEntry(const clang::ParmVarDecl* direction,
+                                     IndexInterval interval,
+                                     const clang::Expr* idx);
   };
 } // end namespace clad
 
@@ -2,7 +2,9 @@
 #define FUNCTION_TRAITS
 
 #include "clad/Differentiator/ArrayRef.h"
+#include "clad/Differentiator/DiffOptions.h"
 
+#include <cstddef>
 #include <type_traits>
 
 namespace clad {
@@ -449,84 +451,6 @@ namespace clad {
     using type = NoFunction*;
   };
 
-  /// This specific specialization is for error estimation calls.
-  template <class T, class = void> struct GradientDerivedEstFnTraits {};
-
-  // GradientDerivedEstFnTraits is used to deduce type of the derived functions
-  // derived using reverse modes
-  template <class T>
-  using GradientDerivedEstFnTraits_t = typename GradientDerivedEstFnTraits<
-      T>::type;
-
-  // GradientDerivedEstFnTraits specializations for pure function pointer types
-  template <class ReturnType, class... Args>
-  struct GradientDerivedEstFnTraits<ReturnType (*)(Args...)> {
-    using type = void (*)(Args..., OutputParamType_t<Args, ReturnType>...,
-                          double&);
-  };
-
-  /// These macro expansions are used to cover all possible cases of
-  /// qualifiers in member functions when declaring GradientDerivedFnTraits.
-  /// They need to be read from bottom to top. Starting from the use of AddCON,
-  /// the call to which is used to pass the cases with and without C-style
-  /// varargs, then as the macro name AddCON says it adds cases of const
-  /// qualifier. The AddVOL and AddREF macro similarly add cases for volatile
-  /// qualifier and reference respectively. The AddNOEX adds cases for noexcept
-  /// qualifier only if it is supported and finally AddSPECS declares the
-  /// function with all the cases
-#define GradientDerivedEstFnTraits_AddSPECS(var, cv, vol, ref, noex)           \
-  template <typename R, typename C, typename... Args>                          \
-  struct GradientDerivedEstFnTraits<R (C::*)(Args...) cv vol ref noex> {       \
-    using type = void (C::*)(Args..., OutputParamType_t<Args, R>...,           \
-                             double&) cv vol ref noex;                         \
-  };
-
-#if __cpp_noexcept_function_type > 0
-#define GradientDerivedEstFnTraits_AddNOEX(var, con, vol, ref)                 \
-  GradientDerivedEstFnTraits_AddSPECS(var, con, vol, ref, )                    \
-      GradientDerivedEstFnTraits_AddSPECS(var, con, vol, ref, noexcept)
-#else
-#define GradientDerivedEstFnTraits_AddNOEX(var, con, vol, ref)                 \
-  GradientDerivedEstFnTraits_AddSPECS(var, con, vol, ref, )
-#endif
-
-#define GradientDerivedEstFnTraits_AddREF(var, con, vol)                       \
-  GradientDerivedEstFnTraits_AddNOEX(var, con, vol, )                          \
-      GradientDerivedEstFnTraits_AddNOEX(var, con, vol, &)                     \
-          GradientDerivedEstFnTraits_AddNOEX(var, con, vol, &&)
-
-#define GradientDerivedEstFnTraits_AddVOL(var, con)                            \
-  GradientDerivedEstFnTraits_AddREF(var, con, )                                \
-      GradientDerivedEstFnTraits_AddREF(var, con, volatile)
-
-#define GradientDerivedEstFnTraits_AddCON(var)                                 \
-  GradientDerivedEstFnTraits_AddVOL(var, )                                     \
-      GradientDerivedEstFnTraits_AddVOL(var, const)
-
-  GradientDerivedEstFnTraits_AddCON(()); // Declares all the specializations
-
-  /// Specialization for class types
-  /// If class have exactly one user defined call operator, then defines
-  /// member typedef `type` same as the type of the derived function of the
-  /// call operator, otherwise defines member typedef `type` as the type of
-  /// `NoFunction*`.
-  template <class F>
-  struct GradientDerivedEstFnTraits<
-      F, typename std::enable_if<
-             std::is_class<remove_reference_and_pointer_t<F>>::value &&
-             has_call_operator<F>::value>::type> {
-    using ClassType = typename std::decay<
-        remove_reference_and_pointer_t<F>>::type;
-    using type = GradientDerivedEstFnTraits_t<decltype(&ClassType::operator())>;
-  };
-  template <class F>
-  struct GradientDerivedEstFnTraits<
-      F, typename std::enable_if<
-             std::is_class<remove_reference_and_pointer_t<F>>::value &&
-             !has_call_operator<F>::value>::type> {
-    using type = NoFunction*;
-  };
-
   template <class... Args> struct SelectLast;
 
   template <class... Args>
@@ -612,6 +536,83 @@ namespace clad {
     using type = NoFunction*;
   };
 
+  template <class T, class = void> struct SparseJacobianDerivedFnTraits {};
+
+  // SparseJacobianDerivedFnTraits is used to deduce type of the derived
+  // functions derived using jacobian mode with `clad::opts::jacobian_sparse`.
+  // Additionally to the output and the values of the matrix they take the
+  // arrays of row and column indices and return the number of nonzeros.
+  template <class T>
+  using SparseJacobianDerivedFnTraits_t =
+      typename SparseJacobianDerivedFnTraits<T>::type;
+
+  // SparseJacobianDerivedFnTraits specializations for pure function pointer
+  // types
+  template <class ReturnType, class... Args>
+  struct SparseJacobianDerivedFnTraits<ReturnType (*)(Args...)> {
+    using type = std::size_t (*)(Args..., SelectLast_t<Args...>, std::size_t*,
+                                 std::size_t*);
+  };
+
+  /// These macro expansions are used to cover all possible cases of
+  /// qualifiers in member functions when declaring
+  /// SparseJacobianDerivedFnTraits. See JacobianDerivedFnTraits for the
+  /// details.
+#define SparseJacobianDerivedFnTraits_AddSPECS(var, cv, vol, ref, noex)        \
+  template <typename R, typename C, typename... Args>                          \
+  struct SparseJacobianDerivedFnTraits<R (C::*)(Args...) cv vol ref noex> {    \
+    using type = std::size_t (C::*)(Args..., SelectLast_t<Args...>,            \
+                                    std::size_t*, std::size_t*) cv vol ref     \
+        noex;                                                                  \
+  };
+
+#if __cpp_noexcept_function_type > 0
+#define SparseJacobianDerivedFnTraits_AddNOEX(var, con, vol, ref)              \
+  SparseJacobianDerivedFnTraits_AddSPECS(var, con, vol, ref, )                 \
+      SparseJacobianDerivedFnTraits_AddSPECS(var, con, vol, ref, noexcept)
+#else
+#define SparseJacobianDerivedFnTraits_AddNOEX(var, con, vol, ref)              \
+  SparseJacobianDerivedFnTraits_AddSPECS(var, con, vol, ref, )
+#endif
+
+#define SparseJacobianDerivedFnTraits_AddREF(var, con, vol)                    \
+  SparseJacobianDerivedFnTraits_AddNOEX(var, con, vol, )                       \
+      SparseJacobianDerivedFnTraits_AddNOEX(var, con, vol, &)                  \
+          SparseJacobianDerivedFnTraits_AddNOEX(var, con, vol, &&)
+
+#define SparseJacobianDerivedFnTraits_AddVOL(var, con)                         \
+  SparseJacobianDerivedFnTraits_AddREF(var, con, )                             \
+      SparseJacobianDerivedFnTraits_AddREF(var, con, volatile)
+
+#define SparseJacobianDerivedFnTraits_AddCON(var)                              \
+  SparseJacobianDerivedFnTraits_AddVOL(var, )                                  \
+      SparseJacobianDerivedFnTraits_AddVOL(var, const)
+
+  SparseJacobianDerivedFnTraits_AddCON(()); // Declares all the specializations
+
+  /// Specialization for class types
+  /// If class have exactly one user defined call operator, then defines
+  /// member typedef `type` same as the type of the derived function of the
+  /// call operator, otherwise defines member typedef `type` as the type of
+  /// `NoFunction*`.
+  template <class F>
+  struct SparseJacobianDerivedFnTraits<
+      F, typename std::enable_if<
+             std::is_class<remove_reference_and_pointer_t<F>>::value &&
+             has_call_operator<F>::value>::type> {
+    using ClassType =
+        typename std::decay<remove_reference_and_pointer_t<F>>::type;
+    using type =
+        SparseJacobianDerivedFnTraits_t<decltype(&ClassType::operator())>;
+  };
+  template <class F>
+  struct SparseJacobianDerivedFnTraits<
+      F, typename std::enable_if<
+             std::is_class<remove_reference_and_pointer_t<F>>::value &&
+             !has_call_operator<F>::value>::type> {
+    using type = NoFunction*;
+  };
+
   template <class T, class = void> struct HessianDerivedFnTraits {};
 
   // HessianDerivedFnTraits is used to deduce type of the derived functions
@@ -685,6 +686,161 @@ namespace clad {
     using type = NoFunction*;
   };
 
+  template <class T, class = void>
+  struct HessianVectorProductDerivedFnTraits {};
+
+  // HessianVectorProductDerivedFnTraits is used to deduce type of the derived
+  // functions derived using clad::hessian_vector_product. They take the
+  // direction and the product as additional `array_ref<R>` parameters.
+  template <class T>
+  using HessianVectorProductDerivedFnTraits_t =
+      typename HessianVectorProductDerivedFnTraits<T>::type;
+
+  // HessianVectorProductDerivedFnTraits specializations for pure function
+  // pointer types
+  template <class ReturnType, class... Args>
+  struct HessianVectorProductDerivedFnTraits<ReturnType (*)(Args...)> {
+    using type = void (*)(Args..., array_ref<ReturnType>,
+                          array_ref<ReturnType>);
+  };
+
+  /// These macro expansions are used to cover all possible cases of
+  /// qualifiers in member functions when declaring
+  /// HessianVectorProductDerivedFnTraits. See HessianDerivedFnTraits for the
+  /// details.
+#define HessianVectorProductDerivedFnTraits_AddSPECS(var, cv, vol, ref, noex)  \
+  template <typename R, typename C, typename... Args>                          \
+  struct HessianVectorProductDerivedFnTraits<R (C::*)(Args...) cv vol ref      \
+                                                 noex> {                       \
+    using type = void (C::*)(Args..., array_ref<R>, array_ref<R>) cv vol ref   \
+        noex;                                                                  \
+  };
+
+#if __cpp_noexcept_function_type > 0
+#define HessianVectorProductDerivedFnTraits_AddNOEX(var, con, vol, ref)        \
+  HessianVectorProductDerivedFnTraits_AddSPECS(var, con, vol, ref, )           \
+      HessianVectorProductDerivedFnTraits_AddSPECS(var, con, vol, ref,         \
+                                                   noexcept)
+#else
+#define HessianVectorProductDerivedFnTraits_AddNOEX(var, con, vol, ref)        \
+  HessianVectorProductDerivedFnTraits_AddSPECS(var, con, vol, ref, )
+#endif
+
+#define HessianVectorProductDerivedFnTraits_AddREF(var, con, vol)              \
+  HessianVectorProductDerivedFnTraits_AddNOEX(var, con, vol, )                 \
+      HessianVectorProductDerivedFnTraits_AddNOEX(var, con, vol, &)            \
+          HessianVectorProductDerivedFnTraits_AddNOEX(var, con, vol, &&)
+
+#define HessianVectorProductDerivedFnTraits_AddVOL(var, con)                   \
+  HessianVectorProductDerivedFnTraits_AddREF(var, con, )                       \
+      HessianVectorProductDerivedFnTraits_AddREF(var, con, volatile)
+
+#define HessianVectorProductDerivedFnTraits_AddCON(var)                        \
+  HessianVectorProductDerivedFnTraits_AddVOL(var, )                            \
+      HessianVectorProductDerivedFnTraits_AddVOL(var, const)
+
+  // Declares all the specializations
+  HessianVectorProductDerivedFnTraits_AddCON(());
+
+  /// Specialization for class types
+  /// If class have exactly one user defined call operator, then defines
+  /// member typedef `type` same as the type of the derived function of the
+  /// call operator, otherwise defines member typedef `type` as the type of
+  /// `NoFunction*`.
+  template <class F>
+  struct HessianVectorProductDerivedFnTraits<
+      F, typename std::enable_if<
+             std::is_class<remove_reference_and_pointer_t<F>>::value &&
+             has_call_operator<F>::value>::type> {
+    using ClassType =
+        typename std::decay<remove_reference_and_pointer_t<F>>::type;
+    using type = HessianVectorProductDerivedFnTraits_t<
+        decltype(&ClassType::operator())>;
+  };
+  template <class F>
+  struct HessianVectorProductDerivedFnTraits<
+      F, typename std::enable_if<
+             std::is_class<remove_reference_and_pointer_t<F>>::value &&
+             !has_call_operator<F>::value>::type> {
+    using type = NoFunction*;
+  };
+
+  template <class T, class = void> struct SparseHessianDerivedFnTraits {};
+
+  // SparseHessianDerivedFnTraits is used to deduce type of the derived
+  // functions derived using hessian mode with `clad::opts::hessian_sparse`.
+  // Additionally to the values of the matrix they take the arrays of row and
+  // column indices and return the number of nonzeros.
+  template <class T>
+  using SparseHessianDerivedFnTraits_t =
+      typename SparseHessianDerivedFnTraits<T>::type;
+
+  // SparseHessianDerivedFnTraits specializations for pure function pointer
+  // types
+  template <class ReturnType, class... Args>
+  struct SparseHessianDerivedFnTraits<ReturnType (*)(Args...)> {
+    using type = std::size_t (*)(Args..., array_ref<ReturnType>, std::size_t*,
+                                 std::size_t*);
+  };
+
+  /// These macro expansions are used to cover all possible cases of
+  /// qualifiers in member functions when declaring
+  /// SparseHessianDerivedFnTraits. See HessianDerivedFnTraits for the
+  /// details.
+#define SparseHessianDerivedFnTraits_AddSPECS(var, cv, vol, ref, noex)         \
+  template <typename R, typename C, typename... Args>                          \
+  struct SparseHessianDerivedFnTraits<R (C::*)(Args...) cv vol ref noex> {     \
+    using type = std::size_t (C::*)(Args..., array_ref<R>, std::size_t*,       \
+                                    std::size_t*) cv vol ref noex;             \
+  };
+
+#if __cpp_noexcept_function_type > 0
+#define SparseHessianDerivedFnTraits_AddNOEX(var, con, vol, ref)               \
+  SparseHessianDerivedFnTraits_AddSPECS(var, con, vol, ref, )                  \
+      SparseHessianDerivedFnTraits_AddSPECS(var, con, vol, ref, noexcept)
+#else
+#define SparseHessianDerivedFnTraits_AddNOEX(var, con, vol, ref)               \
+  SparseHessianDerivedFnTraits_AddSPECS(var, con, vol, ref, )
+#endif
+
+#define SparseHessianDerivedFnTraits_AddREF(var, con, vol)                     \
+  SparseHessianDerivedFnTraits_AddNOEX(var, con, vol, )                        \
+      SparseHessianDerivedFnTraits_AddNOEX(var, con, vol, &)                   \
+          SparseHessianDerivedFnTraits_AddNOEX(var, con, vol, &&)
+
+#define SparseHessianDerivedFnTraits_AddVOL(var, con)                          \
+  SparseHessianDerivedFnTraits_AddREF(var, con, )                              \
+      SparseHessianDerivedFnTraits_AddREF(var, con, volatile)
+
+#define SparseHessianDerivedFnTraits_AddCON(var)                               \
+  SparseHessianDerivedFnTraits_AddVOL(var, )                                   \
+      SparseHessianDerivedFnTraits_AddVOL(var, const)
+
+  SparseHessianDerivedFnTraits_AddCON(()); // Declares all the specializations
+
+  /// Specialization for class types
+  /// If class have exactly one user defined call operator, then defines
+  /// member typedef `type` same as the type of the derived function of the
+  /// call operator, otherwise defines member typedef `type` as the type of
+  /// `NoFunction*`.
+  template <class F>
+  struct SparseHessianDerivedFnTraits<
+      F, typename std::enable_if<
+             std::is_class<remove_reference_and_pointer_t<F>>::value &&
+             has_call_operator<F>::value>::type> {
+    using ClassType =
+        typename std::decay<remove_reference_and_pointer_t<F>>::type;
+    using type =
+        SparseHessianDerivedFnTraits_t<decltype(&ClassType::operator())>;
+  };
+  template <class F>
+  struct SparseHessianDerivedFnTraits<
+      F, typename std::enable_if<
+             std::is_class<remove_reference_and_pointer_t<F>>::value &&
+             !has_call_operator<F>::value>::type> {
+    using type = NoFunction*;
+  };
+
   /// Compute type of derived function of function, method or functor when
   /// differentiated using forward differentiation mode
   /// (`clad::differentiate`). Computed type is provided as member typedef
@@ -758,6 +914,38 @@ namespace clad {
     using type = NoFunction*;
   };
 
+  /// Compute type of derived function of function, method or functor when
+  /// differentiated using `clad::differentiate` with the options
+  /// `BitMaskedOpts`. In Taylor mode (`clad::opts::taylor`) the derived
+  /// function has the same signature as the one computed by
+  /// `HessianDerivedFnTraits`, i.e. an additional `array_ref<R>` output
+  /// parameter; otherwise it is the type computed by
+  /// `ExtractDerivedFnTraitsForwMode`.
+  template <class F, unsigned BitMaskedOpts>
+  using DifferentiateDerivedFnTraits_t = typename std::conditional<
+      HasOption(BitMaskedOpts, opts::taylor), HessianDerivedFnTraits<F>,
+      ExtractDerivedFnTraitsForwMode<F>>::type::type;
+
+  /// Compute type of derived function of function, method or functor when
+  /// differentiated using `clad::jacobian` with the options `BitMaskedOpts`.
+  /// With `clad::opts::jacobian_sparse` it is the type computed by
+  /// `SparseJacobianDerivedFnTraits`, otherwise the type computed by
+  /// `JacobianDerivedFnTraits`.
+  template <class F, unsigned BitMaskedOpts>
+  using SelectJacobianDerivedFnTraits_t = typename std::conditional<
+      HasOption(BitMaskedOpts, opts::jacobian_sparse),
+      SparseJacobianDerivedFnTraits<F>, JacobianDerivedFnTraits<F>>::type::type;
+
+  /// Compute type of derived function of function, method or functor when
+  /// differentiated using `clad::hessian` with the options `BitMaskedOpts`.
+  /// With `clad::opts::hessian_sparse` it is the type computed by
+  /// `SparseHessianDerivedFnTraits`, otherwise the type computed by
+  /// `HessianDerivedFnTraits`.
+  template <class F, unsigned BitMaskedOpts>
+  using SelectHessianDerivedFnTraits_t = typename std::conditional<
+      HasOption(BitMaskedOpts, opts::hessian_sparse),
+      SparseHessianDerivedFnTraits<F>, HessianDerivedFnTraits<F>>::type::type;
+
   /// Placeholder type for denoting no object type exists.
   ///
   /// This is used by `ExtractFunctorTraits` type trait as value of member
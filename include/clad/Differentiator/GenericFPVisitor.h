@@ -0,0 +1,108 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#ifndef CLAD_GENERIC_FP_VISITOR_H
+#define CLAD_GENERIC_FP_VISITOR_H
+
+#include "Compatibility.h"
+#include "VisitorBase.h"
+#include "clang/AST/StmtVisitor.h"
+#include "clang/Sema/Sema.h"
+
+#include "llvm/ADT/DenseMap.h"
+
+namespace clad {
+  /// A visitor rewriting a generated derivative into a function template over
+  /// the floating-point type of the differentiated function, used for
+  /// clad::opts::generic_fp.
+  ///
+  /// For `double f(double x, double y)` the gradient
+  /// `void f_grad(double x, double y, clad::array_ref<double> _d_x, ...)` is
+  /// rewritten into
+  /// `template <typename T> void f_grad(T x, T y, clad::array_ref<T> _d_x,
+  /// ...)`. Every occurrence of the floating-point type in the types of the
+  /// parameters and the locals, including pointers, arrays and clad classes
+  /// such as clad::tape<double>, is replaced with T. Floating-point literals
+  /// and the values implicitly converted to the floating-point type are cast
+  /// to T. Calls to functions, e.g. the derivatives of the called functions
+  /// and the builtin derivatives, are left unresolved until the instantiation,
+  /// so that the overloads for T are found.
+  ///
+  /// The visitor works on the derivative, which is already built, rather than
+  /// on the original function, so all the differentiation modes share it.
+  class GenericFPVisitor
+      : public clang::ConstStmtVisitor<GenericFPVisitor, clang::Stmt*>,
+        public VisitorBase {
+  private:
+    /// The floating-point type replaced by the template parameter.
+    clang::QualType m_FPType;
+    /// The type of the template parameter T.
+    clang::QualType m_TemplateParmType;
+    /// Maps the parameters, variables and labels of the derivative to their
+    /// counterparts in the function template.
+    llvm::DenseMap<const clang::Decl*, clang::Decl*> m_DeclMap;
+    /// The name of the first construct which cannot be rewritten, if any.
+    llvm::StringRef m_Unsupported;
+
+  public:
+    GenericFPVisitor(DerivativeBuilder& builder);
+    ~GenericFPVisitor();
+
+    ///\brief Produces a function template over the floating-point type from
+    /// the derivative of a given function.
+    ///
+    ///\param[in] Derivative - the derivative of request.Function.
+    ///
+    ///\returns The templated function declaration and potentially created
+    /// enclosing context, or null if the derivative cannot be rewritten.
+    DeclWithContext Derive(const clang::FunctionDecl* Derivative,
+                           const DiffRequest& request);
+
+    clang::Stmt* VisitArraySubscriptExpr(const clang::ArraySubscriptExpr* ASE);
+    clang::Stmt* VisitBinaryOperator(const clang::BinaryOperator* BinOp);
+    clang::Stmt* VisitCallExpr(const clang::CallExpr* CE);
+    clang::Stmt* VisitCompoundStmt(const clang::CompoundStmt* CS);
+    clang::Stmt* VisitConditionalOperator(const clang::ConditionalOperator* CO);
+    clang::Stmt* VisitCXXBindTemporaryExpr(
+        const clang::CXXBindTemporaryExpr* BTE);
+    clang::Stmt* VisitCXXConstructExpr(const clang::CXXConstructExpr* CE);
+    clang::Stmt* VisitCXXOperatorCallExpr(
+        const clang::CXXOperatorCallExpr* OpCall);
+    clang::Stmt* VisitDeclRefExpr(const clang::DeclRefExpr* DRE);
+    clang::Stmt* VisitDeclStmt(const clang::DeclStmt* DS);
+    clang::Stmt* VisitDoStmt(const clang::DoStmt* DS);
+    clang::Stmt* VisitExplicitCastExpr(const clang::ExplicitCastExpr* ECE);
+    clang::Stmt* VisitExprWithCleanups(const clang::ExprWithCleanups* EWC);
+    clang::Stmt* VisitFloatingLiteral(const clang::FloatingLiteral* FL);
+    clang::Stmt* VisitForStmt(const clang::ForStmt* FS);
+    clang::Stmt* VisitGotoStmt(const clang::GotoStmt* GS);
+    clang::Stmt* VisitIfStmt(const clang::IfStmt* If);
+    clang::Stmt* VisitImplicitCastExpr(const clang::ImplicitCastExpr* ICE);
+    clang::Stmt* VisitInitListExpr(const clang::InitListExpr* ILE);
+    clang::Stmt* VisitLabelStmt(const clang::LabelStmt* LS);
+    clang::Stmt*
+    VisitMaterializeTemporaryExpr(const clang::MaterializeTemporaryExpr* MTE);
+    clang::Stmt* VisitMemberExpr(const clang::MemberExpr* ME);
+    clang::Stmt* VisitParenExpr(const clang::ParenExpr* PE);
+    clang::Stmt* VisitReturnStmt(const clang::ReturnStmt* RS);
+    clang::Stmt* VisitStmt(const clang::Stmt* S);
+    clang::Stmt* VisitUnaryOperator(const clang::UnaryOperator* UnOp);
+    clang::Stmt* VisitWhileStmt(const clang::WhileStmt* WS);
+
+  private:
+    /// Returns `T` with every occurrence of the floating-point type replaced
+    /// with the template parameter.
+    clang::QualType GetGenericType(clang::QualType T);
+    /// Shorthand to visit an expression, which may be null.
+    clang::Expr* RebuildExpr(const clang::Expr* E) {
+      return E ? llvm::cast_or_null<clang::Expr>(Visit(E)) : nullptr;
+    }
+    /// Returns the label of the function template corresponding to `LD`.
+    clang::LabelDecl* GetLabel(const clang::LabelDecl* LD);
+  };
+} // end namespace clad
+
+#endif // CLAD_GENERIC_FP_VISITOR_H
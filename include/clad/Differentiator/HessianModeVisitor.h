@@ -19,18 +19,39 @@
 
 namespace clad {
   /// A visitor for processing the function code to generate hessians
-  /// Used to compute Hessian matrices by clad::hessian.
+  /// Used to compute Hessian matrices by clad::hessian and their diagonal by
+  /// clad::hessian_diagonal.
   class HessianModeVisitor
       : public clang::ConstStmtVisitor<HessianModeVisitor, StmtDiff>,
         public VisitorBase {
   private:
     /// A helper method that combines all the generated second derivatives
     /// (contained within a vector) obtained from Derive
-    /// into a single FunctionDecl f_hessian
+    /// into a single FunctionDecl f_hessian. If parallel is true, the second
+    /// derivatives are executed in parallel by a clad::task_group.
     OverloadedDeclWithContext
     Merge(std::vector<clang::FunctionDecl*> secDerivFuncs,
           llvm::SmallVector<size_t, 16> IndependentArgsSize,
-          size_t TotalIndependentArgsSize, std::string hessianFuncName);
+          size_t TotalIndependentArgsSize, std::string hessianFuncName,
+          bool parallel = false);
+    /// Derives the product of the hessian of the function with a direction,
+    /// requested by clad::hessian_vector_product. Generates the directional
+    /// derivative 'f_dvec' in forward mode, its gradient 'f_dvec_grad' in
+    /// reverse mode and a function 'f_hessian_vector_product' calling it.
+    OverloadedDeclWithContext
+    DeriveHessianVectorProduct(const clang::FunctionDecl* FD,
+                               const DiffRequest& request);
+    /// Computes the structurally nonzero entries of the hessian, see
+    /// clad::opts::hessian_sparse. The pairs of independent parameters which
+    /// interact nonlinearly are detected from the function body and the
+    /// parameters are star colored. Every color is computed by one
+    /// hessian-vector product 'f_hessian_vector_product' seeded with all its
+    /// parameters, from which each nonzero is recovered directly.
+    OverloadedDeclWithContext DeriveSparse(
+        const clang::FunctionDecl* FD, const DiffRequest& request,
+        llvm::ArrayRef<std::pair<const clang::ParmVarDecl*, IndexInterval>>
+            independentArgs,
+        const std::string& hessianFuncName);
 
   public:
     HessianModeVisitor(DerivativeBuilder& builder);
@@ -0,0 +1,437 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#ifndef CLAD_HESSIAN_SERIES_H
+#define CLAD_HESSIAN_SERIES_H
+
+#include "clad/Differentiator/CladConfig.h"
+#include "clad/Differentiator/DiffOptions.h"
+
+#include <math.h>
+#include <type_traits>
+
+namespace clad {
+  namespace detail {
+    /// The derivatives of a series. They are stored in the object if they
+    /// fit in a few cache lines, otherwise on the heap so that the
+    /// temporaries of the generated functions do not exhaust the stack.
+    template <typename T, unsigned Size, bool OnHeap = (Size > 64)>
+    class series_storage {
+      T m_Data[Size];
+
+    public:
+      CUDA_HOST_DEVICE T* data() { return m_Data; }
+      CUDA_HOST_DEVICE const T* data() const { return m_Data; }
+    };
+
+    template <typename T, unsigned Size>
+    class series_storage<T, Size, /*OnHeap=*/true> {
+      T* m_Data;
+
+    public:
+      CUDA_HOST_DEVICE series_storage() : m_Data(new T[Size]) {}
+      CUDA_HOST_DEVICE series_storage(const series_storage& other)
+          : m_Data(new T[Size]) {
+        for (unsigned i = 0; i < Size; ++i)
+          m_Data[i] = other.m_Data[i];
+      }
+      CUDA_HOST_DEVICE series_storage(series_storage&& other)
+          : m_Data(other.m_Data) {
+        other.m_Data = nullptr;
+      }
+      CUDA_HOST_DEVICE series_storage& operator=(const series_storage& other) {
+        if (!m_Data)
+          m_Data = new T[Size];
+        for (unsigned i = 0; i < Size; ++i)
+          m_Data[i] = other.m_Data[i];
+        return *this;
+      }
+      CUDA_HOST_DEVICE series_storage& operator=(series_storage&& other) {
+        T* data = m_Data;
+        m_Data = other.m_Data;
+        other.m_Data = data;
+        return *this;
+      }
+      CUDA_HOST_DEVICE ~series_storage() { delete[] m_Data; }
+
+      CUDA_HOST_DEVICE T* data() { return m_Data; }
+      CUDA_HOST_DEVICE const T* data() const { return m_Data; }
+    };
+  } // namespace detail
+
+  /// Truncated Taylor series of degree 2 of a value with respect to N
+  /// independent variables, i.e. its value, gradient and Hessian. Hessians
+  /// generated with `clad::hessian<clad::opts::hessian_fused>` propagate these
+  /// through a single copy of the function, so the primal is computed once
+  /// and all the columns are written together. Since the Hessian is
+  /// symmetric only its upper triangle is stored, still every operation below
+  /// costs O(N^2) operations and every series holds 1 + N + N(N+1)/2 values,
+  /// whereas the default mode costs O(N) per operation. Hence N is bounded by
+  /// HessianSeriesMaxVariables.
+  template <typename T, unsigned N> class hessian_series {
+    /// The number of distinct second order partial derivatives.
+    static constexpr unsigned NumMixed = N * (N + 1) / 2;
+
+    static_assert(N <= HessianSeriesMaxVariables,
+                  "too many independent variables for a hessian series");
+
+    T m_Value;
+    /// The gradient, followed by the upper triangle of the Hessian stored row
+    /// by row.
+    detail::series_storage<T, N + NumMixed> m_Derivs;
+
+    CUDA_HOST_DEVICE T* grad() { return m_Derivs.data(); }
+    CUDA_HOST_DEVICE const T* grad() const { return m_Derivs.data(); }
+    CUDA_HOST_DEVICE T* hess() { return m_Derivs.data() + N; }
+    CUDA_HOST_DEVICE const T* hess() const { return m_Derivs.data() + N; }
+
+  public:
+    using value_type = T;
+
+    /// Constructs the series of a constant.
+    CUDA_HOST_DEVICE hessian_series(T value = 0) : m_Value(value) {
+      for (unsigned i = 0; i < N; ++i)
+        grad()[i] = 0;
+      for (unsigned k = 0; k < NumMixed; ++k)
+        hess()[k] = 0;
+    }
+
+    /// Marks the series as the one of the i-th independent variable.
+    CUDA_HOST_DEVICE void make_independent(unsigned i) { grad()[i] = 1; }
+
+    /// Returns the index of the entry (i, j), i <= j, of the upper triangle.
+    CUDA_HOST_DEVICE static unsigned packed_index(unsigned i, unsigned j) {
+      return i * N - i * (i - 1) / 2 + (j - i);
+    }
+
+    /// Returns the value of the series at the expansion point.
+    CUDA_HOST_DEVICE T value() const { return m_Value; }
+    /// Returns the derivative w.r.t. the i-th independent variable.
+    CUDA_HOST_DEVICE T gradient(unsigned i) const { return grad()[i]; }
+    /// Returns the second derivative w.r.t. the i-th and j-th independent
+    /// variables.
+    CUDA_HOST_DEVICE T hessian(unsigned i, unsigned j) const {
+      return i <= j ? hess()[packed_index(i, j)] : hess()[packed_index(j, i)];
+    }
+
+    /// Stores the N x N Hessian into `out`.
+    template <typename Out>
+    CUDA_HOST_DEVICE void store_derivatives(Out out) const {
+      for (unsigned i = 0; i < N; ++i)
+        for (unsigned j = i; j < N; ++j)
+          out[i * N + j] = out[j * N + i] = hess()[packed_index(i, j)];
+    }
+    /// Stores the upper triangle of the Hessian into `out`, the entry (i, j)
+    /// is at packed_index(i, j).
+    template <typename Out>
+    CUDA_HOST_DEVICE void store_packed_derivatives(Out out) const {
+      for (unsigned k = 0; k < NumMixed; ++k)
+        out[k] = hess()[k];
+    }
+
+    /// Returns the series of f(*this) given the value and the first two
+    /// derivatives of f at value(), using
+    /// d2f/dxidxj = f' * d2a/dxidxj + f'' * da/dxi * da/dxj.
+    CUDA_HOST_DEVICE hessian_series compose(T f, T df, T d2f) const {
+      hessian_series res(f);
+      for (unsigned i = 0, k = 0; i < N; ++i) {
+        res.grad()[i] = df * grad()[i];
+        for (unsigned j = i; j < N; ++j, ++k)
+          res.hess()[k] = df * hess()[k] + d2f * grad()[i] * grad()[j];
+      }
+      return res;
+    }
+
+    CUDA_HOST_DEVICE hessian_series operator-() const {
+      return compose(-m_Value, -1, 0);
+    }
+    CUDA_HOST_DEVICE hessian_series& operator+=(const hessian_series& rhs) {
+      m_Value += rhs.m_Value;
+      for (unsigned i = 0; i < N; ++i)
+        grad()[i] += rhs.grad()[i];
+      for (unsigned k = 0; k < NumMixed; ++k)
+        hess()[k] += rhs.hess()[k];
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_series& operator-=(const hessian_series& rhs) {
+      m_Value -= rhs.m_Value;
+      for (unsigned i = 0; i < N; ++i)
+        grad()[i] -= rhs.grad()[i];
+      for (unsigned k = 0; k < NumMixed; ++k)
+        hess()[k] -= rhs.hess()[k];
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_series& operator*=(const hessian_series& rhs) {
+      // The Hessian is updated first since it reads the old gradients.
+      for (unsigned i = 0, k = 0; i < N; ++i)
+        for (unsigned j = i; j < N; ++j, ++k)
+          hess()[k] = hess()[k] * rhs.m_Value + m_Value * rhs.hess()[k] +
+                      grad()[i] * rhs.grad()[j] + grad()[j] * rhs.grad()[i];
+      for (unsigned i = 0; i < N; ++i)
+        grad()[i] = grad()[i] * rhs.m_Value + m_Value * rhs.grad()[i];
+      m_Value *= rhs.m_Value;
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_series& operator/=(const hessian_series& rhs) {
+      T inv = 1 / rhs.m_Value;
+      return *this *= rhs.compose(inv, -inv * inv, 2 * inv * inv * inv);
+    }
+    CUDA_HOST_DEVICE hessian_series& operator+=(T rhs) {
+      m_Value += rhs;
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_series& operator-=(T rhs) {
+      m_Value -= rhs;
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_series& operator*=(T rhs) {
+      m_Value *= rhs;
+      for (unsigned i = 0; i < N; ++i)
+        grad()[i] *= rhs;
+      for (unsigned k = 0; k < NumMixed; ++k)
+        hess()[k] *= rhs;
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_series& operator/=(T rhs) {
+      return *this *= T(1) / rhs;
+    }
+    CUDA_HOST_DEVICE hessian_series& operator++() { return *this += T(1); }
+    CUDA_HOST_DEVICE hessian_series& operator--() { return *this -= T(1); }
+    CUDA_HOST_DEVICE hessian_series operator++(int) {
+      hessian_series res = *this;
+      *this += T(1);
+      return res;
+    }
+    CUDA_HOST_DEVICE hessian_series operator--(int) {
+      hessian_series res = *this;
+      *this -= T(1);
+      return res;
+    }
+  };
+
+  /// Truncated Taylor series of degree 2 of a value with respect to N
+  /// independent variables, restricted to the pure second derivatives, i.e.
+  /// its value, gradient and the diagonal of its Hessian. Used by
+  /// `clad::hessian_diagonal`, every operation below costs O(N) operations
+  /// since d2(uv)/dxi2 only depends on the derivatives of u and v w.r.t. xi.
+  template <typename T, unsigned N> class hessian_diagonal_series {
+    T m_Value;
+    T m_Grad[N];
+    T m_Diag[N];
+
+  public:
+    using value_type = T;
+
+    /// Constructs the series of a constant.
+    CUDA_HOST_DEVICE hessian_diagonal_series(T value = 0) : m_Value(value) {
+      for (unsigned i = 0; i < N; ++i)
+        m_Grad[i] = m_Diag[i] = 0;
+    }
+
+    /// Marks the series as the one of the i-th independent variable.
+    CUDA_HOST_DEVICE void make_independent(unsigned i) { m_Grad[i] = 1; }
+
+    /// Returns the value of the series at the expansion point.
+    CUDA_HOST_DEVICE T value() const { return m_Value; }
+    /// Returns the derivative w.r.t. the i-th independent variable.
+    CUDA_HOST_DEVICE T gradient(unsigned i) const { return m_Grad[i]; }
+    /// Returns the second derivative w.r.t. the i-th independent variable.
+    CUDA_HOST_DEVICE T hessian(unsigned i) const { return m_Diag[i]; }
+
+    /// Stores the diagonal of the Hessian into `out`.
+    template <typename Out>
+    CUDA_HOST_DEVICE void store_derivatives(Out out) const {
+      for (unsigned i = 0; i < N; ++i)
+        out[i] = m_Diag[i];
+    }
+
+    /// Returns the series of f(*this) given the value and the first two
+    /// derivatives of f at value().
+    CUDA_HOST_DEVICE hessian_diagonal_series compose(T f, T df, T d2f) const {
+      hessian_diagonal_series res(f);
+      for (unsigned i = 0; i < N; ++i) {
+        res.m_Grad[i] = df * m_Grad[i];
+        res.m_Diag[i] = df * m_Diag[i] + d2f * m_Grad[i] * m_Grad[i];
+      }
+      return res;
+    }
+
+    CUDA_HOST_DEVICE hessian_diagonal_series operator-() const {
+      return compose(-m_Value, -1, 0);
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series&
+    operator+=(const hessian_diagonal_series& rhs) {
+      m_Value += rhs.m_Value;
+      for (unsigned i = 0; i < N; ++i) {
+        m_Grad[i] += rhs.m_Grad[i];
+        m_Diag[i] += rhs.m_Diag[i];
+      }
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series&
+    operator-=(const hessian_diagonal_series& rhs) {
+      m_Value -= rhs.m_Value;
+      for (unsigned i = 0; i < N; ++i) {
+        m_Grad[i] -= rhs.m_Grad[i];
+        m_Diag[i] -= rhs.m_Diag[i];
+      }
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series&
+    operator*=(const hessian_diagonal_series& rhs) {
+      for (unsigned i = 0; i < N; ++i) {
+        m_Diag[i] = m_Diag[i] * rhs.m_Value + m_Value * rhs.m_Diag[i] +
+                    2 * m_Grad[i] * rhs.m_Grad[i];
+        m_Grad[i] = m_Grad[i] * rhs.m_Value + m_Value * rhs.m_Grad[i];
+      }
+      m_Value *= rhs.m_Value;
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series&
+    operator/=(const hessian_diagonal_series& rhs) {
+      T inv = 1 / rhs.m_Value;
+      return *this *= rhs.compose(inv, -inv * inv, 2 * inv * inv * inv);
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series& operator+=(T rhs) {
+      m_Value += rhs;
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series& operator-=(T rhs) {
+      m_Value -= rhs;
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series& operator*=(T rhs) {
+      m_Value *= rhs;
+      for (unsigned i = 0; i < N; ++i) {
+        m_Grad[i] *= rhs;
+        m_Diag[i] *= rhs;
+      }
+      return *this;
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series& operator/=(T rhs) {
+      return *this *= T(1) / rhs;
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series& operator++() {
+      return *this += T(1);
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series& operator--() {
+      return *this -= T(1);
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series operator++(int) {
+      hessian_diagonal_series res = *this;
+      *this += T(1);
+      return res;
+    }
+    CUDA_HOST_DEVICE hessian_diagonal_series operator--(int) {
+      hessian_diagonal_series res = *this;
+      *this -= T(1);
+      return res;
+    }
+  };
+
+  /// True for the series types above, which share the operators and the
+  /// propagation rules below.
+  template <typename S> struct is_second_order_series : std::false_type {};
+  template <typename T, unsigned N>
+  struct is_second_order_series<hessian_series<T, N>> : std::true_type {};
+  template <typename T, unsigned N>
+  struct is_second_order_series<hessian_diagonal_series<T, N>>
+      : std::true_type {};
+
+  /// Enables the overload only for the second order series type `S`.
+  template <typename S, typename R = S>
+  using enable_if_second_order_series_t =
+      typename std::enable_if<is_second_order_series<S>::value, R>::type;
+
+  // Binary operators. Arithmetic scalars are treated as constant series so
+  // that mixed expressions like `2 * x` do not need an explicit conversion.
+#define CLAD_HESSIAN_SERIES_BINARY_OP(op)                                      \
+  template <typename S>                                                        \
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> operator op(             \
+      S lhs, const S& rhs) {                                                   \
+    return lhs op## = rhs;                                                     \
+  }                                                                            \
+  template <typename S, typename U,                                            \
+            typename = typename std::enable_if<                                \
+                std::is_arithmetic<U>::value>::type>                           \
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> operator op(S lhs,       \
+                                                                  U rhs) {     \
+    return lhs op## = typename S::value_type(rhs);                             \
+  }                                                                            \
+  template <typename S, typename U,                                            \
+            typename = typename std::enable_if<                                \
+                std::is_arithmetic<U>::value>::type>                           \
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> operator op(             \
+      U lhs, const S& rhs) {                                                   \
+    return S(typename S::value_type(lhs)) op## = rhs;                          \
+  }
+
+  CLAD_HESSIAN_SERIES_BINARY_OP(+)
+  CLAD_HESSIAN_SERIES_BINARY_OP(-)
+  CLAD_HESSIAN_SERIES_BINARY_OP(*)
+  CLAD_HESSIAN_SERIES_BINARY_OP(/)
+
+#undef CLAD_HESSIAN_SERIES_BINARY_OP
+
+  // Propagation rules for the elementary functions, given by their first two
+  // derivatives.
+
+  template <typename S>
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> exp(const S& a) {
+    typename S::value_type e = ::exp(a.value());
+    return a.compose(e, e, e);
+  }
+
+  template <typename S>
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> log(const S& a) {
+    typename S::value_type inv = 1 / a.value();
+    return a.compose(::log(a.value()), inv, -inv * inv);
+  }
+
+  template <typename S>
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> sqrt(const S& a) {
+    typename S::value_type r = ::sqrt(a.value());
+    return a.compose(r, 1 / (2 * r), -1 / (4 * r * a.value()));
+  }
+
+  template <typename S>
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> sin(const S& a) {
+    typename S::value_type s = ::sin(a.value());
+    return a.compose(s, ::cos(a.value()), -s);
+  }
+
+  template <typename S>
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> cos(const S& a) {
+    typename S::value_type c = ::cos(a.value());
+    return a.compose(c, -::sin(a.value()), -c);
+  }
+
+  /// Computes a^p for a constant exponent.
+  template <typename S, typename U,
+            typename = typename std::enable_if<std::is_arithmetic<U>::value>::type>
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> pow(const S& a, U p) {
+    using T = typename S::value_type;
+    T x = a.value();
+    T q = T(p);
+    return a.compose(::pow(x, q), q * ::pow(x, q - 1),
+                     q * (q - 1) * ::pow(x, q - 2));
+  }
+
+  template <typename S>
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> pow(const S& a,
+                                                          const S& b) {
+    return exp(b * log(a));
+  }
+
+  template <typename S, typename U,
+            typename = typename std::enable_if<std::is_arithmetic<U>::value>::type>
+  CUDA_HOST_DEVICE enable_if_second_order_series_t<S> pow(U a, const S& b) {
+    using T = typename S::value_type;
+    return exp(b * T(::log(T(a))));
+  }
+} // namespace clad
+
+#endif // CLAD_HESSIAN_SERIES_H
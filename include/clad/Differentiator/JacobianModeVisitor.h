@@ -26,6 +26,30 @@ namespace clad {
   private:
     DerivativeBuilder& builder;
 
+    /// Decides whether the Jacobian is computed in forward mode, either
+    /// because it was requested with clad::opts::jacobian_forward or because
+    /// the function has fewer independent parameters than outputs.
+    bool ShouldUseForwardMode(const clang::FunctionDecl* FD,
+                              const DiffRequest& request,
+                              const DiffParams& args);
+    /// Computes every column of the Jacobian matrix by a forward mode
+    /// derivative w.r.t. one independent parameter, and merges the columns
+    /// into a single function 'f_jac' with the same signature as the one
+    /// generated in reverse mode.
+    OverloadedDeclWithContext
+    DeriveUsingForwardMode(const clang::FunctionDecl* FD,
+                           const DiffRequest& request, DiffParams args,
+                           const std::string& jacobianName);
+    /// Computes the structurally nonzero entries of the Jacobian matrix, see
+    /// clad::opts::jacobian_sparse. The sparsity pattern is detected from the
+    /// assignments in the function body and the independent parameters are
+    /// colored such that parameters with the same color never affect the
+    /// same output. Every color is computed by a single forward mode
+    /// derivative seeding all its parameters at once.
+    OverloadedDeclWithContext
+    DeriveSparse(const clang::FunctionDecl* FD, const DiffRequest& request,
+                 DiffParams args, const std::string& jacobianName);
+
   public:
     JacobianModeVisitor(DerivativeBuilder& builder);
     ~JacobianModeVisitor();
@@ -36,6 +60,10 @@ namespace clad {
     ///
     ///\returns A function containing jacobian matrix.
     ///
+    /// We name the jacobian of f as 'f_jac'. Uses ReverseModeVisitor to
+    /// compute one row of the matrix per output or, if forward mode was
+    /// chosen, ForwardModeVisitor to compute one column per independent
+    /// parameter.
     OverloadedDeclWithContext Derive(const clang::FunctionDecl* FD,
                                      const DiffRequest& request);
   };
@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#ifndef CLAD_PROFILER_H
+#define CLAD_PROFILER_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+} // namespace llvm
+
+namespace clad {
+  /// The phases of the generation of the derivatives measured by the Profiler.
+  enum class ProfilePhase : unsigned {
+    /// Finding the differentiation requests in a top-level declaration.
+    Collection = 0,
+    /// Instantiating the templates which are differentiated.
+    Instantiation,
+    /// Visiting the original function, excluding the phases below.
+    Visitor,
+    /// Cloning the statements of the original function.
+    Cloning,
+    /// Looking up the custom and numerical derivatives of the callees.
+    CustomDerivativeLookup,
+    /// Building the expressions and declarations through Sema.
+    SemaBuilding,
+    /// Handing the derivatives over to CodeGen.
+    CodeGen,
+    NumPhases
+  };
+
+  /// Measures the time spent in each ProfilePhase, in total and for every
+  /// differentiated function, see -fprofile-report. The phases nest, e.g. the
+  /// cloning happens while visiting, and the time of a phase excludes the
+  /// time of the phases started within it. While the -ftime-trace profiler of
+  /// clang is enabled, the phases and the functions are also recorded as its
+  /// events.
+  class Profiler {
+    using Clock = std::chrono::steady_clock;
+    static constexpr unsigned NumPhases =
+        static_cast<unsigned>(ProfilePhase::NumPhases);
+
+    struct FunctionRecord {
+      /// The qualified name of the differentiated function.
+      std::string Function;
+      /// The name of the derivative, empty if the differentiation failed.
+      std::string Derivative;
+      /// The time spent in each phase, in seconds.
+      double PhaseTimes[NumPhases] = {};
+      /// The time from the start to the end of the request, including the
+      /// derivatives it needed.
+      double TotalTime = 0;
+      /// The number of AST nodes of the derivative.
+      unsigned NumNodes = 0;
+      /// The number of statements copied and shared with the original
+      /// function by the cloning, excluding the derivatives it needed.
+      unsigned NumClonedNodes = 0;
+      unsigned NumSharedNodes = 0;
+      /// The memory allocated by the ASTContext during the request,
+      /// including the derivatives it needed.
+      std::size_t Memory = 0;
+      Clock::time_point Start;
+    };
+
+    struct ActivePhase {
+      ProfilePhase Phase;
+      Clock::time_point Start;
+    };
+
+    bool m_Enabled = false;
+    bool m_TimeTrace = false;
+    double m_PhaseTimes[NumPhases] = {};
+    std::vector<FunctionRecord> m_Functions;
+    /// The indices in m_Functions of the requests being processed, the
+    /// innermost last.
+    std::vector<std::size_t> m_FunctionStack;
+    std::vector<ActivePhase> m_PhaseStack;
+
+    /// Charges the time elapsed in the innermost phase to the innermost
+    /// function.
+    void flush(Clock::time_point Now);
+
+  public:
+    /// \param[in] WantReport - whether the report will be printed. The
+    /// profiler is enabled if it is the case or if -ftime-trace is.
+    explicit Profiler(bool WantReport);
+
+    bool isEnabled() const { return m_Enabled; }
+
+    void startPhase(ProfilePhase Phase);
+    void stopPhase();
+
+    /// Starts recording the request to differentiate the function. The
+    /// memory is the amount allocated by the ASTContext so far.
+    void startFunction(llvm::StringRef Function, std::size_t Memory);
+    /// Ends the innermost function record.
+    void stopFunction(llvm::StringRef Derivative, unsigned NumNodes,
+                      std::size_t Memory);
+
+    /// Adds the statements cloned and shared by the cloner to the innermost
+    /// function record.
+    void addClonedNodes(unsigned NumCloned, unsigned NumShared);
+
+    /// Prints the phase times and the function records as JSON.
+    void printJSON(llvm::raw_ostream& OS) const;
+
+    /// \returns the name of the phase in the report.
+    static llvm::StringRef getPhaseName(ProfilePhase Phase);
+  };
+
+  /// Attributes the time spent in its scope to the phase.
+  class ProfileScope {
+    Profiler& m_Profiler;
+    bool m_Active;
+
+  public:
+    ProfileScope(Profiler& P, ProfilePhase Phase)
+        : m_Profiler(P), m_Active(P.isEnabled()) {
+      if (m_Active)
+        m_Profiler.startPhase(Phase);
+    }
+    ~ProfileScope() {
+      if (m_Active)
+        m_Profiler.stopPhase();
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+  };
+} // namespace clad
+
+#endif // CLAD_PROFILER_H
@@ -48,6 +48,17 @@ namespace clad {
     unsigned outputArrayCursor = 0;
     unsigned numParams = 0;
     bool isVectorValued = false;
+    /// The number of outputs of a vector-valued function if its Jacobian is
+    /// computed by replaying the reverse sweep once per output over a single
+    /// recording of the forward sweep, see clad::opts::jacobian_replay.
+    unsigned m_NumOutputs = 0;
+    /// The declarations of the adjoint variables if the reverse sweep is
+    /// replayed. They are put in the beginning of every sweep, so that each
+    /// sweep starts from zero adjoints.
+    Stmts m_SweepAdjoints;
+    /// Set if the derivatives of the called functions are also generated as
+    /// function templates, see clad::opts::generic_fp.
+    bool m_GenericFP = false;
 
     const char* funcPostfix() const {
       if (isVectorValued)
@@ -102,22 +113,18 @@ namespace clad {
     }
     /// Create new block.
     Stmts& beginBlock(direction d = forward) {
-      if (d == forward)
-        m_Blocks.push_back({});
-      else
-        m_Reverse.push_back({});
-      return getCurrentBlock(d);
+      return pushBlock(d == forward ? m_Blocks : m_Reverse);
     }
     /// Remove the block from the stack, wrap it in CompoundStmt and return it.
     clang::CompoundStmt* endBlock(direction d = forward) {
       if (d == forward) {
         auto CS = MakeCompoundStmt(getCurrentBlock(forward));
-        m_Blocks.pop_back();
+        popBlock(m_Blocks);
         return CS;
       } else {
         auto CS = MakeCompoundStmt(getCurrentBlock(reverse));
         std::reverse(CS->body_begin(), CS->body_end());
-        m_Reverse.pop_back();
+        popBlock(m_Reverse);
         return CS;
       }
     }
@@ -134,6 +141,12 @@ namespace clad {
     /// \returns True if the statement was added to the block, false otherwise.
     bool AddToGlobalBlock(clang::Stmt* S) { return addToBlock(S, m_Globals); }
 
+    /// Adds the declaration of an adjoint variable to the global block, or to
+    /// the beginning of every reverse sweep if the sweep is replayed.
+    bool AddAdjointDecl(clang::Stmt* S) {
+      return addToBlock(S, m_NumOutputs ? m_SweepAdjoints : m_Globals);
+    }
+
     /// Stores the result of an expression in a temporary variable (of the same
     /// type as is the result of the expression) and returns a reference to it.
     /// If force decl creation is true, this will allways create a temporary
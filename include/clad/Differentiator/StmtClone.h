@@ -37,6 +37,9 @@ namespace utils {
     clang::Sema& m_Sema;
     clang::ASTContext& Ctx;
     Mapping* m_OriginalToClonedStmts;
+    /// The number of nodes copied and shared by Clone so far.
+    unsigned m_NumCloned = 0;
+    unsigned m_NumShared = 0;
 
     clang::Decl* CloneDecl(clang::Decl* Node);
     clang::VarDecl* CloneDeclOrNull(clang::VarDecl* Node);
@@ -45,9 +48,15 @@ namespace utils {
     StmtClone(clang::Sema& sema, clang::ASTContext& ctx, Mapping* originalToClonedStmts = 0)
       : m_Sema(sema), Ctx(ctx), m_OriginalToClonedStmts(originalToClonedStmts) {}
 
+    /// Clones the statement. The literals are immutable and refer to no
+    /// declaration, so they are shared with the original statement instead of
+    /// being copied, as the template instantiation does.
     template<class StmtTy>
     StmtTy* Clone(const StmtTy* S);
 
+    unsigned getNumCloned() const { return m_NumCloned; }
+    unsigned getNumShared() const { return m_NumShared; }
+
   // visitor part (not for public use)
   // Stmt.def could be used if ABSTR_STMT is introduced
 #define DECLARE_CLONE_FN(CLASS) clang::Stmt* Visit ## CLASS(clang::CLASS *Node);
@@ -133,6 +142,10 @@ namespace utils {
       return 0;
 
     clang::Stmt* clonedStmt = Visit(const_cast<StmtTy*>(S));
+    if (clonedStmt == S)
+      ++m_NumShared;
+    else
+      ++m_NumCloned;
 
     if (m_OriginalToClonedStmts)
       m_OriginalToClonedStmts->m_StmtMapping[S] = clonedStmt;
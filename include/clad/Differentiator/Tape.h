@@ -9,6 +9,46 @@
 #include "clad/Differentiator/CladConfig.h"
 
 namespace clad {
+#ifndef __CUDACC__
+  namespace detail {
+    /// \returns the number of active tape_reuse_scope objects in this thread.
+    inline unsigned& tape_reuse_depth() {
+      static thread_local unsigned depth = 0;
+      return depth;
+    }
+
+    /// The storage released by the last destroyed tape of type T in this
+    /// thread, kept for the next tape while a tape_reuse_scope is active.
+    template <typename T> struct tape_storage_cache {
+      void* data = nullptr;
+      std::size_t capacity = 0;
+      ~tape_storage_cache() { ::operator delete(data); }
+    };
+
+    template <typename T> tape_storage_cache<T>& get_tape_storage_cache() {
+      static thread_local tape_storage_cache<T> cache;
+      return cache;
+    }
+  } // namespace detail
+#endif
+
+  /// While an object of this class is alive, the tapes destroyed in the
+  /// current thread keep their storage for the next tape of the same type
+  /// instead of freeing it. This avoids an allocation per call when a
+  /// derived function is executed repeatedly, e.g. by execute_batch. The
+  /// storage is never reused in CUDA code.
+  class tape_reuse_scope {
+  public:
+#ifndef __CUDACC__
+    tape_reuse_scope() { ++detail::tape_reuse_depth(); }
+    ~tape_reuse_scope() { --detail::tape_reuse_depth(); }
+#else
+    tape_reuse_scope() {}
+#endif
+    tape_reuse_scope(const tape_reuse_scope&) = delete;
+    tape_reuse_scope& operator=(const tape_reuse_scope&) = delete;
+  };
+
   /// Dynamically-sized array (std::vector-like), primarily used for storing
   /// values in reverse-mode AD inside loops.
   template <typename T>
@@ -30,6 +70,18 @@ namespace clad {
 
     CUDA_HOST_DEVICE ~tape_impl(){
       destroy(begin(), end());
+#ifndef __CUDACC__
+      if (detail::tape_reuse_depth()) {
+        detail::tape_storage_cache<T>& cache =
+            detail::get_tape_storage_cache<T>();
+        if (_capacity > cache.capacity) {
+          ::operator delete(cache.data);
+          cache.data = _data;
+          cache.capacity = _capacity;
+          return;
+        }
+      }
+#endif
       // delete the old data here to make sure we do not leak anything.
       ::operator delete(const_cast<void*>(
             static_cast<const volatile void*>(_data)));
@@ -124,8 +176,21 @@ namespace clad {
     constexpr static std::size_t _init_capacity = 32;
     CUDA_HOST_DEVICE void grow() {
       // If empty, use initial capacity.
-      if (!_capacity)
+      if (!_capacity) {
+#ifndef __CUDACC__
+        // Take the storage of a previously destroyed tape, if any.
+        detail::tape_storage_cache<T>& cache =
+            detail::get_tape_storage_cache<T>();
+        if (detail::tape_reuse_depth() && cache.data) {
+          _data = static_cast<T*>(cache.data);
+          _capacity = cache.capacity;
+          cache.data = nullptr;
+          cache.capacity = 0;
+          return;
+        }
+#endif
         _capacity = _init_capacity;
+      }
       else
         // Double the capacity on each reallocation.
         _capacity *= 2;
@@ -0,0 +1,138 @@
+#ifndef CLAD_TASK_GROUP_H
+#define CLAD_TASK_GROUP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace clad {
+  /// Executes a group of independent tasks in parallel, primarily used for
+  /// computing the columns of a hessian with `clad::opts::hessian_parallel`.
+  /// The tasks are collected by run() and executed by wait(), by an OpenMP
+  /// parallel loop if OpenMP is enabled, otherwise by a pool of at most
+  /// std::thread::hardware_concurrency() threads including the calling one.
+  class task_group {
+    std::vector<std::function<void()>> m_Tasks;
+
+  public:
+    /// Reserves space for numTasks tasks.
+    explicit task_group(std::size_t numTasks) { m_Tasks.reserve(numTasks); }
+    task_group(const task_group&) = delete;
+    task_group& operator=(const task_group&) = delete;
+    ~task_group() { wait(); }
+
+    /// Adds the task calling fn(args...). The arguments are copied, tasks
+    /// must not write to the same memory.
+    template <typename F, typename... Args> void run(F fn, Args... args) {
+      m_Tasks.push_back(std::bind(fn, args...));
+    }
+
+    /// Executes all the added tasks and returns once they are finished.
+    void wait() {
+      std::size_t numTasks = m_Tasks.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+      for (long i = 0; i < (long)numTasks; ++i)
+        m_Tasks[i]();
+#else
+      std::size_t numThreads = std::thread::hardware_concurrency();
+      if (numThreads > numTasks)
+        numThreads = numTasks;
+      std::atomic<std::size_t> next(0);
+      auto worker = [this, &next, numTasks]() {
+        for (std::size_t i = next++; i < numTasks; i = next++)
+          m_Tasks[i]();
+      };
+      std::vector<std::thread> threads;
+      for (std::size_t i = 1; i < numThreads; ++i)
+        threads.emplace_back(worker);
+      worker();
+      for (std::thread& thread : threads)
+        thread.join();
+#endif
+      m_Tasks.clear();
+    }
+  };
+
+  namespace detail {
+    /// A range of chunk indices [begin, end) owned by a worker of
+    /// parallel_for. The owner takes chunks from the front and the other
+    /// workers steal them from the back. Both ends are packed in a single
+    /// atomic so that each update is one compare-and-swap.
+    class chunk_range {
+      std::atomic<std::uint64_t> m_Range;
+
+    public:
+      chunk_range() : m_Range(0) {}
+      void assign(std::uint64_t begin, std::uint64_t end) {
+        m_Range.store(begin << 32 | end);
+      }
+      /// Takes the first chunk of the range, returns false if it is empty.
+      bool pop_front(std::size_t& chunk) {
+        std::uint64_t range = m_Range.load();
+        do {
+          std::uint64_t begin = range >> 32, end = range & 0xffffffffu;
+          if (begin >= end)
+            return false;
+          chunk = begin;
+        } while (!m_Range.compare_exchange_weak(range, range + (1ull << 32)));
+        return true;
+      }
+      /// Takes the last chunk of the range, returns false if it is empty.
+      bool steal_back(std::size_t& chunk) {
+        std::uint64_t range = m_Range.load();
+        do {
+          std::uint64_t begin = range >> 32, end = range & 0xffffffffu;
+          if (begin >= end)
+            return false;
+          chunk = end - 1;
+        } while (!m_Range.compare_exchange_weak(range, range - 1));
+        return true;
+      }
+    };
+  } // namespace detail
+
+  /// Calls fn(chunk) for every chunk in [0, numChunks) in parallel. Each
+  /// thread starts with a contiguous share of the chunks and, once it is
+  /// done, steals the remaining chunks of the other threads. With OpenMP
+  /// enabled the chunks are scheduled dynamically by OpenMP instead.
+  template <typename F> void parallel_for(std::size_t numChunks, F fn) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+    for (long i = 0; i < (long)numChunks; ++i)
+      fn((std::size_t)i);
+#else
+    std::size_t numThreads = std::thread::hardware_concurrency();
+    if (numThreads > numChunks)
+      numThreads = numChunks;
+    if (numThreads <= 1) {
+      for (std::size_t i = 0; i < numChunks; ++i)
+        fn(i);
+      return;
+    }
+    std::vector<detail::chunk_range> ranges(numThreads);
+    for (std::size_t i = 0; i < numThreads; ++i)
+      ranges[i].assign(i * numChunks / numThreads,
+                       (i + 1) * numChunks / numThreads);
+    auto worker = [&ranges, &fn, numThreads](std::size_t id) {
+      std::size_t chunk = 0;
+      while (ranges[id].pop_front(chunk))
+        fn(chunk);
+      for (std::size_t i = 1; i < numThreads; ++i)
+        while (ranges[(id + i) % numThreads].steal_back(chunk))
+          fn(chunk);
+    };
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < numThreads; ++i)
+      threads.emplace_back(worker, i);
+    worker(0);
+    for (std::thread& thread : threads)
+      thread.join();
+#endif
+  }
+} // namespace clad
+
+#endif // CLAD_TASK_GROUP_H
@@ -0,0 +1,265 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#ifndef CLAD_TAYLOR_H
+#define CLAD_TAYLOR_H
+
+#include "clad/Differentiator/CladConfig.h"
+
+#include <math.h>
+#include <type_traits>
+
+namespace clad {
+  /// Truncated Taylor series `c[0] + c[1]*t + ... + c[N]*t^N` of a value
+  /// with respect to a single independent variable. Derivatives generated in
+  /// Taylor mode (`clad::differentiate<N, clad::opts::taylor>`) propagate
+  /// these instead of re-differentiating the function N times; every
+  /// operation below costs at most O(N^2) coefficient operations.
+  template <typename T, unsigned N> class taylor {
+    /// The Taylor coefficients, c[k] is the k-th derivative divided by k!.
+    T m_c[N + 1];
+
+  public:
+    /// Constructs the series of a constant.
+    CUDA_HOST_DEVICE taylor(T value = 0) {
+      m_c[0] = value;
+      for (unsigned k = 1; k <= N; ++k)
+        m_c[k] = 0;
+    }
+
+    /// Marks the series as the one of the independent variable.
+    CUDA_HOST_DEVICE void make_independent() {
+      if (N > 0)
+        m_c[1] = 1;
+    }
+
+    /// Returns the k-th Taylor coefficient.
+    CUDA_HOST_DEVICE T& operator[](unsigned k) { return m_c[k]; }
+    CUDA_HOST_DEVICE const T& operator[](unsigned k) const { return m_c[k]; }
+    /// Returns the value of the series at the expansion point.
+    CUDA_HOST_DEVICE T value() const { return m_c[0]; }
+
+    /// Stores the derivatives of order 0 to N into `out`, i.e. out[k] is
+    /// k! * c[k].
+    template <typename Out> CUDA_HOST_DEVICE void store_derivatives(Out out) const {
+      T factorial = 1;
+      for (unsigned k = 0; k <= N; ++k) {
+        if (k > 0)
+          factorial *= k;
+        out[k] = factorial * m_c[k];
+      }
+    }
+
+    CUDA_HOST_DEVICE taylor operator-() const {
+      taylor res;
+      for (unsigned k = 0; k <= N; ++k)
+        res.m_c[k] = -m_c[k];
+      return res;
+    }
+    CUDA_HOST_DEVICE taylor& operator+=(const taylor& rhs) {
+      for (unsigned k = 0; k <= N; ++k)
+        m_c[k] += rhs.m_c[k];
+      return *this;
+    }
+    CUDA_HOST_DEVICE taylor& operator-=(const taylor& rhs) {
+      for (unsigned k = 0; k <= N; ++k)
+        m_c[k] -= rhs.m_c[k];
+      return *this;
+    }
+    /// Cauchy product of the two series.
+    CUDA_HOST_DEVICE taylor& operator*=(const taylor& rhs) {
+      for (int k = N; k >= 0; --k) {
+        T sum = 0;
+        for (int j = 0; j <= k; ++j)
+          sum += m_c[j] * rhs.m_c[k - j];
+        m_c[k] = sum;
+      }
+      return *this;
+    }
+    /// Solves `rhs * res = *this` for the coefficients of `res`.
+    CUDA_HOST_DEVICE taylor& operator/=(taylor rhs) {
+      // rhs is taken by value since the recurrence overwrites the
+      // coefficients it reads when dividing a series by itself.
+      for (unsigned k = 0; k <= N; ++k) {
+        T sum = m_c[k];
+        for (unsigned j = 1; j <= k; ++j)
+          sum -= rhs.m_c[j] * m_c[k - j];
+        m_c[k] = sum / rhs.m_c[0];
+      }
+      return *this;
+    }
+    CUDA_HOST_DEVICE taylor& operator+=(T rhs) {
+      m_c[0] += rhs;
+      return *this;
+    }
+    CUDA_HOST_DEVICE taylor& operator-=(T rhs) {
+      m_c[0] -= rhs;
+      return *this;
+    }
+    CUDA_HOST_DEVICE taylor& operator*=(T rhs) {
+      for (unsigned k = 0; k <= N; ++k)
+        m_c[k] *= rhs;
+      return *this;
+    }
+    CUDA_HOST_DEVICE taylor& operator/=(T rhs) {
+      for (unsigned k = 0; k <= N; ++k)
+        m_c[k] /= rhs;
+      return *this;
+    }
+    CUDA_HOST_DEVICE taylor& operator++() { return *this += T(1); }
+    CUDA_HOST_DEVICE taylor& operator--() { return *this -= T(1); }
+    CUDA_HOST_DEVICE taylor operator++(int) {
+      taylor res = *this;
+      *this += T(1);
+      return res;
+    }
+    CUDA_HOST_DEVICE taylor operator--(int) {
+      taylor res = *this;
+      *this -= T(1);
+      return res;
+    }
+  };
+
+  // Binary operators. Arithmetic scalars are treated as constant series so
+  // that mixed expressions like `2 * x` do not need an explicit conversion.
+#define CLAD_TAYLOR_BINARY_OP(op)                                              \
+  template <typename T, unsigned N>                                            \
+  CUDA_HOST_DEVICE taylor<T, N> operator op(taylor<T, N> lhs,                  \
+                                            const taylor<T, N>& rhs) {         \
+    return lhs op## = rhs;                                                     \
+  }                                                                            \
+  template <typename T, unsigned N, typename U,                                \
+            typename = typename std::enable_if<                                \
+                std::is_arithmetic<U>::value>::type>                           \
+  CUDA_HOST_DEVICE taylor<T, N> operator op(taylor<T, N> lhs, U rhs) {         \
+    return lhs op## = T(rhs);                                                  \
+  }                                                                            \
+  template <typename T, unsigned N, typename U,                                \
+            typename = typename std::enable_if<                                \
+                std::is_arithmetic<U>::value>::type>                           \
+  CUDA_HOST_DEVICE taylor<T, N> operator op(U lhs, const taylor<T, N>& rhs) {  \
+    return taylor<T, N>(T(lhs)) op## = rhs;                                    \
+  }
+
+  CLAD_TAYLOR_BINARY_OP(+)
+  CLAD_TAYLOR_BINARY_OP(-)
+  CLAD_TAYLOR_BINARY_OP(*)
+  CLAD_TAYLOR_BINARY_OP(/)
+
+#undef CLAD_TAYLOR_BINARY_OP
+
+  // Propagation rules for the elementary functions. They are all derived
+  // from the ODE satisfied by the function, e.g. e' = a' * e for e = exp(a),
+  // which gives a recurrence over the coefficients of the result.
+
+  template <typename T, unsigned N>
+  CUDA_HOST_DEVICE taylor<T, N> exp(const taylor<T, N>& a) {
+    taylor<T, N> e(::exp(a[0]));
+    for (unsigned k = 1; k <= N; ++k) {
+      T sum = 0;
+      for (unsigned j = 1; j <= k; ++j)
+        sum += j * a[j] * e[k - j];
+      e[k] = sum / k;
+    }
+    return e;
+  }
+
+  template <typename T, unsigned N>
+  CUDA_HOST_DEVICE taylor<T, N> log(const taylor<T, N>& a) {
+    taylor<T, N> l(::log(a[0]));
+    for (unsigned k = 1; k <= N; ++k) {
+      T sum = 0;
+      for (unsigned j = 1; j < k; ++j)
+        sum += j * l[j] * a[k - j];
+      l[k] = (a[k] - sum / k) / a[0];
+    }
+    return l;
+  }
+
+  template <typename T, unsigned N>
+  CUDA_HOST_DEVICE taylor<T, N> sqrt(const taylor<T, N>& a) {
+    taylor<T, N> r(::sqrt(a[0]));
+    for (unsigned k = 1; k <= N; ++k) {
+      T sum = 0;
+      for (unsigned j = 1; j < k; ++j)
+        sum += r[j] * r[k - j];
+      r[k] = (a[k] - sum) / (2 * r[0]);
+    }
+    return r;
+  }
+
+  /// Computes sin(a) and cos(a) together since their recurrences are coupled.
+  template <typename T, unsigned N>
+  CUDA_HOST_DEVICE void sincos(const taylor<T, N>& a, taylor<T, N>& s,
+                               taylor<T, N>& c) {
+    s = taylor<T, N>(::sin(a[0]));
+    c = taylor<T, N>(::cos(a[0]));
+    for (unsigned k = 1; k <= N; ++k) {
+      T sumS = 0;
+      T sumC = 0;
+      for (unsigned j = 1; j <= k; ++j) {
+        sumS += j * a[j] * c[k - j];
+        sumC += j * a[j] * s[k - j];
+      }
+      s[k] = sumS / k;
+      c[k] = -sumC / k;
+    }
+  }
+
+  template <typename T, unsigned N>
+  CUDA_HOST_DEVICE taylor<T, N> sin(const taylor<T, N>& a) {
+    taylor<T, N> s, c;
+    sincos(a, s, c);
+    return s;
+  }
+
+  template <typename T, unsigned N>
+  CUDA_HOST_DEVICE taylor<T, N> cos(const taylor<T, N>& a) {
+    taylor<T, N> s, c;
+    sincos(a, s, c);
+    return c;
+  }
+
+  /// Computes a^p for a constant exponent using a * y' = p * a' * y. The
+  /// recurrence divides by a[0], at a[0] == 0 a non-negative integral power
+  /// is computed by repeated squaring instead.
+  template <typename T, unsigned N, typename U,
+            typename = typename std::enable_if<std::is_arithmetic<U>::value>::type>
+  CUDA_HOST_DEVICE taylor<T, N> pow(const taylor<T, N>& a, U p) {
+    if (a[0] == 0 && p >= 0 && T(p) == ::floor(T(p))) {
+      taylor<T, N> y(1);
+      taylor<T, N> b = a;
+      for (T e = ::floor(T(p)); e > 0; e = ::floor(e / 2)) {
+        if (::fmod(e, T(2)) == 1)
+          y *= b;
+        b *= b;
+      }
+      return y;
+    }
+    taylor<T, N> y(::pow(a[0], T(p)));
+    for (unsigned k = 1; k <= N; ++k) {
+      T sum = 0;
+      for (unsigned j = 1; j <= k; ++j)
+        sum += (T(p) * j - T(k - j)) * a[j] * y[k - j];
+      y[k] = sum / (k * a[0]);
+    }
+    return y;
+  }
+
+  template <typename T, unsigned N>
+  CUDA_HOST_DEVICE taylor<T, N> pow(const taylor<T, N>& a,
+                                    const taylor<T, N>& b) {
+    return exp(b * log(a));
+  }
+
+  template <typename T, unsigned N, typename U,
+            typename = typename std::enable_if<std::is_arithmetic<U>::value>::type>
+  CUDA_HOST_DEVICE taylor<T, N> pow(U a, const taylor<T, N>& b) {
+    return exp(b * T(::log(T(a))));
+  }
+} // namespace clad
+
+#endif // CLAD_TAYLOR_H
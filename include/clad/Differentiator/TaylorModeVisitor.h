@@ -0,0 +1,148 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#ifndef CLAD_TAYLOR_MODE_VISITOR_H
+#define CLAD_TAYLOR_MODE_VISITOR_H
+
+#include "Compatibility.h"
+#include "VisitorBase.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/AST/StmtVisitor.h"
+#include "clang/Sema/Sema.h"
+
+#include <unordered_map>
+
+namespace clad {
+  /// A visitor for processing the function code in Taylor mode.
+  /// Used to compute all the derivatives up to order N of a function w.r.t.
+  /// one parameter by clad::differentiate<N, clad::opts::taylor>.
+  ///
+  /// Every real variable `x` of the original function gets a shadow variable
+  /// `_d_x` of type clad::taylor<T, N> holding the truncated Taylor series of
+  /// `x`. Arithmetic on the shadow variables is resolved to the overloaded
+  /// operators of clad::taylor and calls to elementary functions are
+  /// redirected to their clad::taylor overloads, so the generated code costs
+  /// O(N^2) per operation instead of re-differentiating the function N times.
+  ///
+  /// In the result of Visit, Stmt() is the cloned primal statement and
+  /// Stmt_dx() is the statement/expression operating on the Taylor series.
+  /// A null Expr_dx() means that the expression does not depend on the
+  /// independent variable and its series is the constant Expr().
+  ///
+  /// The same propagation computes Hessians for
+  /// clad::hessian<clad::opts::hessian_fused> with shadow variables of type
+  /// clad::hessian_series<T, N>, the series of degree 2 w.r.t. all the N
+  /// independent variables, see DeriveHessian.
+  class TaylorModeVisitor
+      : public clang::ConstStmtVisitor<TaylorModeVisitor, StmtDiff>,
+        public VisitorBase {
+  private:
+    const clang::ValueDecl* m_IndependentVar = nullptr;
+    /// The highest derivative order computed.
+    unsigned m_Order = 0;
+    /// The type clad::taylor<R, N>, clad::hessian_series<R, N> or
+    /// clad::hessian_diagonal_series<R, N> used for the shadow variables.
+    clang::QualType m_TaylorType;
+    /// The output parameter receiving the derivatives.
+    clang::ParmVarDecl* m_Output = nullptr;
+    /// The independent parameters of a Hessian with the requested interval of
+    /// array parameters, in the order of the parameters of the function.
+    llvm::SmallVector<std::pair<const clang::ParmVarDecl*, IndexInterval>, 16>
+        m_HessianArgs;
+    /// The arrays holding the series of the requested elements of array
+    /// parameters, e.g. `_d_p` for "p[1:2]", with the requested interval.
+    std::unordered_map<const clang::ValueDecl*,
+                       std::pair<clang::VarDecl*, IndexInterval>>
+        m_ArraySeries;
+    /// Whether only the upper triangle of the Hessian is stored, see
+    /// clad::opts::hessian_packed.
+    bool m_PackedHessian = false;
+    /// Whether the function calls a function which has no propagation rule,
+    /// in which case no derivative is produced.
+    bool m_Unsupported = false;
+
+  public:
+    TaylorModeVisitor(DerivativeBuilder& builder);
+    ~TaylorModeVisitor();
+
+    ///\brief Produces a function computing the derivatives of order 0 to N
+    /// of a given function.
+    ///
+    ///\param[in] FD - the function that will be differentiated.
+    ///
+    ///\returns The differentiated and potentially created enclosing
+    /// context.
+    ///
+    OverloadedDeclWithContext Derive(const clang::FunctionDecl* FD,
+                                     const DiffRequest& request);
+    ///\brief Produces a single function computing the Hessian of a given
+    /// function, used by HessianModeVisitor for clad::opts::hessian_fused.
+    ///
+    /// Unlike the default Hessian mode which generates two derivatives per
+    /// column, the primal is computed once and all the columns are written
+    /// by `void f_hessian(Args..., clad::array_ref<R> hessianMatrix)`. With
+    /// clad::opts::hessian_packed only the upper triangle is written and for
+    /// clad::hessian_diagonal only the diagonal is propagated and written,
+    /// using clad::hessian_diagonal_series<T, N>.
+    ///
+    ///\param[in] FD - the function that will be differentiated.
+    ///\param[in] independentArgs - the independent parameters in the order of
+    /// the parameters of FD, with the requested interval of array parameters.
+    ///\param[in] hessianFuncName - the name of the generated function.
+    OverloadedDeclWithContext DeriveHessian(
+        const clang::FunctionDecl* FD, const DiffRequest& request,
+        llvm::ArrayRef<std::pair<const clang::ParmVarDecl*, IndexInterval>>
+            independentArgs,
+        const std::string& hessianFuncName);
+    StmtDiff VisitArraySubscriptExpr(const clang::ArraySubscriptExpr* ASE);
+    StmtDiff VisitBinaryOperator(const clang::BinaryOperator* BinOp);
+    StmtDiff VisitBreakStmt(const clang::BreakStmt* BS);
+    StmtDiff VisitCallExpr(const clang::CallExpr* CE);
+    StmtDiff VisitCompoundStmt(const clang::CompoundStmt* CS);
+    StmtDiff VisitConditionalOperator(const clang::ConditionalOperator* CO);
+    StmtDiff VisitContinueStmt(const clang::ContinueStmt* CS);
+    StmtDiff VisitCXXDefaultArgExpr(const clang::CXXDefaultArgExpr* DE);
+    StmtDiff VisitDeclRefExpr(const clang::DeclRefExpr* DRE);
+    StmtDiff VisitDeclStmt(const clang::DeclStmt* DS);
+    StmtDiff VisitDoStmt(const clang::DoStmt* DS);
+    StmtDiff VisitExplicitCastExpr(const clang::ExplicitCastExpr* ECE);
+    StmtDiff VisitExpr(const clang::Expr* E);
+    StmtDiff VisitForStmt(const clang::ForStmt* FS);
+    StmtDiff VisitIfStmt(const clang::IfStmt* If);
+    StmtDiff VisitImplicitCastExpr(const clang::ImplicitCastExpr* ICE);
+    StmtDiff VisitNullStmt(const clang::NullStmt* NS);
+    StmtDiff VisitParenExpr(const clang::ParenExpr* PE);
+    StmtDiff VisitReturnStmt(const clang::ReturnStmt* RS);
+    StmtDiff VisitStmt(const clang::Stmt* S);
+    StmtDiff VisitUnaryOperator(const clang::UnaryOperator* UnOp);
+    StmtDiff VisitWhileStmt(const clang::WhileStmt* WS);
+    // Decl is not Stmt, so it cannot be visited directly.
+    VarDeclDiff DifferentiateVarDecl(const clang::VarDecl* VD);
+
+  private:
+    /// Builds the derivative `II` of m_Function with the additional output
+    /// parameter `outputName` of type clad::array_ref<R>, seeding the
+    /// series of the independent parameters.
+    OverloadedDeclWithContext BuildDerivative(clang::IdentifierInfo* II,
+                                              llvm::StringRef outputName);
+    /// Returns the Taylor series of the visited expression, i.e. Expr_dx()
+    /// if the expression depends on the independent variable, otherwise the
+    /// primal Expr() which is implicitly converted to a constant series.
+    static clang::Expr* getSeries(StmtDiff& Diff) {
+      return Diff.getExpr_dx() ? Diff.getExpr_dx() : Diff.getExpr();
+    }
+    /// Builds a call to the clad::taylor overload of the elementary function
+    /// `Name`, e.g. clad::sin(_d_x). Returns null if there is no such
+    /// overload for the given arguments.
+    clang::Expr* BuildTaylorRuleCall(llvm::StringRef Name,
+                                     llvm::MutableArrayRef<clang::Expr*> Args);
+    /// Visits the body of a loop or a branch, wrapping the result in a block
+    /// if the body is not a compound statement already.
+    clang::Stmt* VisitBody(const clang::Stmt* Body);
+  };
+} // end namespace clad
+
+#endif // CLAD_TAYLOR_MODE_VISITOR_H
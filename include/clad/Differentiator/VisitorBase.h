@@ -20,6 +20,7 @@ namespace clad {
 #include <array>
 #include <stack>
 #include <unordered_map>
+#include <utility>
 
 namespace clad {
   /// A class that represents the result of Visit of ForwardModeVisitor.
@@ -104,6 +105,9 @@ namespace clad {
     /// A stack of all the blocks where the statements of the gradient function
     /// are stored (e.g., function body, if statement blocks).
     std::vector<Stmts> m_Blocks;
+    /// The emptied blocks, reused by the next blocks of the derivative so that
+    /// their storage is allocated once.
+    std::vector<Stmts> m_FreeBlocks;
     /// Stores output variables for vector-valued functions
     VectorOutputs m_VectorOutput;
     /// The functor type that is currently being differentiated, if any.
@@ -151,16 +155,29 @@ namespace clad {
     /// Get the latest block of code (i.e. place for statements output).
     Stmts& getCurrentBlock() { return m_Blocks.back(); }
     /// Create new block.
-    Stmts& beginBlock() {
-      m_Blocks.push_back({});
-      return m_Blocks.back();
-    }
+    Stmts& beginBlock() { return pushBlock(m_Blocks); }
     /// Remove the block from the stack, wrap it in CompoundStmt and return it.
     clang::CompoundStmt* endBlock() {
       auto CS = MakeCompoundStmt(getCurrentBlock());
-      m_Blocks.pop_back();
+      popBlock(m_Blocks);
       return CS;
     }
+    /// Pushes an empty block on the stack, reusing a free one if any.
+    Stmts& pushBlock(std::vector<Stmts>& Stack) {
+      if (m_FreeBlocks.empty()) {
+        Stack.emplace_back();
+      } else {
+        Stack.push_back(std::move(m_FreeBlocks.back()));
+        m_FreeBlocks.pop_back();
+      }
+      return Stack.back();
+    }
+    /// Pops the block from the stack and keeps its storage for the next one.
+    void popBlock(std::vector<Stmts>& Stack) {
+      Stack.back().clear();
+      m_FreeBlocks.push_back(std::move(Stack.back()));
+      Stack.pop_back();
+    }
 
     // Check if result of the expression is unused.
     bool isUnusedResult(const clang::Expr* E);
@@ -364,8 +381,13 @@ namespace clad {
     /// Find declaration of clad::class templated type
     ///
     /// \param[in] className name of the class to be found
-    /// \returns The declaration of the class with the name ClassName
-    clang::TemplateDecl* GetCladClassDecl(llvm::StringRef ClassName);
+    /// \param[in] Header the runtime header declaring the class, which the
+    /// diagnostic asks to include if the class is not declared
+    /// \returns The declaration of the class with the name ClassName, or null
+    /// if it is not declared
+    clang::TemplateDecl*
+    GetCladClassDecl(llvm::StringRef ClassName,
+                     llvm::StringRef Header = "clad/Differentiator/CladCore.h");
     /// Instantiate clad::class<TemplateArgs> type
     ///
     /// \param[in] CladClassDecl the decl of the class that is going to be used
@@ -374,6 +396,11 @@ namespace clad {
     clang::QualType
     GetCladClassOfType(clang::TemplateDecl* CladClassDecl,
                        llvm::MutableArrayRef<clang::QualType> TemplateArgs);
+    /// Instantiate clad::class<TemplateArgs> type for arbitrary (e.g.
+    /// non-type) template arguments.
+    clang::QualType
+    GetCladClassOfType(clang::TemplateDecl* CladClassDecl,
+                       clang::TemplateArgumentListInfo& TemplateArgs);
     /// Find declaration of clad::tape templated type.
     clang::TemplateDecl* GetCladTapeDecl();
     /// Perform a lookup into clad namespace for an entity with given name.
@@ -455,6 +482,24 @@ namespace clad {
     clang::TemplateDecl* GetCladArrayDecl();
     /// Create clad::array<T> type.
     clang::QualType GetCladArrayOfType(clang::QualType T);
+    /// Create clad::array<T, N> type, which stores its N elements inline.
+    clang::QualType GetCladArrayOfType(clang::QualType T, unsigned N);
+    /// Find declaration of clad::taylor templated type.
+    clang::TemplateDecl* GetCladTaylorDecl();
+    /// Create clad::taylor<T, N> type.
+    clang::QualType GetCladTaylorOfType(clang::QualType T, unsigned N);
+    /// Find declaration of clad::hessian_series templated type.
+    clang::TemplateDecl* GetCladHessianSeriesDecl();
+    /// Create clad::hessian_series<T, N> type.
+    clang::QualType GetCladHessianSeriesOfType(clang::QualType T, unsigned N);
+    /// Find declaration of clad::hessian_diagonal_series templated type.
+    clang::TemplateDecl* GetCladHessianDiagonalSeriesDecl();
+    /// Create clad::hessian_diagonal_series<T, N> type.
+    clang::QualType GetCladHessianDiagonalSeriesOfType(clang::QualType T,
+                                                       unsigned N);
+    /// Create the clad::task_group type, null if TaskGroup.h is not
+    /// included.
+    clang::QualType GetCladTaskGroupType();
     /// Creates the expression Base.size() for the given Base expr. The Base
     /// expr must be of clad::array_ref<T> type
     clang::Expr* BuildArrayRefSizeExpr(clang::Expr* Base);
@@ -1,6 +1,10 @@
 #include "clad/Differentiator/CladUtils.h"
 
+#include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
+#include "clang/AST/Expr.h"
+
+#include "clad/Differentiator/Compatibility.h"
 
 namespace clad {
   namespace utils {
@@ -11,5 +15,19 @@ namespace clad {
         default: return FD->getNameAsString();
       }
     }
+
+    const clang::StringLiteral* CreateStringLiteral(clang::ASTContext& C,
+                                                    llvm::StringRef str) {
+      clang::QualType CharTyConst = C.CharTy.withConst();
+      clang::QualType StrTy = clad_compat::getConstantArrayType(
+          C, CharTyConst, llvm::APInt(/*numBits=*/32, str.size() + 1),
+          /*SizeExpr=*/nullptr,
+          /*ASM=*/clang::ArrayType::Normal,
+          /*IndexTypeQuals*/ 0);
+      return clang::StringLiteral::Create(C, str,
+                                          /*Kind=*/clang::StringLiteral::Ascii,
+                                          /*Pascal=*/false, StrTy,
+                                          clang::SourceLocation());
+    }
   } // namespace utils
 } // namespace clad
\ No newline at end of file
@@ -8,11 +8,14 @@
 
 #include "clad/Differentiator/ErrorEstimator.h"
 #include "clad/Differentiator/ForwardModeVisitor.h"
+#include "clad/Differentiator/GenericFPVisitor.h"
 #include "clad/Differentiator/HessianModeVisitor.h"
 #include "clad/Differentiator/JacobianModeVisitor.h"
 #include "clad/Differentiator/ReverseModeVisitor.h"
+#include "clad/Differentiator/TaylorModeVisitor.h"
 
 #include "clad/Differentiator/DiffPlanner.h"
+#include "clad/Differentiator/Profiler.h"
 #include "clad/Differentiator/StmtClone.h"
 
 #include "clang/AST/ASTContext.h"
@@ -23,6 +26,7 @@
 #include "clang/Sema/Overload.h"
 #include "clang/Sema/SemaInternal.h"
 #include "clang/Sema/Template.h"
+#include "clang/Sema/TemplateDeduction.h"
 
 #include <algorithm>
 
@@ -32,10 +36,13 @@ using namespace clang;
 
 namespace clad {
 
-  std::unique_ptr<ErrorEstimationHandler> errorEstHandler = nullptr;
+  thread_local std::unique_ptr<ErrorEstimationHandler> errorEstHandler =
+      nullptr;
 
-  DerivativeBuilder::DerivativeBuilder(clang::Sema& S, plugin::CladPlugin& P)
+  DerivativeBuilder::DerivativeBuilder(clang::Sema& S, plugin::CladPlugin& P,
+                                       Profiler& Prof)
     : m_Sema(S), m_CladPlugin(P), m_Context(S.getASTContext()),
+      m_Profiler(Prof),
       m_NodeCloner(new utils::StmtClone(m_Sema, m_Context)),
       m_BuiltinDerivativesNSD(nullptr), m_NumericalDiffNSD(nullptr) {}
 
@@ -133,6 +140,18 @@ namespace clad {
                             const DiffRequest& request) {
     //m_Sema.CurContext = m_Context.getTranslationUnitDecl();
     assert(FD && "Must not be null.");
+    // The templates are instantiated lazily, at the end of the translation
+    // unit. Only the specializations which are differentiated need their
+    // body now.
+    if (!FD->getDefinition() && FD->isImplicitlyInstantiable()) {
+      SourceLocation PointOfInstantiation = FD->getPointOfInstantiation();
+      if (PointOfInstantiation.isInvalid() && request.CallContext)
+        PointOfInstantiation = request.CallContext->getBeginLoc();
+      ProfileScope Scope(m_Profiler, ProfilePhase::Instantiation);
+      m_Sema.InstantiateFunctionDefinition(PointOfInstantiation,
+                                           const_cast<FunctionDecl*>(FD),
+                                           /*Recursive=*/true);
+    }
     // If FD is only a declaration, try to find its definition.
     if (!FD->getDefinition()) {
       if (request.VerboseDiags)
@@ -144,18 +163,24 @@ namespace clad {
     }
     FD = FD->getDefinition();
     OverloadedDeclWithContext result{};
+    ProfileScope Scope(m_Profiler, ProfilePhase::Visitor);
     if (request.Mode == DiffMode::forward) {
       ForwardModeVisitor V(*this);
       result = V.Derive(FD, request);
     } else if (request.Mode == DiffMode::reverse) {
       ReverseModeVisitor V(*this);
       result = V.Derive(FD, request);
-    } else if (request.Mode == DiffMode::hessian) {
+    } else if (request.Mode == DiffMode::hessian ||
+               request.Mode == DiffMode::hessian_vector_product ||
+               request.Mode == DiffMode::hessian_diagonal) {
       HessianModeVisitor H(*this);
       result = H.Derive(FD, request);
     } else if (request.Mode == DiffMode::jacobian) {
       JacobianModeVisitor J(*this);
       result = J.Derive(FD, request);
+    } else if (request.Mode == DiffMode::taylor) {
+      TaylorModeVisitor T(*this);
+      result = T.Derive(FD, request);
     } else if (request.Mode == DiffMode::error_estimation) {
       // Set the handler.
       errorEstHandler.reset(new ErrorEstimationHandler(*this));
@@ -181,4 +206,32 @@ namespace clad {
 
     return result;
   }
+
+  DeclWithContext
+  DerivativeBuilder::DeriveGenericFP(const FunctionDecl* Derivative,
+                                     const DiffRequest& request) {
+    ProfileScope Scope(m_Profiler, ProfilePhase::Visitor);
+    GenericFPVisitor V(*this);
+    return V.Derive(Derivative, request);
+  }
+
+  FunctionDecl*
+  DerivativeBuilder::InstantiateGenericFP(FunctionTemplateDecl* Template,
+                                          QualType FPType, SourceLocation Loc) {
+    ProfileScope Scope(m_Profiler, ProfilePhase::Instantiation);
+    TemplateArgumentListInfo TLI{};
+    TLI.addArgument(TemplateArgumentLoc(
+        TemplateArgument(FPType),
+        m_Context.getTrivialTypeSourceInfo(FPType, Loc)));
+    FunctionDecl* Specialization = nullptr;
+    sema::TemplateDeductionInfo Info(Loc);
+    if (m_Sema.DeduceTemplateArguments(Template, &TLI, Specialization, Info) !=
+            Sema::TDK_Success ||
+        !Specialization)
+      return nullptr;
+    if (!Specialization->isDefined())
+      m_Sema.InstantiateFunctionDefinition(Loc, Specialization,
+                                           /*Recursive=*/true);
+    return Specialization->isDefined() ? Specialization : nullptr;
+  }
 }// end namespace clad
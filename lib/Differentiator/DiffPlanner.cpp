@@ -3,6 +3,8 @@
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/Preprocessor.h"
 #include "clang/Sema/Lookup.h"
 #include "clang/Sema/Sema.h"
 #include "clang/Sema/SemaDiagnostic.h"
@@ -10,6 +12,8 @@
 
 #include "llvm/Support/SaveAndRestore.h"
 
+#include <algorithm>
+
 #include "clad/Differentiator/CladUtils.h"
 #include "clad/Differentiator/Compatibility.h"
 
@@ -240,7 +244,16 @@ namespace clad {
             .get();
     call->setArg(derivedFnArgIdx, newUnOp);
 
-    // Update the code parameter.
+    // Sema may have evaluated the initializer of the variable before the call
+    // was updated, e.g. of `auto f_grad = clad::gradient(f);`. Discard that
+    // value, so that codegen constant-initializes the CladFunction object.
+    if (CallContextVar)
+      clad_compat::VarDecl_ResetEvaluatedInit(CallContextVar);
+
+    // Update the code parameter, unless the user opted out of embedding the
+    // source of the derivatives in the binary.
+    if (SemaRef.getPreprocessor().isMacroDefined("CLAD_NO_CODE_STRINGS"))
+      return;
     if (CXXDefaultArgExpr* Arg
         = dyn_cast<CXXDefaultArgExpr>(call->getArg(codeArgIdx))) {
       clang::LangOptions LangOpts;
@@ -281,11 +294,29 @@ namespace clad {
     }
   }
 
+  /// The identifiers a call to clad has to spell, the namespace or the name
+  /// of one of the annotated functions of CladCore.h and ErrorEstimation.h.
+  /// A new annotated function must be added here, otherwise its calls
+  /// spelled by macros are skipped.
+  static const char* const CladAPIIdentifiers[] = {
+      "clad",     "differentiate",          "gradient",
+      "hessian",  "hessian_vector_product", "hessian_diagonal",
+      "jacobian", "estimate_error"};
+
+  bool isCladAPIIdentifier(llvm::StringRef Name) {
+    for (const char* API : CladAPIIdentifiers)
+      if (Name == API)
+        return true;
+    return false;
+  }
+
   DiffCollector::DiffCollector(DeclGroupRef DGR, DiffInterval& Interval,
+                               const CladMacroExpansions& MacroExpansions,
                                const DerivativesSet& Derivatives,
                                DiffSchedule& plans, clang::Sema& S)
-    : m_Interval(Interval), m_GeneratedDerivatives(Derivatives),
-      m_DiffPlans(plans), m_TopMostFD(nullptr), m_Sema(S) {
+    : m_Interval(Interval), m_MacroExpansions(MacroExpansions),
+      m_GeneratedDerivatives(Derivatives), m_DiffPlans(plans),
+      m_TopMostFD(nullptr), m_Sema(S) {
 
     if (Interval.empty())
       return;
@@ -295,10 +326,51 @@ namespace clad {
       // Skip over the derivatives that we produce.
       if (m_GeneratedDerivatives.count(D))
         continue;
+      // Walking the declarations of the headers is expensive, look at their
+      // source first.
+      if (!mayCallClad(D))
+        continue;
       TraverseDecl(D);
     }
   }
 
+  bool DiffCollector::mayCallClad(const Decl* D) const {
+    SourceRange R = D->getSourceRange();
+    if (R.isInvalid())
+      return true;
+    const SourceManager& SM = m_Sema.getSourceManager();
+    SourceLocation Begin = SM.getExpansionLoc(R.getBegin());
+    SourceLocation End = SM.getExpansionLoc(R.getEnd());
+    if (!isInInterval(Begin, End))
+      return false;
+
+    // Look for the identifiers in the text of the declaration.
+    std::pair<FileID, unsigned> BeginInfo = SM.getDecomposedLoc(Begin);
+    std::pair<FileID, unsigned> EndInfo = SM.getDecomposedLoc(End);
+    if (BeginInfo.first != EndInfo.first || BeginInfo.second > EndInfo.second)
+      return true;
+    bool Invalid = false;
+    llvm::StringRef Buffer = SM.getBufferData(BeginInfo.first, &Invalid);
+    if (Invalid)
+      return true;
+    unsigned EndOffset =
+        EndInfo.second +
+        Lexer::MeasureTokenLength(End, SM, m_Sema.getLangOpts());
+    llvm::StringRef Text = Buffer.slice(BeginInfo.second, EndOffset);
+    for (const char* API : CladAPIIdentifiers)
+      if (Text.find(API) != llvm::StringRef::npos)
+        return true;
+
+    // The call may come from a macro.
+    auto I = std::partition_point(
+        m_MacroExpansions.begin(), m_MacroExpansions.end(),
+        [&SM, Begin](SourceLocation Loc) {
+          return SM.isBeforeInTranslationUnit(Loc, Begin);
+        });
+    return I != m_MacroExpansions.end() &&
+           !SM.isBeforeInTranslationUnit(End, *I);
+  }
+
   /// Returns true if `FD` is a call operator; otherwise returns false.
   static bool isCallOperator(ASTContext& Context, const FunctionDecl* FD) {
     if (auto method = dyn_cast<CXXMethodDecl>(FD)) {
@@ -311,19 +383,40 @@ namespace clad {
   }
 
   bool DiffCollector::isInInterval(SourceLocation Loc) const {
+    return isInInterval(Loc, Loc);
+  }
+
+  bool DiffCollector::isInInterval(SourceLocation Begin,
+                                   SourceLocation End) const {
     const SourceManager &SM = m_Sema.getSourceManager();
-    for (size_t i = 0, e = m_Interval.size(); i < e; ++i) {
-      SourceLocation B = m_Interval[i].getBegin();
-      SourceLocation E = m_Interval[i].getEnd();
-      assert((i == e-1 || E.isValid()) && "Unexpected open interval");
-      assert(E.isInvalid() || SM.isBeforeInTranslationUnit(B, E));
-      if (E.isValid() &&
-          clad_compat::SourceManager_isPointWithin(SM, Loc, B, E))
-        return true;
-      else if (SM.isBeforeInTranslationUnit(B, Loc))
-        return true;
-    }
-    return false;
+    // The intervals are sorted and disjoint, find the first one which does
+    // not end before Begin.
+    auto I = std::partition_point(
+        m_Interval.begin(), m_Interval.end(), [&SM, Begin](SourceRange R) {
+          assert((R.getEnd().isInvalid() ||
+                  SM.isBeforeInTranslationUnit(R.getBegin(), R.getEnd())) &&
+                 "Unexpected interval");
+          return R.getEnd().isValid() &&
+                 SM.isBeforeInTranslationUnit(R.getEnd(), Begin);
+        });
+    return I != m_Interval.end() &&
+           !SM.isBeforeInTranslationUnit(End, I->getBegin());
+  }
+
+  /// Returns the bitwise or of the clad::opts passed in the template argument
+  /// pack at position `PackIdx` of the specialization of the clad API
+  /// function `FD`, e.g. for `clad::differentiate<2, clad::opts::taylor>`.
+  static unsigned getBitMaskedOpts(const FunctionDecl* FD, unsigned PackIdx) {
+    const TemplateArgumentList* TAL = FD->getTemplateSpecializationArgs();
+    if (!TAL || TAL->size() <= PackIdx)
+      return 0;
+    const TemplateArgument& Pack = TAL->get(PackIdx);
+    if (Pack.getKind() != TemplateArgument::Pack)
+      return 0;
+    unsigned BitMaskedOpts = 0;
+    for (const TemplateArgument& Opt : Pack.pack_elements())
+      BitMaskedOpts |= Opt.getAsIntegral().getZExtValue();
+    return BitMaskedOpts;
   }
 
   bool DiffCollector::VisitCallExpr(CallExpr* E) {
@@ -345,7 +438,8 @@ namespace clad {
     if (A &&
         (A->getAnnotation().equals("D") || A->getAnnotation().equals("G") ||
          A->getAnnotation().equals("H") || A->getAnnotation().equals("J") ||
-         A->getAnnotation().equals("E"))) {
+         A->getAnnotation().equals("E") || A->getAnnotation().equals("HV") ||
+         A->getAnnotation().equals("HD"))) {
       // A call to clad::differentiate or clad::gradient was found.
       DeclRefExpr* DRE = getArgFunction(E, m_Sema);
       if (!DRE)
@@ -360,16 +454,27 @@ namespace clad {
         assert(derivativeOrderAPSInt.isUnsigned() && "Must be unsigned");
         unsigned derivativeOrder = derivativeOrderAPSInt.getZExtValue();
         request.RequestedDerivativeOrder = derivativeOrder;
+        request.BitMaskedOpts = getBitMaskedOpts(FD, /*PackIdx=*/1);
+        if (HasOption(request.BitMaskedOpts, opts::taylor))
+          request.Mode = DiffMode::taylor;
       } else if (A->getAnnotation().equals("H")) {
         request.Mode = DiffMode::hessian;
+        request.BitMaskedOpts = getBitMaskedOpts(FD, /*PackIdx=*/0);
+      } else if (A->getAnnotation().equals("HV")) {
+        request.Mode = DiffMode::hessian_vector_product;
+      } else if (A->getAnnotation().equals("HD")) {
+        request.Mode = DiffMode::hessian_diagonal;
       } else if (A->getAnnotation().equals("J")) {
         request.Mode = DiffMode::jacobian;
+        request.BitMaskedOpts = getBitMaskedOpts(FD, /*PackIdx=*/0);
       } else if (A->getAnnotation().equals("G")) {
         request.Mode = DiffMode::reverse;
+        request.BitMaskedOpts = getBitMaskedOpts(FD, /*PackIdx=*/0);
       } else {
         request.Mode = DiffMode::error_estimation;
       }
       request.CallContext = E;
+      request.CallContextVar = m_CurrentVar;
       request.CallUpdateRequired = true;
       request.VerboseDiags = true;
       request.Args = E->getArg(1);
@@ -396,4 +501,9 @@ namespace clad {
     }*/
     return true;     // return false to abort visiting.
   }
+
+  bool DiffCollector::TraverseVarDecl(VarDecl* VD) {
+    llvm::SaveAndRestore<VarDecl*> saveCurrentVar(m_CurrentVar, VD);
+    return RecursiveASTVisitor<DiffCollector>::TraverseVarDecl(VD);
+  }
 } // end namespace
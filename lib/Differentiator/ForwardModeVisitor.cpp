@@ -10,6 +10,7 @@
 
 #include "clad/Differentiator/DiffPlanner.h"
 #include "clad/Differentiator/ErrorEstimator.h"
+#include "clad/Differentiator/Profiler.h"
 #include "clad/Differentiator/StmtClone.h"
 
 #include "clang/AST/ASTContext.h"
@@ -43,6 +44,7 @@ namespace clad {
     silenceDiags = !request.VerboseDiags;
     m_Function = FD;
     m_Functor = request.Functor;
+    m_GenericFP = HasOption(request.BitMaskedOpts, opts::generic_fp);
     assert(!m_DerivativeInFlight &&
            "Doesn't support recursive diff. Use DiffPlan.");
     m_DerivativeInFlight = true;
@@ -61,8 +63,15 @@ namespace clad {
       return {};
     // Check that only one arg is requested and if the arg requested is of array
     // or pointer type, only one of the indices have been requested
-    if (args.size() > 1 || (isArrayOrPointerType(args[0]->getType()) &&
-                            (indexIntervalTable.size() != 1 || indexIntervalTable[0].size() != 1))) {
+    // A compressed column of a sparse Jacobian seeds several parameters, a
+    // directional derivative seeds all of them with the given direction.
+    bool isCompressedColumn = !request.JacobianSparseEntries.empty();
+    bool isDirectional = request.DirectionalDerivative;
+    if (!isDirectional &&
+        ((args.size() > 1 && !isCompressedColumn) ||
+         (isArrayOrPointerType(args[0]->getType()) &&
+          (indexIntervalTable.size() != 1 ||
+           indexIntervalTable[0].size() != 1)))) {
       diag(DiagnosticsEngine::Error,
            request.Args ? request.Args->getEndLoc() : noLoc,
            "Forward mode differentiation w.r.t. several parameters at once is "
@@ -118,9 +127,61 @@ namespace clad {
                                            m_IndependentVar));
     }
 
-    IdentifierInfo* II =
-        &m_Context.Idents.get(request.BaseFunctionName + "_d" + s + "arg" +
-                              std::to_string(m_ArgIndex) + derivativeSuffix);
+    // A column of a Jacobian matrix takes the matrix as an extra parameter
+    // of the same type as the output parameter of the function, i.e.
+    // void f_darg0_jac(A1, A2, ..., An, R*, R*).
+    QualType derivedFnType = FD->getType();
+    std::string jacobianSuffix("");
+    if (request.JacobianNumColumns) {
+      m_JacobianColumn = request.JacobianColumn;
+      m_JacobianNumColumns = request.JacobianNumColumns;
+      m_JacobianSparseEntries = request.JacobianSparseEntries;
+      jacobianSuffix = "_jac";
+      auto FnProtoType = cast<FunctionProtoType>(FD->getType());
+      llvm::SmallVector<QualType, 8> paramTypes(
+          FnProtoType->param_type_begin(), FnProtoType->param_type_end());
+      paramTypes.push_back(paramTypes.back());
+      derivedFnType =
+          m_Context.getFunctionType(FnProtoType->getReturnType(), paramTypes,
+                                    FnProtoType->getExtProtoInfo());
+    }
+    // A directional derivative takes the direction as extra parameters, one
+    // per independent parameter, e.g. double f_dvec(double x, double y,
+    // double _dir_x, double _dir_y). The direction of an array is a pointer to
+    // the elements in the requested interval of indices.
+    std::string directionalSuffix("");
+    if (isDirectional) {
+      auto FnProtoType = cast<FunctionProtoType>(FD->getType());
+      llvm::SmallVector<QualType, 8> paramTypes(
+          FnProtoType->param_type_begin(), FnProtoType->param_type_end());
+      for (auto arg : args)
+        paramTypes.push_back(GetDirectionType(arg->getType()));
+      derivedFnType =
+          m_Context.getFunctionType(FnProtoType->getReturnType(), paramTypes,
+                                    FnProtoType->getExtProtoInfo());
+      directionalSuffix = "_dvec";
+      // Nothing is appended to 'f_dvec' if all the parameters are seeded.
+      if (!(args.size() == FD->getNumParams() &&
+            std::equal(FD->param_begin(), FD->param_end(), args.begin()))) {
+        for (auto arg : args) {
+          auto it = std::find(FD->param_begin(), FD->param_end(), arg);
+          directionalSuffix +=
+              "_" + std::to_string(std::distance(FD->param_begin(), it));
+        }
+      }
+    }
+
+    std::string derivedName = request.BaseFunctionName + "_d" + s + "arg" +
+                              std::to_string(m_ArgIndex) + derivativeSuffix +
+                              jacobianSuffix;
+    // Compressed columns are named after the sparse Jacobian and their
+    // index, e.g. f_sparse_jac_col0.
+    if (isCompressedColumn)
+      derivedName =
+          request.BaseFunctionName + "_col" + std::to_string(m_JacobianColumn);
+    else if (isDirectional)
+      derivedName = request.BaseFunctionName + directionalSuffix;
+    IdentifierInfo* II = &m_Context.Idents.get(derivedName);
     SourceLocation loc{m_Function->getLocation()};
     DeclarationNameInfo name(II, loc);
     llvm::SaveAndRestore<DeclContext*> SaveContext(m_Sema.CurContext);
@@ -129,11 +190,13 @@ namespace clad {
     m_Sema.CurContext = DC;
     DeclWithContext result =
         m_Builder.cloneFunction(FD, *this, DC, m_Sema, m_Context, loc, name,
-                                FD->getType());
+                                derivedFnType);
     FunctionDecl* derivedFD = result.first;
     m_Derivative = derivedFD;
 
     llvm::SmallVector<ParmVarDecl*, 4> params;
+    // The parameters seeded together with m_IndependentVar.
+    llvm::SmallVector<const ParmVarDecl*, 4> seededParams;
     ParmVarDecl* newPVD = nullptr;
     const ParmVarDecl* PVD = nullptr;
 
@@ -164,6 +227,9 @@ namespace clad {
       // derivedFD.
       if (PVD == m_IndependentVar)
         m_IndependentVar = newPVD;
+      else if (isCompressedColumn &&
+               std::find(args.begin(), args.end(), PVD) != args.end())
+        seededParams.push_back(newPVD);
 
       params.push_back(newPVD);
       // Add the args in the scope and id chain so that they could be found.
@@ -173,23 +239,73 @@ namespace clad {
                                  /*AddToContext*/ false);
     }
 
+    if (isDirectional) {
+      for (unsigned i = 0, e = args.size(); i < e; ++i) {
+        auto it = std::find(FD->param_begin(), FD->param_end(), args[i]);
+        ParmVarDecl* param = params[std::distance(FD->param_begin(), it)];
+        QualType directionType = GetDirectionType(param->getType());
+        auto directionPVD = ParmVarDecl::Create(
+            m_Context, m_Sema.CurContext, noLoc, noLoc,
+            &m_Context.Idents.get("_dir_" + param->getNameAsString()),
+            directionType,
+            m_Context.getTrivialTypeSourceInfo(directionType, noLoc),
+            param->getStorageClass(),
+            /*DefArg=*/nullptr);
+        m_Sema.PushOnScopeChains(directionPVD, getCurrentScope(),
+                                 /*AddToContext=*/false);
+        params.push_back(directionPVD);
+        IndexInterval interval{};
+        if (isArrayOrPointerType(param->getType()))
+          interval = indexIntervalTable[i];
+        m_Directions[param] = std::make_pair(directionPVD, interval);
+      }
+    }
+
+    if (m_JacobianNumColumns) {
+      // The derivatives of the vector output are stored in the Jacobian
+      // matrix instead of a shadow array.
+      m_VectorOutput = params.back();
+      QualType jacobianType = m_VectorOutput->getType();
+      auto jacobianPVD = ParmVarDecl::Create(
+          m_Context, m_Sema.CurContext, noLoc, noLoc,
+          &m_Context.Idents.get("jacobianMatrix"), jacobianType,
+          m_Context.getTrivialTypeSourceInfo(jacobianType, noLoc),
+          params.front()->getStorageClass(),
+          /*DefArg=*/nullptr);
+      m_Sema.PushOnScopeChains(jacobianPVD, getCurrentScope(),
+                               /*AddToContext=*/false);
+      params.push_back(jacobianPVD);
+    }
+
     llvm::ArrayRef<ParmVarDecl*> paramsRef =
         llvm::makeArrayRef(params.data(), params.size());
     derivedFD->setParams(paramsRef);
     derivedFD->setBody(nullptr);
+    if (m_JacobianNumColumns)
+      m_JacobianMatrix = BuildDeclRef(params.back());
 
     // Function body scope
     beginScope(Scope::FnScope | Scope::DeclScope);
     m_DerivativeFnScope = getCurrentScope();
     beginBlock();
     // For each function parameter variable, store its derivative value.
-    for (auto param : params) {
+    for (unsigned i = 0, e = FD->getNumParams(); i < e; ++i) {
+      ParmVarDecl* param = params[i];
       if (!param->getType()->isRealType())
         continue;
-      // If param is independent variable, its derivative is 1, otherwise 0.
-      int dValue = (param == m_IndependentVar);
-      auto dParam =
-          ConstantFolder::synthesizeLiteral(m_Context.IntTy, m_Context, dValue);
+      Expr* dParam = nullptr;
+      auto direction = m_Directions.find(param);
+      if (direction != m_Directions.end()) {
+        // The derivative is the component of the direction.
+        dParam = BuildDeclRef(direction->second.first);
+      } else {
+        // If param is independent variable, its derivative is 1, otherwise 0.
+        int dValue = (param == m_IndependentVar) ||
+                     std::find(seededParams.begin(), seededParams.end(),
+                               param) != seededParams.end();
+        dParam = ConstantFolder::synthesizeLiteral(m_Context.IntTy, m_Context,
+                                                   dValue);
+      }
       // For each function arg, create a variable _d_arg to store derivatives
       // of potential reassignments, e.g.:
       // double f_darg0(double x, double y) {
@@ -207,6 +323,21 @@ namespace clad {
       m_Variables[param] = dParam;
     }
 
+    // Outputs which do not depend on the seeded parameters of a compressed
+    // column have no entry in the values, their derivatives are stored in a
+    // variable which stays zero instead.
+    if (std::find(m_JacobianSparseEntries.begin(),
+                  m_JacobianSparseEntries.end(),
+                  -1) != m_JacobianSparseEntries.end()) {
+      QualType elemType = QualType(
+          m_VectorOutput->getType()->getPointeeOrArrayElementType(),
+          /*Quals=*/0);
+      auto zeroDecl = BuildVarDecl(elemType, "_d_zero",
+                                   getZeroInit(elemType));
+      addToCurrentBlock(BuildDeclStmt(zeroDecl));
+      m_JacobianZero = BuildDeclRef(zeroDecl);
+    }
+
     // Create derived variable for each member variable if we are
     // differentiating a call operator.
     if (m_Functor) {
@@ -524,6 +655,10 @@ namespace clad {
   }
 
   StmtDiff ForwardModeVisitor::VisitReturnStmt(const ReturnStmt* RS) {
+    // A void function, e.g. the column of a Jacobian, has no derivative to
+    // return.
+    if (!RS->getRetValue())
+      return StmtDiff(Clone(RS));
     StmtDiff retValDiff = Visit(RS->getRetValue());
     Stmt* returnStmt =
         m_Sema
@@ -593,6 +728,19 @@ namespace clad {
 
     auto zero =
         ConstantFolder::synthesizeLiteral(m_Context.IntTy, m_Context, 0);
+    if (m_VectorOutput && clonedIndices.size() == 1) {
+      auto DRE = dyn_cast<DeclRefExpr>(clonedBase->IgnoreParenImpCasts());
+      if (DRE && DRE->getDecl() == m_VectorOutput)
+        return StmtDiff(cloned, BuildJacobianEntry(clonedIndices.back()));
+    }
+    if (!m_Directions.empty() && clonedIndices.size() == 1) {
+      auto DRE = dyn_cast<DeclRefExpr>(clonedBase->IgnoreParenImpCasts());
+      auto it = DRE ? m_Directions.find(DRE->getDecl()) : m_Directions.end();
+      if (it != m_Directions.end())
+        return StmtDiff(cloned, BuildDirectionEntry(it->second.first,
+                                                    it->second.second,
+                                                    Indices.back()));
+    }
     ValueDecl* VD;        
     // Derived variables for member variables are also created when we are 
     // differentiating a call operator.
@@ -655,6 +803,100 @@ namespace clad {
     return StmtDiff(cloned, result_at_is);
   }
 
+  Expr* ForwardModeVisitor::BuildJacobianEntry(Expr* idx) {
+    auto size_type = m_Context.getSizeType();
+    unsigned size_type_bits = m_Context.getIntWidth(size_type);
+    Expr* entryIdx = nullptr;
+    llvm::APSInt intIdx;
+    if (!m_JacobianSparseEntries.empty()) {
+      // The sparsity pattern is only computed for constant indices, the
+      // collector rejects the functions using others.
+      if (!clad_compat::Expr_EvaluateAsInt(idx, intIdx, m_Context)) {
+        diag(DiagnosticsEngine::Error, idx->getBeginLoc(),
+             "the output of a sparse Jacobian must be accessed with constant "
+             "indices");
+        return m_JacobianZero;
+      }
+      int64_t row = intIdx.getExtValue();
+      if (row < 0 || row >= (int64_t)m_JacobianSparseEntries.size() ||
+          m_JacobianSparseEntries[row] < 0)
+        return m_JacobianZero;
+      entryIdx = IntegerLiteral::Create(
+          m_Context, llvm::APInt(size_type_bits, m_JacobianSparseEntries[row]),
+          size_type, noLoc);
+    } else if (clad_compat::Expr_EvaluateAsInt(idx, intIdx, m_Context)) {
+      llvm::APInt entryValue(size_type_bits,
+                             intIdx.getExtValue() * m_JacobianNumColumns +
+                                 m_JacobianColumn);
+      entryIdx = IntegerLiteral::Create(m_Context, entryValue, size_type,
+                                        noLoc);
+    } else {
+      auto numColumns = IntegerLiteral::Create(
+          m_Context, llvm::APInt(size_type_bits, m_JacobianNumColumns),
+          size_type, noLoc);
+      auto column = IntegerLiteral::Create(
+          m_Context, llvm::APInt(size_type_bits, m_JacobianColumn), size_type,
+          noLoc);
+      entryIdx = BuildOp(BO_Add,
+                         BuildOp(BO_Mul, BuildParens(idx), numColumns),
+                         column);
+    }
+    return m_Sema
+        .CreateBuiltinArraySubscriptExpr(m_JacobianMatrix, noLoc, entryIdx,
+                                         noLoc)
+        .get();
+  }
+
+  QualType ForwardModeVisitor::GetDirectionType(QualType T) {
+    if (!isArrayOrPointerType(T))
+      return T.getNonReferenceType().getUnqualifiedType();
+    QualType elemType = QualType(T->getPointeeOrArrayElementType(),
+                                 /*Quals=*/0);
+    return m_Context.getPointerType(elemType.withConst());
+  }
+
+  Expr* ForwardModeVisitor::BuildDirectionEntry(const ParmVarDecl* direction,
+                                                IndexInterval interval,
+                                                const Expr* idx) {
+    auto zero =
+        ConstantFolder::synthesizeLiteral(m_Context.IntTy, m_Context, 0);
+    llvm::APSInt intIdx;
+    if (clad_compat::Expr_EvaluateAsInt(idx, intIdx, m_Context)) {
+      int64_t i = intIdx.getExtValue();
+      if (i < (int64_t)interval.Start || i >= (int64_t)interval.Finish)
+        return zero;
+      auto entryIdx = ConstantFolder::synthesizeLiteral(
+          m_Context.IntTy, m_Context, i - interval.Start);
+      return m_Sema
+          .CreateBuiltinArraySubscriptExpr(BuildDeclRef(direction), noLoc,
+                                           entryIdx, noLoc)
+          .get();
+    }
+    // Elements outside of the interval are not seeded, e.g. for x[1:2]:
+    // (1 <= i && i < 3 ? _dir_x[i - 1] : 0)
+    auto start = ConstantFolder::synthesizeLiteral(m_Context.IntTy, m_Context,
+                                                   interval.Start);
+    auto finish = ConstantFolder::synthesizeLiteral(m_Context.IntTy,
+                                                    m_Context, interval.Finish);
+    Expr* inInterval = BuildOp(BO_LT, Clone(idx), finish);
+    Expr* entryIdx = Clone(idx);
+    if (interval.Start) {
+      inInterval = BuildOp(BO_LAnd, BuildOp(BO_LE, start, Clone(idx)),
+                           inInterval);
+      entryIdx = BuildOp(BO_Sub, entryIdx,
+                         ConstantFolder::synthesizeLiteral(
+                             m_Context.IntTy, m_Context, interval.Start));
+    }
+    Expr* entry = m_Sema
+                      .CreateBuiltinArraySubscriptExpr(BuildDeclRef(direction),
+                                                       noLoc, entryIdx, noLoc)
+                      .get();
+    return BuildParens(m_Sema
+                           .ActOnConditionalOp(noLoc, noLoc, inInterval, entry,
+                                               zero)
+                           .get());
+  }
+
   StmtDiff ForwardModeVisitor::VisitDeclRefExpr(const DeclRefExpr* DRE) {
     DeclRefExpr* clonedDRE = nullptr;
     // Check if referenced Decl was "replaced" with another identifier inside
@@ -719,6 +961,7 @@ namespace clad {
   bool
   DerivativeBuilder::noOverloadExists(Expr* UnresolvedLookup,
                                       llvm::MutableArrayRef<Expr*> ARargs) {
+    ProfileScope Scope(m_Profiler, ProfilePhase::CustomDerivativeLookup);
     if (UnresolvedLookup->getType() == m_Context.OverloadTy) {
       OverloadExpr::FindResult find = OverloadExpr::find(UnresolvedLookup);
 
@@ -764,9 +1007,18 @@ namespace clad {
     return cast<NamespaceDecl>(R.getFoundDecl());
   }
 
+  bool DerivativeBuilder::hasCustomDerivatives() {
+    if (!m_BuiltinDerivativesNSD)
+      m_BuiltinDerivativesNSD = LookupNSD(m_Context, m_Sema,
+                                          "custom_derivatives",
+                                          /*shouldExist=*/false);
+    return m_BuiltinDerivativesNSD;
+  }
+
   Expr* DerivativeBuilder::findOverloadedDefinition(
       DeclarationNameInfo DNI, llvm::SmallVectorImpl<Expr*>& CallArgs,
-      bool forCustomDerv /*=true*/, bool namespaceShouldExist /*=true*/) {
+      bool forCustomDerv /*=true*/, bool namespaceShouldExist /*=false*/) {
+    ProfileScope Scope(m_Profiler, ProfilePhase::CustomDerivativeLookup);
     NamespaceDecl* NSD;
     std::string namespaceID;
     if (forCustomDerv) {
@@ -778,13 +1030,21 @@ namespace clad {
     }
     if (!NSD){
       NSD = LookupNSD(m_Context, m_Sema, namespaceID, namespaceShouldExist);
+      // The custom derivatives are opt-in, see BuiltinDerivatives.h. The
+      // calls which are not differentiated then ask for the header, see
+      // VisitorBase::CallExprDiffDiagnostics.
+      if (forCustomDerv && !NSD)
+        return nullptr;
+      if (!forCustomDerv && !NSD && !hasCustomDerivatives())
+        return nullptr;
       if (!forCustomDerv && !NSD) {
         diag(DiagnosticsEngine::Warning, noLoc,
              "Numerical differentiation is diabled using the "
              "-DCLAD_NO_NUM_DIFF "
-             "flag, this means that every try to numerically differentiate a "
-             "function will fail! Remove the flag to revert to default "
-             "behaviour.");
+             "flag or by not including clad/Differentiator/NumericalDiff.h, "
+             "this means that every try to numerically differentiate a "
+             "function will fail! Remove the flag or include the header to "
+             "revert to default behaviour.");
         return nullptr;
       }
     }
@@ -890,6 +1150,8 @@ namespace clad {
       request.Function = FD;
       request.BaseFunctionName = FD->getNameAsString();
       request.Mode = DiffMode::forward;
+      if (m_GenericFP)
+        request.BitMaskedOpts = opts::generic_fp;
       // Silence diag outputs in nested derivation process.
       request.VerboseDiags = false;
 
@@ -0,0 +1,641 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#include "clad/Differentiator/GenericFPVisitor.h"
+
+#include "clad/Differentiator/DiffPlanner.h"
+#include "clad/Differentiator/StmtClone.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclTemplate.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/ExprCXX.h"
+#include "clang/AST/TemplateBase.h"
+#include "clang/Sema/Lookup.h"
+#include "clang/Sema/Scope.h"
+#include "clang/Sema/ScopeInfo.h"
+#include "clang/Sema/Sema.h"
+#include "clang/Sema/SemaInternal.h"
+
+#include "llvm/Support/SaveAndRestore.h"
+
+#include "clad/Differentiator/Compatibility.h"
+
+using namespace clang;
+
+namespace clad {
+  /// Returns the floating-point type of a value of type `T`, looking through
+  /// references, pointers and arrays, or a null type if there is none.
+  static QualType getFPType(QualType T) {
+    T = T.getNonReferenceType();
+    for (;;) {
+      if (const auto* PT = T->getAs<PointerType>())
+        T = PT->getPointeeType();
+      else if (const ArrayType* AT = T->getAsArrayTypeUnsafe())
+        T = AT->getElementType();
+      else
+        break;
+    }
+    if (!T->isRealFloatingType())
+      return QualType();
+    return T.getCanonicalType().getUnqualifiedType();
+  }
+
+  GenericFPVisitor::GenericFPVisitor(DerivativeBuilder& builder)
+      : VisitorBase(builder) {}
+
+  GenericFPVisitor::~GenericFPVisitor() {}
+
+  DeclWithContext GenericFPVisitor::Derive(const FunctionDecl* Derivative,
+                                           const DiffRequest& request) {
+    silenceDiags = !request.VerboseDiags;
+    const FunctionDecl* FD = request.Function;
+    m_Function = FD;
+    for (const ParmVarDecl* PVD : FD->parameters()) {
+      m_FPType = getFPType(PVD->getType());
+      if (!m_FPType.isNull())
+        break;
+    }
+    if (m_FPType.isNull())
+      m_FPType = getFPType(FD->getReturnType());
+    if (m_FPType.isNull() || isa<CXXMethodDecl>(Derivative)) {
+      diag(DiagnosticsEngine::Warning, FD->getLocation(),
+           "'%0' is not emitted as a template over the floating-point type, "
+           "%1",
+           {Derivative->getName(),
+            isa<CXXMethodDecl>(Derivative)
+                ? "member functions are not supported"
+                : "the function has no floating-point parameters"});
+      return {};
+    }
+
+    llvm::SaveAndRestore<DeclContext*> SaveContext(m_Sema.CurContext);
+    llvm::SaveAndRestore<Scope*> SaveScope(m_CurScope);
+
+    // template <typename T>
+    auto TTP = TemplateTypeParmDecl::Create(
+        m_Context, m_Context.getTranslationUnitDecl(), noLoc, noLoc,
+        /*Depth=*/0, /*Position=*/0, &m_Context.Idents.get("T"),
+        /*Typename=*/true, /*ParameterPack=*/false);
+    m_TemplateParmType = m_Context.getTemplateTypeParmType(
+        /*Depth=*/0, /*Index=*/0, /*ParameterPack=*/false, TTP);
+    NamedDecl* TemplateParams[] = {TTP};
+    TemplateParameterList* TPL = TemplateParameterList::Create(
+        m_Context, noLoc, noLoc, TemplateParams, noLoc,
+        /*RequiresClause=*/nullptr);
+
+    const auto* FnProtoType = cast<FunctionProtoType>(Derivative->getType());
+    llvm::SmallVector<QualType, 8> paramTypes;
+    for (QualType T : FnProtoType->param_types())
+      paramTypes.push_back(GetGenericType(T));
+    QualType genericFnType =
+        m_Context.getFunctionType(GetGenericType(FnProtoType->getReturnType()),
+                                  paramTypes, FnProtoType->getExtProtoInfo());
+
+    DeclContext* DC = const_cast<DeclContext*>(FD->getDeclContext());
+    m_Sema.CurContext = DC;
+    DeclWithContext result =
+        m_Builder.cloneFunction(Derivative, *this, DC, m_Sema, m_Context, noLoc,
+                                Derivative->getNameInfo(), genericFnType);
+    FunctionDecl* genericFD = result.first;
+    m_Derivative = genericFD;
+    auto FTD = FunctionTemplateDecl::Create(
+        m_Context, genericFD->getDeclContext(), noLoc,
+        genericFD->getDeclName(), TPL, genericFD);
+    // The body is built in a dependent context.
+    genericFD->setDescribedFunctionTemplate(FTD);
+
+    // Function declaration scope
+    beginScope(Scope::FunctionPrototypeScope | Scope::FunctionDeclarationScope |
+               Scope::DeclScope);
+    m_Sema.PushFunctionScope();
+    m_Sema.PushDeclContext(getCurrentScope(), genericFD);
+
+    llvm::SmallVector<ParmVarDecl*, 8> params;
+    for (const ParmVarDecl* PVD : Derivative->parameters()) {
+      QualType paramType = GetGenericType(PVD->getType());
+      auto newPVD = ParmVarDecl::Create(
+          m_Context, m_Sema.CurContext, noLoc, noLoc, PVD->getIdentifier(),
+          paramType, m_Context.getTrivialTypeSourceInfo(paramType, noLoc),
+          PVD->getStorageClass(), /*DefArg=*/nullptr);
+      newPVD->setScopeInfo(/*scopeDepth=*/0, params.size());
+      if (newPVD->getIdentifier())
+        m_Sema.PushOnScopeChains(newPVD, getCurrentScope(),
+                                 /*AddToContext=*/false);
+      m_DeclMap[PVD] = newPVD;
+      params.push_back(newPVD);
+    }
+    genericFD->setParams(params);
+    // The instantiation substitutes the parameters found in the type source
+    // information of the function.
+    TypeSourceInfo* TSI =
+        m_Context.getTrivialTypeSourceInfo(genericFnType, noLoc);
+    auto FTL = TSI->getTypeLoc().IgnoreParens().castAs<FunctionProtoTypeLoc>();
+    for (unsigned i = 0, e = params.size(); i < e; ++i)
+      FTL.setParam(i, params[i]);
+    genericFD->setTypeSourceInfo(TSI);
+
+    // Function body scope
+    beginScope(Scope::FnScope | Scope::DeclScope);
+    m_DerivativeFnScope = getCurrentScope();
+    genericFD->setBody(Visit(Derivative->getBody()));
+
+    endScope(); // Function body scope
+    m_Sema.PopFunctionScopeInfo();
+    m_Sema.PopDeclContext();
+    endScope(); // Function decl scope
+
+    if (!m_Unsupported.empty()) {
+      diag(DiagnosticsEngine::Warning, FD->getLocation(),
+           "'%0' is not emitted as a template over the floating-point type, "
+           "'%1' is not supported",
+           {Derivative->getName(), m_Unsupported});
+      return {};
+    }
+
+    // Register the template on the redecl chain of a declaration written by
+    // the user, so that the uses of that declaration find the definition.
+    LookupResult R(m_Sema, genericFD->getNameInfo(), Sema::LookupOrdinaryName);
+    m_Sema.LookupQualifiedName(R, genericFD->getDeclContext(),
+                               /*allowBuiltinCreation*/ false);
+    for (NamedDecl* I : R) {
+      auto Prev = dyn_cast<FunctionTemplateDecl>(I);
+      if (!Prev || Prev->getTemplateParameters()->size() != 1 ||
+          !isa<TemplateTypeParmDecl>(Prev->getTemplateParameters()->getParam(0)))
+        continue;
+      if (m_Context.hasSameFunctionTypeIgnoringExceptionSpec(
+              genericFnType, Prev->getTemplatedDecl()->getType())) {
+        // Links the templates as well.
+        genericFD->setPreviousDeclaration(Prev->getTemplatedDecl());
+        break;
+      }
+    }
+    // Added after the redecl chain is set up, so that the template replaces
+    // the declaration in the lookup table.
+    genericFD->getDeclContext()->addDecl(FTD);
+    return result;
+  }
+
+  QualType GenericFPVisitor::GetGenericType(QualType T) {
+    if (T.isNull())
+      return T;
+    if (m_Context.hasSameUnqualifiedType(T, m_FPType))
+      return m_Context.getQualifiedType(m_TemplateParmType, T.getQualifiers());
+    if (const auto* RT = T->getAs<LValueReferenceType>())
+      return m_Context.getLValueReferenceType(
+          GetGenericType(RT->getPointeeType()));
+    if (const auto* RT = T->getAs<RValueReferenceType>())
+      return m_Context.getRValueReferenceType(
+          GetGenericType(RT->getPointeeType()));
+    if (const auto* PT = T->getAs<PointerType>())
+      return m_Context.getQualifiedType(
+          m_Context.getPointerType(GetGenericType(PT->getPointeeType())),
+          T.getQualifiers());
+    if (const ConstantArrayType* CAT = m_Context.getAsConstantArrayType(T))
+      return clad_compat::getConstantArrayType(
+          m_Context, GetGenericType(CAT->getElementType()), CAT->getSize(),
+          /*SizeExpr=*/nullptr, CAT->getSizeModifier(),
+          CAT->getIndexTypeCVRQualifiers());
+    if (const IncompleteArrayType* IAT = m_Context.getAsIncompleteArrayType(T))
+      return m_Context.getIncompleteArrayType(
+          GetGenericType(IAT->getElementType()), IAT->getSizeModifier(),
+          IAT->getIndexTypeCVRQualifiers());
+
+    // Specializations of class templates, e.g. clad::tape<double>, are rebuilt
+    // with the generic template arguments.
+    TemplateDecl* TD = nullptr;
+    llvm::ArrayRef<TemplateArgument> Args;
+    if (const auto* TST = T->getAs<TemplateSpecializationType>()) {
+      TD = TST->getTemplateName().getAsTemplateDecl();
+      Args = llvm::makeArrayRef(TST->getArgs(), TST->getNumArgs());
+    } else if (const auto* CTSD =
+                   dyn_cast_or_null<ClassTemplateSpecializationDecl>(
+                       T->getAsCXXRecordDecl())) {
+      TD = CTSD->getSpecializedTemplate();
+      Args = CTSD->getTemplateArgs().asArray();
+    }
+    if (!TD)
+      return T;
+    TemplateArgumentListInfo TLI{};
+    bool changed = false;
+    auto addArgument = [&](const TemplateArgument& Arg) {
+      if (Arg.getKind() != TemplateArgument::Type) {
+        TLI.addArgument(m_Sema.getTrivialTemplateArgumentLoc(Arg, QualType(),
+                                                             noLoc));
+        return;
+      }
+      QualType ArgType = GetGenericType(Arg.getAsType());
+      changed |= ArgType != Arg.getAsType();
+      TLI.addArgument(TemplateArgumentLoc(
+          TemplateArgument(ArgType),
+          m_Context.getTrivialTypeSourceInfo(ArgType, noLoc)));
+    };
+    for (const TemplateArgument& Arg : Args) {
+      if (Arg.getKind() == TemplateArgument::Pack)
+        for (const TemplateArgument& Elt : Arg.pack_elements())
+          addArgument(Elt);
+      else
+        addArgument(Arg);
+    }
+    if (!changed)
+      return T;
+    QualType Result;
+    if (TD->getDeclContext()->Equals(GetCladNamespace()))
+      Result = GetCladClassOfType(TD, TLI);
+    else
+      Result = m_Sema.CheckTemplateIdType(TemplateName(TD), noLoc, TLI);
+    return m_Context.getQualifiedType(Result, T.getQualifiers());
+  }
+
+  LabelDecl* GenericFPVisitor::GetLabel(const LabelDecl* LD) {
+    auto it = m_DeclMap.find(LD);
+    if (it != m_DeclMap.end())
+      return cast<LabelDecl>(it->second);
+    LabelDecl* newLD = LabelDecl::Create(m_Context, m_Sema.CurContext, noLoc,
+                                         LD->getIdentifier());
+    m_Sema.PushOnScopeChains(newLD, m_DerivativeFnScope, true);
+    m_DeclMap[LD] = newLD;
+    return newLD;
+  }
+
+  Stmt* GenericFPVisitor::VisitStmt(const Stmt* S) {
+    // Leaves, e.g. integer literals or break statements, do not depend on the
+    // floating-point type.
+    if (S->child_begin() != S->child_end() && m_Unsupported.empty())
+      m_Unsupported = S->getStmtClassName();
+    return Clone(S);
+  }
+
+  Stmt* GenericFPVisitor::VisitCompoundStmt(const CompoundStmt* CS) {
+    beginScope(Scope::DeclScope);
+    beginBlock();
+    // Unlike addToCurrentBlock, the statements are kept as they are, the
+    // derivative does not contain unused expressions.
+    for (Stmt* S : CS->body())
+      getCurrentBlock().push_back(Visit(S));
+    CompoundStmt* Result = endBlock();
+    endScope();
+    return Result;
+  }
+
+  Stmt* GenericFPVisitor::VisitDeclStmt(const DeclStmt* DS) {
+    llvm::SmallVector<Decl*, 4> decls;
+    for (const Decl* D : DS->decls()) {
+      const auto* VD = dyn_cast<VarDecl>(D);
+      if (!VD) {
+        if (m_Unsupported.empty())
+          m_Unsupported = D->getDeclKindName();
+        return Clone(DS);
+      }
+      Expr* init = nullptr;
+      if (const Expr* E = VD->getInit()) {
+        if (const auto* EWC = dyn_cast<ExprWithCleanups>(E))
+          E = EWC->getSubExpr();
+        const auto* CE = dyn_cast<CXXConstructExpr>(E);
+        if (!CE || CE->getNumArgs())
+          init = RebuildExpr(E);
+        else if (CE->isListInitialization())
+          init = m_Sema.ActOnInitList(noLoc, {}, noLoc).get();
+        // Otherwise the variable is default initialized.
+      }
+      QualType VDType = GetGenericType(VD->getType());
+      VarDecl* newVD =
+          BuildVarDecl(VDType, VD->getIdentifier(), init, VD->isDirectInit(),
+                       m_Context.getTrivialTypeSourceInfo(VDType, noLoc),
+                       VD->getInitStyle());
+      m_DeclMap[VD] = newVD;
+      decls.push_back(newVD);
+    }
+    return BuildDeclStmt(decls);
+  }
+
+  Stmt* GenericFPVisitor::VisitDeclRefExpr(const DeclRefExpr* DRE) {
+    const ValueDecl* VD = DRE->getDecl();
+    auto it = m_DeclMap.find(VD);
+    if (it != m_DeclMap.end())
+      return BuildDeclRef(cast<DeclaratorDecl>(it->second));
+    const auto* FD = dyn_cast<FunctionDecl>(VD);
+    if (!FD || isa<CXXMethodDecl>(FD))
+      return Clone(DRE);
+    // Functions are looked up again, e.g. the derivatives of the called
+    // functions, the builtin derivatives or the functions of clad::tape, and
+    // the overload is resolved when the template is instantiated.
+    LookupResult R(m_Sema, FD->getNameInfo(), Sema::LookupOrdinaryName);
+    m_Sema.LookupQualifiedName(R,
+                               const_cast<DeclContext*>(
+                                   FD->getDeclContext()->getRedeclContext()),
+                               /*allowBuiltinCreation*/ false);
+    if (R.empty())
+      return Clone(DRE);
+    CXXScopeSpec SS;
+    if (NestedNameSpecifierLoc QualifierLoc = DRE->getQualifierLoc())
+      SS.Adopt(QualifierLoc);
+    if (!DRE->hasExplicitTemplateArgs())
+      return m_Sema
+          .BuildDeclarationNameExpr(SS, R, /*NeedsADL=*/!SS.isSet())
+          .get();
+    TemplateArgumentListInfo TLI{};
+    for (const TemplateArgumentLoc& Arg : DRE->template_arguments()) {
+      if (Arg.getArgument().getKind() != TemplateArgument::Type) {
+        TLI.addArgument(Arg);
+        continue;
+      }
+      QualType ArgType = GetGenericType(Arg.getArgument().getAsType());
+      TLI.addArgument(TemplateArgumentLoc(
+          TemplateArgument(ArgType),
+          m_Context.getTrivialTypeSourceInfo(ArgType, noLoc)));
+    }
+    return m_Sema
+        .BuildTemplateIdExpr(SS, noLoc, R, /*RequiresADL=*/!SS.isSet(), &TLI)
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitFloatingLiteral(const FloatingLiteral* FL) {
+    Expr* clonedFL = Clone(FL);
+    if (!m_Context.hasSameUnqualifiedType(FL->getType(), m_FPType))
+      return clonedFL;
+    return m_Sema
+        .BuildCStyleCastExpr(
+            noLoc, m_Context.getTrivialTypeSourceInfo(m_TemplateParmType),
+            noLoc, clonedFL)
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitImplicitCastExpr(const ImplicitCastExpr* ICE) {
+    const Expr* subExpr = ICE->getSubExpr();
+    CastKind kind = ICE->getCastKind();
+    // User-defined conversions are applied again when the template is
+    // instantiated.
+    if (const auto* MCE = dyn_cast<CXXMemberCallExpr>(subExpr))
+      if (kind == CK_UserDefinedConversion && MCE->getMethodDecl() &&
+          isa<CXXConversionDecl>(MCE->getMethodDecl()))
+        subExpr = MCE->getImplicitObjectArgument();
+    Expr* rebuiltExpr = RebuildExpr(subExpr);
+    // The other implicit conversions are rebuilt by Sema, except for:
+    // - the conversions to the floating-point type, which would not be
+    //   applied to the values of type T, e.g. `double _d_x = 0` becomes
+    //   `T _d_x = (T)0`;
+    // - the conversions to classes depending on T, e.g. from `&_grad0` to
+    //   clad::array_ref<T>, which would prevent the deduction of the template
+    //   arguments of the called derivatives.
+    QualType castType;
+    if (m_Context.hasSameUnqualifiedType(ICE->getType(), m_FPType) &&
+        !m_Context.hasSameUnqualifiedType(subExpr->getType(), m_FPType))
+      castType = m_TemplateParmType;
+    else if ((kind == CK_ConstructorConversion ||
+              kind == CK_UserDefinedConversion) &&
+             ICE->getType()->isRecordType() &&
+             GetGenericType(ICE->getType()) != ICE->getType())
+      castType = GetGenericType(ICE->getType());
+    if (castType.isNull())
+      return rebuiltExpr;
+    return m_Sema
+        .BuildCStyleCastExpr(noLoc, m_Context.getTrivialTypeSourceInfo(castType),
+                             noLoc, rebuiltExpr)
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitExplicitCastExpr(const ExplicitCastExpr* ECE) {
+    QualType castType = GetGenericType(ECE->getTypeAsWritten());
+    return m_Sema
+        .BuildCStyleCastExpr(noLoc, m_Context.getTrivialTypeSourceInfo(castType),
+                             noLoc, RebuildExpr(ECE->getSubExpr()))
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitParenExpr(const ParenExpr* PE) {
+    return m_Sema.ActOnParenExpr(noLoc, noLoc, RebuildExpr(PE->getSubExpr()))
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitUnaryOperator(const UnaryOperator* UnOp) {
+    return BuildOp(UnOp->getOpcode(), RebuildExpr(UnOp->getSubExpr()));
+  }
+
+  Stmt* GenericFPVisitor::VisitBinaryOperator(const BinaryOperator* BinOp) {
+    return BuildOp(BinOp->getOpcode(), RebuildExpr(BinOp->getLHS()),
+                   RebuildExpr(BinOp->getRHS()));
+  }
+
+  Stmt*
+  GenericFPVisitor::VisitConditionalOperator(const ConditionalOperator* CO) {
+    return m_Sema
+        .ActOnConditionalOp(noLoc, noLoc, RebuildExpr(CO->getCond()),
+                            RebuildExpr(CO->getLHS()),
+                            RebuildExpr(CO->getRHS()))
+        .get();
+  }
+
+  Stmt*
+  GenericFPVisitor::VisitArraySubscriptExpr(const ArraySubscriptExpr* ASE) {
+    return m_Sema
+        .ActOnArraySubscriptExpr(getCurrentScope(), RebuildExpr(ASE->getBase()),
+                                 noLoc, RebuildExpr(ASE->getIdx()), noLoc)
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitCallExpr(const CallExpr* CE) {
+    Expr* callee = RebuildExpr(CE->getCallee());
+    llvm::SmallVector<Expr*, 4> args;
+    for (const Expr* arg : CE->arguments()) {
+      // Default arguments are added again by Sema.
+      if (isa<CXXDefaultArgExpr>(arg))
+        break;
+      args.push_back(RebuildExpr(arg));
+    }
+    return m_Sema.ActOnCallExpr(getCurrentScope(), callee, noLoc, args, noLoc)
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitMemberExpr(const MemberExpr* ME) {
+    IdentifierInfo* II = ME->getMemberDecl()->getIdentifier();
+    if (!II) {
+      if (m_Unsupported.empty())
+        m_Unsupported = ME->getStmtClassName();
+      return Clone(ME);
+    }
+    UnqualifiedId Member;
+    Member.setIdentifier(II, noLoc);
+    CXXScopeSpec SS;
+    return m_Sema
+        .ActOnMemberAccessExpr(getCurrentScope(), RebuildExpr(ME->getBase()),
+                               noLoc,
+                               ME->isArrow() ? tok::TokenKind::arrow
+                                             : tok::TokenKind::period,
+                               SS, noLoc, Member, /*ObjCImpDecl=*/nullptr)
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitCXXOperatorCallExpr(
+      const CXXOperatorCallExpr* OpCall) {
+    OverloadedOperatorKind OO = OpCall->getOperator();
+    llvm::SmallVector<Expr*, 4> args;
+    for (const Expr* arg : OpCall->arguments())
+      args.push_back(RebuildExpr(arg));
+    switch (OO) {
+    case OO_Subscript:
+      return m_Sema
+          .ActOnArraySubscriptExpr(getCurrentScope(), args[0], noLoc, args[1],
+                                   noLoc)
+          .get();
+    case OO_Call:
+      return m_Sema
+          .ActOnCallExpr(getCurrentScope(), args[0], noLoc,
+                         llvm::MutableArrayRef<Expr*>(args).drop_front(),
+                         noLoc)
+          .get();
+    // The member access of the enclosing MemberExpr is rebuilt with the
+    // arrow.
+    case OO_Arrow:
+      return args[0];
+    case OO_PlusPlus:
+    case OO_MinusMinus:
+      // The postfix operators have a second dummy argument.
+      return BuildOp(UnaryOperator::getOverloadedOpcode(OO, args.size() == 2),
+                     args[0]);
+    default:
+      break;
+    }
+    if (OO == OO_None || (OO >= OO_New && OO <= OO_Array_Delete) ||
+        OO == OO_Coawait || OO == OO_Conditional) {
+      if (m_Unsupported.empty())
+        m_Unsupported = OpCall->getStmtClassName();
+      return Clone(OpCall);
+    }
+    if (args.size() == 1)
+      return BuildOp(UnaryOperator::getOverloadedOpcode(OO, /*Postfix=*/false),
+                     args[0]);
+    return BuildOp(BinaryOperator::getOverloadedOpcode(OO), args[0], args[1]);
+  }
+
+  Stmt* GenericFPVisitor::VisitCXXConstructExpr(const CXXConstructExpr* CE) {
+    // Conversions and copies are applied again when the template is
+    // instantiated.
+    if (CE->getNumArgs() == 1 && !CE->isListInitialization())
+      return Visit(CE->getArg(0));
+    if (CE->getNumArgs() == 0 && CE->isListInitialization())
+      return m_Sema.ActOnInitList(noLoc, {}, noLoc).get();
+    if (m_Unsupported.empty())
+      m_Unsupported = CE->getStmtClassName();
+    return Clone(CE);
+  }
+
+  Stmt* GenericFPVisitor::VisitInitListExpr(const InitListExpr* ILE) {
+    // The semantic form contains the implicit initializations.
+    if (const InitListExpr* SyntacticForm = ILE->getSyntacticForm())
+      ILE = SyntacticForm;
+    llvm::SmallVector<Expr*, 4> inits;
+    for (unsigned i = 0, e = ILE->getNumInits(); i < e; ++i)
+      inits.push_back(RebuildExpr(ILE->getInit(i)));
+    return m_Sema.ActOnInitList(noLoc, inits, noLoc).get();
+  }
+
+  Stmt* GenericFPVisitor::VisitExprWithCleanups(const ExprWithCleanups* EWC) {
+    return Visit(EWC->getSubExpr());
+  }
+
+  Stmt*
+  GenericFPVisitor::VisitCXXBindTemporaryExpr(const CXXBindTemporaryExpr* BTE) {
+    return Visit(BTE->getSubExpr());
+  }
+
+  Stmt* GenericFPVisitor::VisitMaterializeTemporaryExpr(
+      const MaterializeTemporaryExpr* MTE) {
+    return Visit(*MTE->child_begin());
+  }
+
+  Stmt* GenericFPVisitor::VisitIfStmt(const IfStmt* If) {
+    if (If->getConditionVariable()) {
+      if (m_Unsupported.empty())
+        m_Unsupported = "condition variable";
+      return Clone(If);
+    }
+    beginScope(Scope::DeclScope | Scope::ControlScope);
+    Stmt* init = If->getInit() ? Visit(If->getInit()) : nullptr;
+    Expr* cond = m_Sema
+                     .ActOnCondition(getCurrentScope(), noLoc,
+                                     RebuildExpr(If->getCond()),
+                                     Sema::ConditionKind::Boolean)
+                     .get()
+                     .second;
+    Stmt* thenStmt = Visit(If->getThen());
+    Stmt* elseStmt = If->getElse() ? Visit(If->getElse()) : nullptr;
+    endScope();
+    return clad_compat::IfStmt_Create(m_Context, noLoc, If->isConstexpr(), init,
+                                      /*Var=*/nullptr, cond, noLoc, noLoc,
+                                      thenStmt, noLoc, elseStmt);
+  }
+
+  Stmt* GenericFPVisitor::VisitForStmt(const ForStmt* FS) {
+    if (FS->getConditionVariable()) {
+      if (m_Unsupported.empty())
+        m_Unsupported = "condition variable";
+      return Clone(FS);
+    }
+    beginScope(Scope::DeclScope | Scope::ControlScope | Scope::BreakScope |
+               Scope::ContinueScope);
+    Stmt* init = FS->getInit() ? Visit(FS->getInit()) : nullptr;
+    Expr* cond = nullptr;
+    if (FS->getCond())
+      cond = m_Sema
+                 .ActOnCondition(getCurrentScope(), noLoc,
+                                 RebuildExpr(FS->getCond()),
+                                 Sema::ConditionKind::Boolean)
+                 .get()
+                 .second;
+    Expr* inc = RebuildExpr(FS->getInc());
+    Stmt* body = Visit(FS->getBody());
+    endScope();
+    return new (m_Context) ForStmt(m_Context, init, cond, /*condVar=*/nullptr,
+                                   inc, body, noLoc, noLoc, noLoc);
+  }
+
+  Stmt* GenericFPVisitor::VisitWhileStmt(const WhileStmt* WS) {
+    if (WS->getConditionVariable()) {
+      if (m_Unsupported.empty())
+        m_Unsupported = "condition variable";
+      return Clone(WS);
+    }
+    beginScope(Scope::DeclScope | Scope::ControlScope | Scope::BreakScope |
+               Scope::ContinueScope);
+    Sema::ConditionResult cond =
+        m_Sema.ActOnCondition(getCurrentScope(), noLoc,
+                              RebuildExpr(WS->getCond()),
+                              Sema::ConditionKind::Boolean);
+    Stmt* body = Visit(WS->getBody());
+    endScope();
+    return clad_compat::Sema_ActOnWhileStmt(m_Sema, cond, body).get();
+  }
+
+  Stmt* GenericFPVisitor::VisitDoStmt(const DoStmt* DS) {
+    beginScope(Scope::DeclScope | Scope::BreakScope | Scope::ContinueScope);
+    Stmt* body = Visit(DS->getBody());
+    endScope();
+    return m_Sema
+        .ActOnDoStmt(/*DoLoc=*/noLoc, body, /*WhileLoc=*/noLoc,
+                     /*CondLParen=*/noLoc, RebuildExpr(DS->getCond()),
+                     /*CondRParen=*/noLoc)
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitReturnStmt(const ReturnStmt* RS) {
+    return m_Sema
+        .ActOnReturnStmt(noLoc, RebuildExpr(RS->getRetValue()),
+                         getCurrentScope())
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitLabelStmt(const LabelStmt* LS) {
+    return m_Sema
+        .ActOnLabelStmt(noLoc, GetLabel(LS->getDecl()), noLoc,
+                        Visit(LS->getSubStmt()))
+        .get();
+  }
+
+  Stmt* GenericFPVisitor::VisitGotoStmt(const GotoStmt* GS) {
+    return m_Sema.ActOnGotoStmt(noLoc, noLoc, GetLabel(GS->getLabel())).get();
+  }
+} // end namespace clad
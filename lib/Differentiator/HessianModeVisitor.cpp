@@ -6,9 +6,13 @@
 
 #include "clad/Differentiator/HessianModeVisitor.h"
 
+#include "ConstantFolder.h"
+
+#include "clad/Differentiator/CladUtils.h"
 #include "clad/Differentiator/DiffPlanner.h"
 #include "clad/Differentiator/ErrorEstimator.h"
 #include "clad/Differentiator/StmtClone.h"
+#include "clad/Differentiator/TaylorModeVisitor.h"
 
 #include "clang/AST/Expr.h"
 #include "clang/AST/TemplateBase.h"
@@ -21,6 +25,8 @@
 #include "llvm/Support/SaveAndRestore.h"
 
 #include <algorithm>
+#include <map>
+#include <set>
 
 #include "clad/Differentiator/Compatibility.h"
 
@@ -32,23 +38,6 @@ namespace clad {
 
   HessianModeVisitor::~HessianModeVisitor() {}
 
-  /// Converts the string str into a StringLiteral
-  static const StringLiteral* CreateStringLiteral(ASTContext& C,
-                                                  std::string str) {
-    QualType CharTyConst = C.CharTy.withConst();
-    QualType StrTy =
-        clad_compat::getConstantArrayType(C, CharTyConst,
-                                          llvm::APInt(/*numBits=*/32,
-                                                      str.size() + 1),
-                                          /*SizeExpr=*/nullptr,
-                                          /*ASM=*/ArrayType::Normal,
-                                          /*IndexTypeQuals*/ 0);
-    const StringLiteral* SL =
-        StringLiteral::Create(C, str, /*Kind=*/StringLiteral::Ascii,
-                              /*Pascal=*/false, StrTy, noLoc);
-    return SL;
-  }
-
   /// Derives the function w.r.t both forward and reverse mode and returns the
   /// FunctionDecl obtained from reverse mode differentiation
   static FunctionDecl* DeriveUsingForwardAndReverseMode(
@@ -73,9 +62,241 @@ namespace clad {
     return secondDerivative;
   }
 
+  namespace {
+    /// Computes the sparsity pattern of the hessian of a scalar function,
+    /// i.e. the pairs of independent variables which interact nonlinearly.
+    /// Every variable depends on the union of everything assigned to it,
+    /// which is propagated until a fixed point is reached, and every
+    /// nonlinear operation adds the products of the dependencies of its
+    /// operands to the pattern, e.g. 'x * y' adds (x, y) and 'exp(x + y)'
+    /// adds (x, x), (x, y) and (y, y). The pattern is conservative, calls
+    /// are treated as nonlinear in all their arguments and interactions in
+    /// values which do not contribute to the result are kept.
+    class HessianSparsityPatternCollector
+        : public RecursiveASTVisitor<HessianSparsityPatternCollector> {
+      using Dependencies = std::set<unsigned>;
+      const ASTContext& m_Context;
+      /// The indices of the independent variables each variable depends on.
+      std::map<const ValueDecl*, Dependencies> m_Dependencies;
+      /// The index of the first requested element and the requested interval
+      /// of the independent array parameters.
+      std::map<const ValueDecl*, std::pair<unsigned, IndexInterval>> m_Arrays;
+      bool m_Changed = false;
+
+      void addDependencies(Dependencies& to, const Dependencies& from) {
+        for (unsigned idx : from)
+          m_Changed |= to.insert(idx).second;
+      }
+
+      void addInteractions(const Dependencies& a, const Dependencies& b) {
+        for (unsigned i : a)
+          for (unsigned j : b)
+            m_Changed |=
+                Pattern.insert({std::min(i, j), std::max(i, j)}).second;
+      }
+
+      /// \returns the dependencies of the element idx of an independent array
+      /// parameter, or of any of its elements if idx is not constant.
+      Dependencies getElementDependencies(const ValueDecl* VD,
+                                          const Expr* idx) {
+        Dependencies result;
+        auto& array = m_Arrays[VD];
+        IndexInterval& interval = array.second;
+        llvm::APSInt intIdx;
+        if (idx && clad_compat::Expr_EvaluateAsInt(idx, intIdx, m_Context)) {
+          int64_t i = intIdx.getExtValue();
+          if (i >= (int64_t)interval.Start && i < (int64_t)interval.Finish)
+            result.insert(array.first + i - interval.Start);
+          return result;
+        }
+        for (unsigned i = 0, e = interval.size(); i < e; ++i)
+          result.insert(array.first + i);
+        return result;
+      }
+
+      Dependencies getDependencies(const Stmt* S) {
+        Dependencies result;
+        if (!S)
+          return result;
+        if (auto DRE = dyn_cast<DeclRefExpr>(S)) {
+          const ValueDecl* VD = DRE->getDecl();
+          if (m_Arrays.count(VD))
+            return getElementDependencies(VD, nullptr);
+          auto it = m_Dependencies.find(VD);
+          if (it != m_Dependencies.end())
+            result = it->second;
+          return result;
+        }
+        if (auto ASE = dyn_cast<ArraySubscriptExpr>(S)) {
+          auto DRE =
+              dyn_cast<DeclRefExpr>(ASE->getBase()->IgnoreParenImpCasts());
+          if (DRE && m_Arrays.count(DRE->getDecl()))
+            return getElementDependencies(DRE->getDecl(), ASE->getIdx());
+          // The index does not contribute to the derivatives.
+          return getDependencies(ASE->getBase());
+        }
+        if (auto BinOp = dyn_cast<BinaryOperator>(S)) {
+          Dependencies LHS = getDependencies(BinOp->getLHS());
+          Dependencies RHS = getDependencies(BinOp->getRHS());
+          switch (BinOp->getOpcode()) {
+          case BO_Comma:
+            return RHS;
+          case BO_Mul:
+          case BO_MulAssign:
+            addInteractions(LHS, RHS);
+            break;
+          case BO_Div:
+          case BO_DivAssign:
+            addInteractions(LHS, RHS);
+            addInteractions(RHS, RHS);
+            break;
+          case BO_Add:
+          case BO_Sub:
+          case BO_Assign:
+          case BO_AddAssign:
+          case BO_SubAssign:
+            break;
+          default:
+            // Comparisons, logical and bitwise operators.
+            return result;
+          }
+          result.insert(LHS.begin(), LHS.end());
+          result.insert(RHS.begin(), RHS.end());
+          return result;
+        }
+        if (auto UnOp = dyn_cast<UnaryOperator>(S)) {
+          if (UnOp->getOpcode() == UO_LNot || UnOp->getOpcode() == UO_Not)
+            return result;
+          return getDependencies(UnOp->getSubExpr());
+        }
+        if (auto CO = dyn_cast<ConditionalOperator>(S)) {
+          // The condition does not contribute to the derivatives.
+          result = getDependencies(CO->getTrueExpr());
+          Dependencies falseDeps = getDependencies(CO->getFalseExpr());
+          result.insert(falseDeps.begin(), falseDeps.end());
+          return result;
+        }
+        for (const Stmt* child : S->children()) {
+          Dependencies childDeps = getDependencies(child);
+          result.insert(childDeps.begin(), childDeps.end());
+        }
+        if (isa<CallExpr>(S))
+          addInteractions(result, result);
+        return result;
+      }
+
+      void assign(const Expr* LHS, const Dependencies& deps) {
+        LHS = LHS->IgnoreParenImpCasts();
+        if (auto ASE = dyn_cast<ArraySubscriptExpr>(LHS))
+          return assign(ASE->getBase(), deps);
+        auto DRE = dyn_cast<DeclRefExpr>(LHS);
+        // Assignments through pointers or to members are not tracked, nor
+        // are the elements of independent arrays.
+        if (!DRE || m_Arrays.count(DRE->getDecl())) {
+          IsSupported = false;
+          return;
+        }
+        addDependencies(m_Dependencies[DRE->getDecl()], deps);
+      }
+
+    public:
+      /// The upper triangle of the sparsity pattern, as pairs of indices of
+      /// the independent variables.
+      std::set<std::pair<unsigned, unsigned>> Pattern;
+      /// The number of independent variables.
+      unsigned NumIndependents = 0;
+      /// Set to false if the function modifies its variables in a way the
+      /// analysis cannot follow, e.g. through pointers.
+      bool IsSupported = true;
+
+      HessianSparsityPatternCollector(
+          const ASTContext& C,
+          llvm::ArrayRef<std::pair<const ParmVarDecl*, IndexInterval>>
+              independentArgs)
+          : m_Context(C) {
+        for (auto& independentArg : independentArgs) {
+          const ParmVarDecl* PVD = independentArg.first;
+          if (VisitorBase::isArrayOrPointerType(PVD->getType())) {
+            m_Arrays[PVD] = {NumIndependents, independentArg.second};
+            NumIndependents += independentArg.second.size();
+          } else {
+            m_Dependencies[PVD].insert(NumIndependents++);
+          }
+        }
+      }
+
+      void Collect(const Stmt* Body) {
+        do {
+          m_Changed = false;
+          TraverseStmt(const_cast<Stmt*>(Body));
+        } while (m_Changed && IsSupported);
+      }
+
+      bool VisitBinaryOperator(BinaryOperator* BinOp) {
+        if (BinOp->isAssignmentOp())
+          assign(BinOp->getLHS(), getDependencies(BinOp));
+        return true;
+      }
+
+      bool VisitUnaryOperator(UnaryOperator* UnOp) {
+        if (UnOp->isIncrementDecrementOp())
+          assign(UnOp->getSubExpr(), getDependencies(UnOp->getSubExpr()));
+        return true;
+      }
+
+      bool VisitReturnStmt(ReturnStmt* RS) {
+        getDependencies(RS->getRetValue());
+        return true;
+      }
+
+      bool VisitVarDecl(VarDecl* VD) {
+        // Aliases of variables are not tracked.
+        QualType T = VD->getType();
+        if (T->isPointerType() ||
+            (T->isReferenceType() &&
+             !T.getNonReferenceType().isConstQualified())) {
+          if (!isa<ParmVarDecl>(VD))
+            IsSupported = false;
+          return true;
+        }
+        if (VD->hasInit())
+          addDependencies(m_Dependencies[VD], getDependencies(VD->getInit()));
+        return true;
+      }
+
+      bool VisitCallExpr(CallExpr* CE) {
+        const FunctionDecl* callee = CE->getDirectCallee();
+        if (!callee) {
+          IsSupported = false;
+          return true;
+        }
+        // Arguments passed by non-const reference or pointer may be assigned
+        // anything passed to the call.
+        Dependencies deps = getDependencies(CE);
+        unsigned firstArg = isa<CXXOperatorCallExpr>(CE) &&
+                                    isa<CXXMethodDecl>(callee) &&
+                                    !cast<CXXMethodDecl>(callee)->isStatic()
+                                ? 1
+                                : 0;
+        for (unsigned i = firstArg, e = CE->getNumArgs(); i < e; ++i) {
+          if (i - firstArg >= callee->getNumParams())
+            break;
+          QualType T = callee->getParamDecl(i - firstArg)->getType();
+          if ((T->isReferenceType() || T->isPointerType()) &&
+              !T->getPointeeType().isConstQualified())
+            assign(CE->getArg(i), deps);
+        }
+        return true;
+      }
+    };
+  } // namespace
+
   OverloadedDeclWithContext
   HessianModeVisitor::Derive(const clang::FunctionDecl* FD,
                              const DiffRequest& request) {
+    if (request.Mode == DiffMode::hessian_vector_product)
+      return DeriveHessianVectorProduct(FD, request);
+
     DiffParams args{};
     IndexIntervalTable indexIntervalTable{};
     if (request.Args)
@@ -90,7 +311,18 @@ namespace clad {
     // request.Function is original function passed in from clad::hessian
     m_Function = request.Function;
 
+    bool isSparse = HasOption(request.BitMaskedOpts, opts::hessian_sparse);
+    bool isPacked = HasOption(request.BitMaskedOpts, opts::hessian_packed);
+    bool isDiagonal = request.Mode == DiffMode::hessian_diagonal;
     std::string hessianFuncName = request.BaseFunctionName + "_hessian";
+    // The sparse entries, the packed triangle and the diagonal have a
+    // different layout than the full matrix.
+    if (isSparse)
+      hessianFuncName += "_sparse";
+    else if (isPacked)
+      hessianFuncName += "_packed";
+    else if (isDiagonal)
+      hessianFuncName += "_diagonal";
     // To be consistent with older tests, nothing is appended to 'f_hessian' if
     // we differentiate w.r.t. all the parameters at once.
     if (!std::equal(m_Function->param_begin(), m_Function->param_end(),
@@ -103,11 +335,10 @@ namespace clad {
       }
     }
 
-    // Ascertains the independent arguments and differentiates the function
-    // in forward and reverse mode by calling ProcessDiffRequest twice each
-    // iteration, storing each generated second derivative function
-    // (corresponds to columns of Hessian matrix) in a vector for private method
-    // merge.
+    // Ascertains the independent arguments in the order of the parameters,
+    // together with the requested indices of array parameters.
+    llvm::SmallVector<std::pair<const ParmVarDecl*, IndexInterval>, 16>
+        independentArgs{};
     for (auto PVD : FD->parameters()) {
       auto it = std::find(std::begin(args), std::end(args), PVD);
       if (it != args.end()) {
@@ -138,8 +369,9 @@ namespace clad {
               suggestedArgsStr =
                   PVD->getNameAsString() + "[0:<last index of b>]";
             }
-            std::string helperMsg("clad::hessian(" + FD->getNameAsString() +
-                                  ", \"" + suggestedArgsStr + "\")");
+            std::string helperMsg(
+                (isDiagonal ? "clad::hessian_diagonal(" : "clad::hessian(") +
+                FD->getNameAsString() + ", \"" + suggestedArgsStr + "\")");
             diag(DiagnosticsEngine::Error,
                  request.Args ? request.Args->getEndLoc() : noLoc,
                  "Hessian mode differentiation w.r.t. array or pointer "
@@ -148,41 +380,569 @@ namespace clad {
                  {helperMsg});
             return {};
           }
+          independentArgs.emplace_back(PVD, indexIntervalTable[argIndex]);
+        } else {
+          independentArgs.emplace_back(PVD, IndexInterval{});
+        }
+      }
+    }
 
-          IndependentArgsSize.push_back(indexIntervalTable[argIndex].size());
-          TotalIndependentArgsSize += indexIntervalTable[argIndex].size();
-
-          // Derive the function w.r.t. to each requested index of the current
-          // array in forward mode and then in reverse mode w.r.t to all
-          // requested args
-          for (auto i = indexIntervalTable[argIndex].Start;
-               i < indexIntervalTable[argIndex].Finish; i++) {
-            auto independentArgString =
-                PVD->getNameAsString() + "[" + std::to_string(i) + "]";
-            auto ForwardModeIASL =
-                CreateStringLiteral(m_Context, independentArgString);
-            auto DFD =
-                DeriveUsingForwardAndReverseMode(m_CladPlugin, request,
-                                                 ForwardModeIASL, request.Args);
-            secondDerivativeColumns.push_back(DFD);
-          }
+    if (isSparse)
+      return DeriveSparse(FD, request, independentArgs, hessianFuncName);
 
-        } else {
-          IndependentArgsSize.push_back(1);
-          TotalIndependentArgsSize++;
-          // Derive the function w.r.t. to the current arg in forward mode and
-          // then in reverse mode w.r.t to all requested args
+    // All the columns are computed together by a single function propagating
+    // second order series, see TaylorModeVisitor::DeriveHessian. Each distinct
+    // second derivative is computed once, which also allows storing only the
+    // upper triangle.
+    if (HasOption(request.BitMaskedOpts, opts::hessian_fused) || isPacked ||
+        isDiagonal) {
+      TaylorModeVisitor T(m_Builder);
+      return T.DeriveHessian(FD, request, independentArgs, hessianFuncName);
+    }
+
+    // The columns of a method are computed sequentially as they would need
+    // to be passed as pointers to members together with the object.
+    bool isParallel =
+        HasOption(request.BitMaskedOpts, opts::hessian_parallel) &&
+        !isa<CXXMethodDecl>(m_Function);
+    if (isParallel && GetCladTaskGroupType().isNull())
+      return {};
+
+    // Differentiates the function in forward and reverse mode by calling
+    // ProcessDiffRequest twice for each independent argument, storing each
+    // generated second derivative function (corresponds to columns of Hessian
+    // matrix) in a vector for private method merge.
+    for (auto& independentArg : independentArgs) {
+      const ParmVarDecl* PVD = independentArg.first;
+      IndexInterval& interval = independentArg.second;
+      if (isArrayOrPointerType(PVD->getType())) {
+        IndependentArgsSize.push_back(interval.size());
+        TotalIndependentArgsSize += interval.size();
+
+        // Derive the function w.r.t. to each requested index of the current
+        // array in forward mode and then in reverse mode w.r.t to all
+        // requested args
+        for (auto i = interval.Start; i < interval.Finish; i++) {
+          auto independentArgString =
+              PVD->getNameAsString() + "[" + std::to_string(i) + "]";
           auto ForwardModeIASL =
-              CreateStringLiteral(m_Context, PVD->getNameAsString());
+              utils::CreateStringLiteral(m_Context, independentArgString);
           auto DFD =
               DeriveUsingForwardAndReverseMode(m_CladPlugin, request,
                                                ForwardModeIASL, request.Args);
           secondDerivativeColumns.push_back(DFD);
         }
+      } else {
+        IndependentArgsSize.push_back(1);
+        TotalIndependentArgsSize++;
+        // Derive the function w.r.t. to the current arg in forward mode and
+        // then in reverse mode w.r.t to all requested args
+        auto ForwardModeIASL =
+            utils::CreateStringLiteral(m_Context, PVD->getNameAsString());
+        auto DFD =
+            DeriveUsingForwardAndReverseMode(m_CladPlugin, request,
+                                             ForwardModeIASL, request.Args);
+        secondDerivativeColumns.push_back(DFD);
       }
     }
     return Merge(secondDerivativeColumns, IndependentArgsSize,
-                 TotalIndependentArgsSize, hessianFuncName);
+                 TotalIndependentArgsSize, hessianFuncName, isParallel);
+  }
+
+  OverloadedDeclWithContext
+  HessianModeVisitor::DeriveHessianVectorProduct(const FunctionDecl* FD,
+                                                 const DiffRequest& request) {
+    DiffParams args{};
+    IndexIntervalTable indexIntervalTable{};
+    if (request.Args)
+      std::tie(args, indexIntervalTable) = parseDiffArgs(request.Args, FD);
+    else
+      std::copy(FD->param_begin(), FD->param_end(), std::back_inserter(args));
+    if (args.empty())
+      return {};
+
+    // request.Function is original function passed in from
+    // clad::hessian_vector_product
+    m_Function = request.Function;
+
+    std::string hvpFuncName =
+        request.BaseFunctionName + "_hessian_vector_product";
+    // Nothing is appended if we differentiate w.r.t. all the parameters.
+    if (!(args.size() == m_Function->getNumParams() &&
+          std::equal(m_Function->param_begin(), m_Function->param_end(),
+                     std::begin(args)))) {
+      for (auto arg : args) {
+        auto it =
+            std::find(m_Function->param_begin(), m_Function->param_end(), arg);
+        auto idx = std::distance(m_Function->param_begin(), it);
+        hvpFuncName += ('_' + std::to_string(idx));
+      }
+    }
+
+    // Collect the independent parameters in the order of the parameters of
+    // the function, which is also the order of their entries in the
+    // direction and in the product, e.g. "x, p[0:2]".
+    std::string independentArgsStr;
+    llvm::SmallVector<IndexInterval, 16> independentIntervals;
+    for (auto PVD : FD->parameters()) {
+      auto it = std::find(std::begin(args), std::end(args), PVD);
+      if (it == args.end())
+        continue;
+      auto argIndex = it - args.begin();
+      IndexInterval interval(0);
+      std::string independentArgStr = PVD->getNameAsString();
+      if (isArrayOrPointerType(PVD->getType())) {
+        if (indexIntervalTable.size() == 0 ||
+            indexIntervalTable[argIndex].size() == 0) {
+          diag(DiagnosticsEngine::Error,
+               request.Args ? request.Args->getEndLoc() : noLoc,
+               "Hessian-vector product w.r.t. array or pointer parameter "
+               "('%0') needs explicit declaration of the indices of the array "
+               "using the args parameter, e.g. '%0[0:<last index of %0>]'",
+               {PVD->getNameAsString()});
+          return {};
+        }
+        interval = indexIntervalTable[argIndex];
+        independentArgStr += "[" + std::to_string(interval.Start);
+        if (interval.size() > 1)
+          independentArgStr += ":" + std::to_string(interval.Finish - 1);
+        independentArgStr += "]";
+      }
+      independentArgsStr +=
+          (independentArgsStr.empty() ? "" : ", ") + independentArgStr;
+      independentIntervals.push_back(interval);
+    }
+    if (independentIntervals.size() != args.size()) {
+      diag(DiagnosticsEngine::Error,
+           request.Args ? request.Args->getEndLoc() : noLoc,
+           "Hessian-vector product w.r.t. member variables is not supported");
+      return {};
+    }
+    auto independentArgsSL =
+        utils::CreateStringLiteral(m_Context, independentArgsStr);
+
+    // The directional derivative along the direction, which is further
+    // derived in reverse mode w.r.t. the independent parameters. The gradient
+    // of the directional derivative is the product of the hessian with the
+    // direction.
+    DiffRequest directionalRequest = request;
+    directionalRequest.Mode = DiffMode::forward;
+    directionalRequest.Args = independentArgsSL;
+    directionalRequest.DirectionalDerivative = true;
+    directionalRequest.CallUpdateRequired = false;
+    // FIXME: Find a way to do this without accessing plugin namespace functions
+    FunctionDecl* directionalDerivative =
+        plugin::ProcessDiffRequest(m_CladPlugin, directionalRequest);
+    if (!directionalDerivative)
+      return {};
+
+    DiffRequest gradientRequest = request;
+    gradientRequest.Mode = DiffMode::reverse;
+    gradientRequest.Function = directionalDerivative;
+    gradientRequest.Args = independentArgsSL;
+    gradientRequest.BaseFunctionName =
+        directionalDerivative->getNameAsString();
+    gradientRequest.CallUpdateRequired = false;
+    FunctionDecl* gradient =
+        plugin::ProcessDiffRequest(m_CladPlugin, gradientRequest);
+    if (!gradient)
+      return {};
+
+    // Create the function void f_hessian_vector_product(A1, A2, ..., An,
+    // clad::array_ref<R> direction, clad::array_ref<R> hvp).
+    QualType arrayRefType = GetCladArrayRefOfType(m_Function->getReturnType());
+    auto originalFnProtoType = cast<FunctionProtoType>(m_Function->getType());
+    llvm::SmallVector<QualType, 16> paramTypes(
+        originalFnProtoType->param_type_begin(),
+        originalFnProtoType->param_type_end());
+    paramTypes.push_back(arrayRefType);
+    paramTypes.push_back(arrayRefType);
+    QualType hvpFunctionType =
+        m_Context.getFunctionType(m_Context.VoidTy, paramTypes,
+                                  originalFnProtoType->getExtProtoInfo());
+
+    IdentifierInfo* II = &m_Context.Idents.get(hvpFuncName);
+    DeclarationNameInfo name(II, noLoc);
+    DeclContext* DC = const_cast<DeclContext*>(m_Function->getDeclContext());
+    llvm::SaveAndRestore<DeclContext*> SaveContext(m_Sema.CurContext);
+    llvm::SaveAndRestore<Scope*> SaveScope(m_CurScope);
+    m_Sema.CurContext = DC;
+    DeclWithContext result =
+        m_Builder.cloneFunction(m_Function, *this, DC, m_Sema, m_Context,
+                                noLoc, name, hvpFunctionType);
+    FunctionDecl* hvpFD = result.first;
+
+    beginScope(Scope::FunctionPrototypeScope | Scope::FunctionDeclarationScope |
+               Scope::DeclScope);
+    m_Sema.PushFunctionScope();
+    m_Sema.PushDeclContext(getCurrentScope(), hvpFD);
+
+    llvm::SmallVector<ParmVarDecl*, 16> params;
+    for (auto* PVD : m_Function->parameters()) {
+      auto VD = ParmVarDecl::Create(
+          m_Context, hvpFD, noLoc, noLoc, PVD->getIdentifier(),
+          PVD->getType(), PVD->getTypeSourceInfo(), PVD->getStorageClass(),
+          // Clone default arg if present.
+          PVD->hasDefaultArg() ? Clone(PVD->getDefaultArg()) : nullptr);
+      if (VD->getIdentifier())
+        m_Sema.PushOnScopeChains(VD, getCurrentScope(),
+                                 /*AddToContext=*/false);
+      params.push_back(VD);
+    }
+    // The parameters "direction" and "hvp".
+    for (const char* paramName : {"direction", "hvp"}) {
+      params.push_back(ParmVarDecl::Create(
+          m_Context, hvpFD, noLoc, noLoc, &m_Context.Idents.get(paramName),
+          arrayRefType,
+          m_Context.getTrivialTypeSourceInfo(arrayRefType, noLoc),
+          params.front()->getStorageClass(),
+          /* No default value */ nullptr));
+      m_Sema.PushOnScopeChains(params.back(), getCurrentScope(),
+                               /*AddToContext=*/false);
+    }
+    hvpFD->setParams(params);
+    ParmVarDecl* direction = params[params.size() - 2];
+    ParmVarDecl* hvp = params.back();
+
+    beginScope(Scope::FnScope | Scope::DeclScope);
+    m_DerivativeFnScope = getCurrentScope();
+    beginBlock();
+
+    // Call the gradient of the directional derivative with the parameters,
+    // the components of the direction and the slices of the product, e.g.
+    // f_dvec_grad(x, p, direction[0], &direction[1], hvp.slice(0, 1),
+    //             hvp.slice(1, 3));
+    auto size_type = m_Context.getSizeType();
+    auto size_type_bits = m_Context.getIntWidth(size_type);
+    auto BuildSizeLiteral = [&](size_t value) -> Expr* {
+      return IntegerLiteral::Create(m_Context,
+                                    llvm::APInt(size_type_bits, value),
+                                    size_type, noLoc);
+    };
+    llvm::SmallVector<Expr*, 16> callArgs;
+    for (unsigned i = 0, e = m_Function->getNumParams(); i < e; ++i)
+      callArgs.push_back(BuildDeclRef(params[i]));
+    size_t offset = 0;
+    llvm::SmallVector<Expr*, 16> productArgs;
+    for (unsigned i = 0, e = m_Function->getNumParams(); i < e; ++i) {
+      const ParmVarDecl* PVD = m_Function->getParamDecl(i);
+      if (std::find(args.begin(), args.end(), PVD) == args.end())
+        continue;
+      size_t size = independentIntervals[productArgs.size()].size();
+      Expr* directionEntry =
+          m_Sema
+              .ActOnArraySubscriptExpr(getCurrentScope(),
+                                       BuildDeclRef(direction), noLoc,
+                                       BuildSizeLiteral(offset), noLoc)
+              .get();
+      if (isArrayOrPointerType(PVD->getType()))
+        directionEntry = BuildOp(UO_AddrOf, directionEntry);
+      callArgs.push_back(directionEntry);
+      // Create the hvp.slice(offset, size) expression.
+      SmallVector<Expr*, 2> sliceArgs({BuildSizeLiteral(offset),
+                                       BuildSizeLiteral(size)});
+      productArgs.push_back(
+          BuildArrayRefSliceExpr(BuildDeclRef(hvp), sliceArgs));
+      offset += size;
+    }
+    callArgs.append(productArgs.begin(), productArgs.end());
+    addToCurrentBlock(BuildCallExprToFunction(gradient, callArgs));
+    hvpFD->setBody(endBlock());
+
+    endScope(); // Function body scope
+    m_Sema.PopFunctionScopeInfo();
+    m_Sema.PopDeclContext();
+    endScope(); // Function decl scope
+
+    return OverloadedDeclWithContext{result.first, result.second,
+                                     /*OverloadFunctionDecl=*/nullptr};
+  }
+
+  OverloadedDeclWithContext HessianModeVisitor::DeriveSparse(
+      const FunctionDecl* FD, const DiffRequest& request,
+      llvm::ArrayRef<std::pair<const ParmVarDecl*, IndexInterval>>
+          independentArgs,
+      const std::string& hessianFuncName) {
+    HessianSparsityPatternCollector Collector(m_Context, independentArgs);
+    Collector.Collect(FD->getBody());
+    if (!Collector.IsSupported) {
+      diag(DiagnosticsEngine::Error,
+           request.Args ? request.Args->getEndLoc() : noLoc,
+           "the sparsity pattern of the hessian of '%0' cannot be detected, "
+           "its variables must not be modified through pointers, references "
+           "or members",
+           {FD->getNameAsString()});
+      return {};
+    }
+
+    // Enumerate the nonzeros of both triangles in row-major order and
+    // collect the off-diagonal neighbours of each independent variable.
+    unsigned n = Collector.NumIndependents;
+    std::vector<std::set<unsigned>> rows(n);
+    std::vector<std::set<unsigned>> neighbours(n);
+    for (auto& entry : Collector.Pattern) {
+      rows[entry.first].insert(entry.second);
+      rows[entry.second].insert(entry.first);
+      if (entry.first != entry.second) {
+        neighbours[entry.first].insert(entry.second);
+        neighbours[entry.second].insert(entry.first);
+      }
+    }
+    std::vector<std::pair<unsigned, unsigned>> nonzeros;
+    for (unsigned row = 0; row < n; ++row)
+      for (unsigned col : rows[row])
+        nonzeros.emplace_back(row, col);
+
+    // Greedily star color the adjacency graph: adjacent variables have
+    // different colors and every path on four variables uses at least three
+    // colors. Variables without nonzeros are not computed at all.
+    const unsigned noColor = ~0U;
+    std::vector<unsigned> colors(n, noColor);
+    unsigned numColors = 0;
+    for (unsigned v = 0; v < n; ++v) {
+      if (rows[v].empty())
+        continue;
+      std::set<unsigned> forbidden;
+      for (unsigned w : neighbours[v]) {
+        if (colors[w] != noColor)
+          forbidden.insert(colors[w]);
+        for (unsigned x : neighbours[w]) {
+          if (x == v || colors[x] == noColor)
+            continue;
+          if (colors[w] == noColor) {
+            forbidden.insert(colors[x]);
+            continue;
+          }
+          // The path v-w-x-y would be colored with two colors.
+          for (unsigned y : neighbours[x]) {
+            if (y != w && colors[y] == colors[w]) {
+              forbidden.insert(colors[x]);
+              break;
+            }
+          }
+        }
+      }
+      unsigned color = 0;
+      while (forbidden.count(color))
+        ++color;
+      colors[v] = color;
+      numColors = std::max(numColors, color + 1);
+    }
+
+    // The products of the hessian with the sum of the unit vectors of each
+    // color. The entry (i, j) is the element i of the product of the color of
+    // j if no other neighbour of i has the color of j, otherwise, by the
+    // properties of star colorings, the element j of the product of the color
+    // of i.
+    auto compressedIndex = [&](unsigned row, unsigned col) -> size_t {
+      if (row != col) {
+        for (unsigned k : neighbours[row]) {
+          if (k != col && colors[k] == colors[col])
+            return colors[row] * n + col;
+        }
+      }
+      return colors[col] * n + row;
+    };
+
+    FunctionDecl* hvpFD = nullptr;
+    if (numColors) {
+      DiffRequest hvpRequest = request;
+      hvpRequest.Mode = DiffMode::hessian_vector_product;
+      hvpRequest.BitMaskedOpts = 0;
+      hvpRequest.CallUpdateRequired = false;
+      // FIXME: Find a way to do this without accessing plugin namespace
+      // functions
+      hvpFD = plugin::ProcessDiffRequest(m_CladPlugin, hvpRequest);
+      if (!hvpFD)
+        return {};
+    }
+
+    // Create the function size_t f_hessian_sparse(A1, A2, ..., An,
+    // clad::array_ref<R> hessianValues, size_t* rowIndices,
+    // size_t* columnIndices).
+    QualType elemType = m_Function->getReturnType();
+    QualType arrayRefType = GetCladArrayRefOfType(elemType);
+    QualType sizeType = m_Context.getSizeType();
+    QualType indicesType = m_Context.getPointerType(sizeType);
+    auto originalFnProtoType = cast<FunctionProtoType>(m_Function->getType());
+    llvm::SmallVector<QualType, 16> paramTypes(
+        originalFnProtoType->param_type_begin(),
+        originalFnProtoType->param_type_end());
+    paramTypes.push_back(arrayRefType);
+    paramTypes.push_back(indicesType);
+    paramTypes.push_back(indicesType);
+    QualType hessianFunctionType =
+        m_Context.getFunctionType(sizeType, paramTypes,
+                                  originalFnProtoType->getExtProtoInfo());
+
+    IdentifierInfo* II = &m_Context.Idents.get(hessianFuncName);
+    DeclarationNameInfo name(II, noLoc);
+    DeclContext* DC = const_cast<DeclContext*>(m_Function->getDeclContext());
+    llvm::SaveAndRestore<DeclContext*> SaveContext(m_Sema.CurContext);
+    llvm::SaveAndRestore<Scope*> SaveScope(m_CurScope);
+    m_Sema.CurContext = DC;
+    DeclWithContext result =
+        m_Builder.cloneFunction(m_Function, *this, DC, m_Sema, m_Context,
+                                noLoc, name, hessianFunctionType);
+    FunctionDecl* hessianFD = result.first;
+
+    beginScope(Scope::FunctionPrototypeScope | Scope::FunctionDeclarationScope |
+               Scope::DeclScope);
+    m_Sema.PushFunctionScope();
+    m_Sema.PushDeclContext(getCurrentScope(), hessianFD);
+
+    llvm::SmallVector<ParmVarDecl*, 16> params;
+    for (auto* PVD : m_Function->parameters()) {
+      auto VD = ParmVarDecl::Create(
+          m_Context, hessianFD, noLoc, noLoc, PVD->getIdentifier(),
+          PVD->getType(), PVD->getTypeSourceInfo(), PVD->getStorageClass(),
+          // Clone default arg if present.
+          PVD->hasDefaultArg() ? Clone(PVD->getDefaultArg()) : nullptr);
+      if (VD->getIdentifier())
+        m_Sema.PushOnScopeChains(VD, getCurrentScope(),
+                                 /*AddToContext=*/false);
+      params.push_back(VD);
+    }
+    // The values of the matrix and their row and column indices.
+    std::pair<const char*, QualType> extraParams[] = {
+        {"hessianValues", arrayRefType},
+        {"rowIndices", indicesType},
+        {"columnIndices", indicesType}};
+    for (auto& extraParam : extraParams) {
+      params.push_back(ParmVarDecl::Create(
+          m_Context, hessianFD, noLoc, noLoc,
+          &m_Context.Idents.get(extraParam.first), extraParam.second,
+          m_Context.getTrivialTypeSourceInfo(extraParam.second, noLoc),
+          params.front()->getStorageClass(),
+          /*DefArg=*/nullptr));
+      m_Sema.PushOnScopeChains(params.back(), getCurrentScope(),
+                               /*AddToContext=*/false);
+    }
+    hessianFD->setParams(params);
+    ParmVarDecl* hessianValues = params[params.size() - 3];
+    ParmVarDecl* rowIndices = params[params.size() - 2];
+    ParmVarDecl* columnIndices = params.back();
+
+    beginScope(Scope::FnScope | Scope::DeclScope);
+    m_DerivativeFnScope = getCurrentScope();
+    beginBlock();
+
+    unsigned sizeTypeBits = m_Context.getIntWidth(sizeType);
+    auto BuildSizeLiteral = [&](uint64_t value) -> Expr* {
+      return IntegerLiteral::Create(m_Context,
+                                    llvm::APInt(sizeTypeBits, value),
+                                    sizeType, noLoc);
+    };
+    auto BuildSubscript = [&](VarDecl* base, uint64_t idx) -> Expr* {
+      return m_Sema
+          .ActOnArraySubscriptExpr(getCurrentScope(), BuildDeclRef(base),
+                                   noLoc, BuildSizeLiteral(idx), noLoc)
+          .get();
+    };
+    if (numColors) {
+      // The seeds and the products of all the colors are stored one after
+      // the other, e.g. for two colors and three variables:
+      // double _seeds0[6] = {1, 1, 0, 0, 0, 1};
+      // double _compressed0[6] = {};
+      // clad::array_ref<double> _seeds_ref0(_seeds0, 6UL);
+      // clad::array_ref<double> _compressed_ref0(_compressed0, 6UL);
+      size_t size = numColors * n;
+      QualType compressedType = clad_compat::getConstantArrayType(
+          m_Context, elemType, llvm::APInt(sizeTypeBits, size),
+          /*SizeExpr=*/nullptr, ArrayType::ArraySizeModifier::Normal,
+          /*IndexTypeQuals=*/0);
+      llvm::SmallVector<Expr*, 16> seedValues;
+      for (unsigned color = 0; color < numColors; ++color)
+        for (unsigned k = 0; k < n; ++k)
+          seedValues.push_back(ConstantFolder::synthesizeLiteral(
+              m_Context.IntTy, m_Context, colors[k] == color));
+      VarDecl* seeds = BuildVarDecl(
+          compressedType, "_seeds",
+          m_Sema.ActOnInitList(noLoc, seedValues, noLoc).get());
+      VarDecl* compressed = BuildVarDecl(compressedType, "_compressed",
+                                         getZeroInit(compressedType));
+      addToCurrentBlock(BuildDeclStmt(seeds));
+      addToCurrentBlock(BuildDeclStmt(compressed));
+      auto BuildArrayRef = [&](VarDecl* array, llvm::StringRef prefix) {
+        llvm::SmallVector<Expr*, 2> refArgs{BuildDeclRef(array),
+                                            BuildSizeLiteral(size)};
+        Expr* init =
+            m_Sema.ActOnParenListExpr(noLoc, noLoc, refArgs).get();
+        VarDecl* ref = BuildVarDecl(arrayRefType, prefix, init,
+                                    /*DirectInit=*/true, /*TSI=*/nullptr,
+                                    VarDecl::InitializationStyle::CallInit);
+        addToCurrentBlock(BuildDeclStmt(ref));
+        return ref;
+      };
+      VarDecl* seedsRef = BuildArrayRef(seeds, "_seeds_ref");
+      VarDecl* compressedRef = BuildArrayRef(compressed, "_compressed_ref");
+
+      // One hessian-vector product per color, e.g.
+      // f_hessian_vector_product(x, y, z, _seeds_ref0.slice(0UL, 3UL),
+      //                          _compressed_ref0.slice(0UL, 3UL));
+      for (unsigned color = 0; color < numColors; ++color) {
+        llvm::SmallVector<Expr*, 16> callArgs;
+        for (unsigned i = 0, e = m_Function->getNumParams(); i < e; ++i)
+          callArgs.push_back(BuildDeclRef(params[i]));
+        for (VarDecl* ref : {seedsRef, compressedRef}) {
+          llvm::SmallVector<Expr*, 2> sliceArgs{BuildSizeLiteral(color * n),
+                                                BuildSizeLiteral(n)};
+          callArgs.push_back(
+              BuildArrayRefSliceExpr(BuildDeclRef(ref), sliceArgs));
+        }
+        addToCurrentBlock(BuildCallExprToFunction(hvpFD, callArgs));
+      }
+
+      // Recover the nonzeros from the products, e.g.
+      // hessianValues[0UL] = _compressed0[0UL];
+      for (unsigned i = 0, e = nonzeros.size(); i < e; ++i) {
+        Expr* entry = BuildSubscript(hessianValues, i);
+        Expr* value = BuildSubscript(
+            compressed,
+            compressedIndex(nonzeros[i].first, nonzeros[i].second));
+        addToCurrentBlock(BuildOp(BO_Assign, entry, value));
+      }
+    }
+
+    // The sparsity pattern is known at compile time and is only stored if
+    // the arrays of indices are passed, e.g.
+    // if (rowIndices && columnIndices) {
+    //   rowIndices[0] = 0UL;
+    //   columnIndices[0] = 1UL;
+    //   ...
+    // }
+    if (!nonzeros.empty()) {
+      beginBlock();
+      for (unsigned i = 0, e = nonzeros.size(); i < e; ++i) {
+        addToCurrentBlock(BuildOp(BO_Assign, BuildSubscript(rowIndices, i),
+                                  BuildSizeLiteral(nonzeros[i].first)));
+        addToCurrentBlock(BuildOp(BO_Assign,
+                                  BuildSubscript(columnIndices, i),
+                                  BuildSizeLiteral(nonzeros[i].second)));
+      }
+      Stmt* storePattern = endBlock();
+      Expr* cond = BuildOp(BO_LAnd, BuildDeclRef(rowIndices),
+                           BuildDeclRef(columnIndices));
+      addToCurrentBlock(clad_compat::IfStmt_Create(m_Context, noLoc,
+                                                   /*IsConstexpr=*/false,
+                                                   /*Init=*/nullptr,
+                                                   /*Var=*/nullptr, cond,
+                                                   noLoc, noLoc, storePattern));
+    }
+    addToCurrentBlock(m_Sema
+                          .ActOnReturnStmt(noLoc,
+                                           BuildSizeLiteral(nonzeros.size()),
+                                           getCurrentScope())
+                          .get());
+    hessianFD->setBody(endBlock());
+
+    endScope(); // Function body scope
+    m_Sema.PopFunctionScopeInfo();
+    m_Sema.PopDeclContext();
+    endScope(); // Function decl scope
+
+    return OverloadedDeclWithContext{result.first, result.second,
+                                     /*OverloadFunctionDecl=*/nullptr};
   }
 
   // Combines all generated second derivative functions into a
@@ -192,7 +952,7 @@ namespace clad {
   HessianModeVisitor::Merge(std::vector<FunctionDecl*> secDerivFuncs,
                             SmallVector<size_t, 16> IndependentArgsSize,
                             size_t TotalIndependentArgsSize,
-                            std::string hessianFuncName) {
+                            std::string hessianFuncName, bool parallel) {
     DiffParams args;
     std::copy(m_Function->param_begin(),
               m_Function->param_end(),
@@ -292,12 +1052,32 @@ namespace clad {
     beginScope(Scope::FnScope | Scope::DeclScope);
     m_DerivativeFnScope = getCurrentScope();
 
+    auto size_type = m_Context.getSizeType();
+    auto size_type_bits = m_Context.getIntWidth(size_type);
+
+    // The columns are added to a task group and executed together, e.g.
+    // clad::task_group _tasks0(2UL);
+    // _tasks0.run(static_cast<void (*)(double, double,
+    //             clad::array_ref<double>, clad::array_ref<double>)>(
+    //                 f_darg0_grad),
+    //             x, y, hessianMatrix.slice(0UL, 1UL), ...);
+    // ...
+    // _tasks0.wait();
+    VarDecl* tasks = nullptr;
+    if (parallel) {
+      Expr* numTasks = IntegerLiteral::Create(
+          m_Context, llvm::APInt(size_type_bits, secDerivFuncs.size()),
+          size_type, noLoc);
+      tasks = BuildVarDecl(GetCladTaskGroupType(), "_tasks", numTasks,
+                           /*DirectInit=*/true, /*TSI=*/nullptr,
+                           VarDecl::InitializationStyle::CallInit);
+      CompStmtSave.push_back(BuildDeclStmt(tasks));
+    }
+
     // Creates callExprs to the second derivative functions genereated
     // and creates maps array elements to input array.
     for (size_t i = 0, e = secDerivFuncs.size(); i < e; ++i) {
       const size_t HessianMatrixStartIndex = i * TotalIndependentArgsSize;
-      auto size_type = m_Context.getSizeType();
-      auto size_type_bits = m_Context.getIntWidth(size_type);
 
       // Transforms ParmVarDecls into Expr paramters for insertion into function
       std::vector<Expr*> DeclRefToParams;
@@ -330,9 +1110,30 @@ namespace clad {
         DeclRefToParams.push_back(SliceExpr);
         columnIndex += IndependentArgsSize[j];
       }
-      Expr* call = BuildCallExprToFunction(secDerivFuncs[i], DeclRefToParams);
+      Expr* call = nullptr;
+      if (tasks) {
+        // The gradients of a subset of the arguments are overloaded, the
+        // cast picks the column when the derivative is parsed again, e.g.
+        // from the generated sources.
+        QualType FnPtrTy =
+            m_Context.getPointerType(secDerivFuncs[i]->getType());
+        Expr* Fn = m_Sema
+                       .BuildCXXNamedCast(
+                           noLoc, tok::TokenKind::kw_static_cast,
+                           m_Context.getTrivialTypeSourceInfo(FnPtrTy),
+                           BuildDeclRef(secDerivFuncs[i]), noLoc, noLoc)
+                       .get();
+        DeclRefToParams.insert(DeclRefToParams.begin(), Fn);
+        call = BuildCallExprToMemFn(BuildDeclRef(tasks), /*isArrow=*/false,
+                                    "run", DeclRefToParams);
+      } else {
+        call = BuildCallExprToFunction(secDerivFuncs[i], DeclRefToParams);
+      }
       CompStmtSave.push_back(call);
     }
+    if (tasks)
+      CompStmtSave.push_back(BuildCallExprToMemFn(
+          BuildDeclRef(tasks), /*isArrow=*/false, "wait", {}));
 
     auto StmtsRef =
         llvm::makeArrayRef(CompStmtSave.data(), CompStmtSave.size());
@@ -6,6 +6,7 @@
 
 #include "clad/Differentiator/JacobianModeVisitor.h"
 
+#include "clad/Differentiator/CladUtils.h"
 #include "clad/Differentiator/DiffPlanner.h"
 #include "clad/Differentiator/ErrorEstimator.h"
 #include "clad/Differentiator/ReverseModeVisitor.h"
@@ -20,7 +21,9 @@
 #include "llvm/Support/SaveAndRestore.h"
 
 #include <algorithm>
+#include <map>
 #include <numeric>
+#include <set>
 
 #include "clad/Differentiator/Compatibility.h"
 
@@ -32,15 +35,635 @@ namespace clad {
 
   JacobianModeVisitor::~JacobianModeVisitor() {}
 
+  namespace {
+    /// Collects the elements of the output parameter of a vector-valued
+    /// function which are assigned to, e.g. output[2] = x * y, and whether the
+    /// function has control flow which prevents replaying its reverse sweep.
+    class OutputAssignmentsCollector
+        : public RecursiveASTVisitor<OutputAssignmentsCollector> {
+      const ASTContext& m_Context;
+      const ValueDecl* m_Output;
+
+    public:
+      /// The constant indices of the assigned elements.
+      std::set<int64_t> Indices;
+      /// Set if an element is assigned with an index not known at compile
+      /// time, in which case the number of outputs is unknown.
+      bool HasNonConstantIndex = false;
+      /// Set if the function has loops or returns. The reverse sweep of such
+      /// functions consumes its tapes and cannot be replayed.
+      bool HasLoopOrReturn = false;
+
+      OutputAssignmentsCollector(const ASTContext& C, const ValueDecl* Output)
+          : m_Context(C), m_Output(Output) {}
+
+      bool VisitBinaryOperator(BinaryOperator* BinOp) {
+        if (!BinOp->isAssignmentOp())
+          return true;
+        auto ASE =
+            dyn_cast<ArraySubscriptExpr>(BinOp->getLHS()->IgnoreParenImpCasts());
+        if (!ASE)
+          return true;
+        auto DRE = dyn_cast<DeclRefExpr>(ASE->getBase()->IgnoreParenImpCasts());
+        if (!DRE || DRE->getDecl() != m_Output)
+          return true;
+        llvm::APSInt idx;
+        if (clad_compat::Expr_EvaluateAsInt(ASE->getIdx(), idx, m_Context))
+          Indices.insert(idx.getExtValue());
+        else
+          HasNonConstantIndex = true;
+        return true;
+      }
+
+      bool VisitStmt(Stmt* S) {
+        if (isa<ForStmt>(S) || isa<WhileStmt>(S) || isa<DoStmt>(S) ||
+            isa<ReturnStmt>(S))
+          HasLoopOrReturn = true;
+        return true;
+      }
+    };
+
+    /// Computes the sparsity pattern of the Jacobian matrix of a
+    /// vector-valued function, i.e. the independent parameters each element
+    /// of the output depends on. The analysis is flow-insensitive: every
+    /// variable depends on the union of everything assigned to it, which is
+    /// propagated until a fixed point is reached. Control flow conditions are
+    /// ignored as they do not contribute to derivatives.
+    class SparsityPatternCollector
+        : public RecursiveASTVisitor<SparsityPatternCollector> {
+      using Dependencies = std::set<unsigned>;
+      const ASTContext& m_Context;
+      const ValueDecl* m_Output;
+      /// The indices of the independent parameters each variable depends on.
+      std::map<const ValueDecl*, Dependencies> m_Dependencies;
+      bool m_Changed = false;
+
+      void addDependencies(Dependencies& to, const Dependencies& from) {
+        for (unsigned col : from)
+          m_Changed |= to.insert(col).second;
+      }
+
+      Dependencies getDependencies(const Stmt* S) {
+        Dependencies result;
+        if (!S)
+          return result;
+        if (auto DRE = dyn_cast<DeclRefExpr>(S)) {
+          if (DRE->getDecl() == m_Output) {
+            // Reading an element of the output may read any of them.
+            for (auto& row : Pattern)
+              result.insert(row.second.begin(), row.second.end());
+          } else {
+            auto it = m_Dependencies.find(DRE->getDecl());
+            if (it != m_Dependencies.end())
+              result = it->second;
+          }
+          return result;
+        }
+        for (const Stmt* child : S->children()) {
+          Dependencies childDeps = getDependencies(child);
+          result.insert(childDeps.begin(), childDeps.end());
+        }
+        return result;
+      }
+
+      void assign(const Expr* LHS, const Dependencies& deps) {
+        LHS = LHS->IgnoreParenImpCasts();
+        if (auto UO = dyn_cast<UnaryOperator>(LHS))
+          if (UO->getOpcode() == UO_AddrOf)
+            LHS = UO->getSubExpr()->IgnoreParenImpCasts();
+        if (auto ASE = dyn_cast<ArraySubscriptExpr>(LHS)) {
+          auto DRE =
+              dyn_cast<DeclRefExpr>(ASE->getBase()->IgnoreParenImpCasts());
+          if (!DRE || DRE->getDecl() != m_Output)
+            return assign(ASE->getBase(), deps);
+          llvm::APSInt idx;
+          if (clad_compat::Expr_EvaluateAsInt(ASE->getIdx(), idx, m_Context) &&
+              idx.getExtValue() >= 0)
+            addDependencies(Pattern[idx.getExtValue()], deps);
+          else
+            IsSupported = false;
+        } else if (auto DRE = dyn_cast<DeclRefExpr>(LHS)) {
+          // The output is modified through an unknown element.
+          if (DRE->getDecl() == m_Output)
+            IsSupported = false;
+          else
+            addDependencies(m_Dependencies[DRE->getDecl()], deps);
+        } else {
+          // Assignments through pointers or to members are not tracked.
+          IsSupported = false;
+        }
+      }
+
+    public:
+      /// The indices of the independent parameters each element of the
+      /// output depends on.
+      std::map<int64_t, Dependencies> Pattern;
+      /// Set to false if the function modifies its variables or outputs in a
+      /// way the analysis cannot follow, e.g. through pointers.
+      bool IsSupported = true;
+
+      SparsityPatternCollector(const ASTContext& C, const FunctionDecl* FD,
+                               const DiffParams& args)
+          : m_Context(C), m_Output(FD->parameters().back()) {
+        for (unsigned i = 0, e = args.size(); i < e; ++i)
+          m_Dependencies[args[i]].insert(i);
+      }
+
+      void Collect(const Stmt* Body) {
+        do {
+          m_Changed = false;
+          TraverseStmt(const_cast<Stmt*>(Body));
+        } while (m_Changed && IsSupported);
+      }
+
+      bool VisitBinaryOperator(BinaryOperator* BinOp) {
+        if (BinOp->isAssignmentOp())
+          assign(BinOp->getLHS(), getDependencies(BinOp->getRHS()));
+        return true;
+      }
+
+      bool VisitArraySubscriptExpr(ArraySubscriptExpr* ASE) {
+        // The entries of the Jacobian are only known for constant indices,
+        // reading the output at another index, e.g. `y = output[i]`, makes
+        // the rows it depends on unknown.
+        auto DRE = dyn_cast<DeclRefExpr>(ASE->getBase()->IgnoreParenImpCasts());
+        llvm::APSInt idx;
+        if (DRE && DRE->getDecl() == m_Output &&
+            !clad_compat::Expr_EvaluateAsInt(ASE->getIdx(), idx, m_Context))
+          IsSupported = false;
+        return true;
+      }
+
+      bool VisitVarDecl(VarDecl* VD) {
+        // Aliases of variables or outputs are not tracked.
+        QualType T = VD->getType();
+        if (T->isPointerType() ||
+            (T->isReferenceType() &&
+             !T.getNonReferenceType().isConstQualified())) {
+          if (!isa<ParmVarDecl>(VD))
+            IsSupported = false;
+          return true;
+        }
+        if (VD->hasInit())
+          addDependencies(m_Dependencies[VD], getDependencies(VD->getInit()));
+        return true;
+      }
+
+      bool VisitCallExpr(CallExpr* CE) {
+        const FunctionDecl* callee = CE->getDirectCallee();
+        if (!callee) {
+          IsSupported = false;
+          return true;
+        }
+        // Arguments passed by non-const reference or pointer, and the object
+        // of a non-const method, may be assigned anything passed to the call.
+        Dependencies deps = getDependencies(CE);
+        unsigned firstArg = 0;
+        if (auto MD = dyn_cast<CXXMethodDecl>(callee)) {
+          const Expr* object = nullptr;
+          if (auto MCE = dyn_cast<CXXMemberCallExpr>(CE))
+            object = MCE->getImplicitObjectArgument();
+          else if (isa<CXXOperatorCallExpr>(CE) && !MD->isStatic()) {
+            object = CE->getArg(0);
+            firstArg = 1;
+          }
+          if (object && !MD->isConst())
+            assign(object, deps);
+        }
+        for (unsigned i = firstArg, e = CE->getNumArgs(); i < e; ++i) {
+          if (i - firstArg >= callee->getNumParams())
+            break;
+          QualType T = callee->getParamDecl(i - firstArg)->getType();
+          if ((T->isReferenceType() || T->isPointerType()) &&
+              !T->getPointeeType().isConstQualified())
+            assign(CE->getArg(i), deps);
+        }
+        return true;
+      }
+    };
+  } // namespace
+
+  bool JacobianModeVisitor::ShouldUseForwardMode(const FunctionDecl* FD,
+                                                 const DiffRequest& request,
+                                                 const DiffParams& args) {
+    if (HasOption(request.BitMaskedOpts, opts::jacobian_reverse) ||
+        HasOption(request.BitMaskedOpts, opts::jacobian_replay))
+      return false;
+    bool forwardRequested =
+        HasOption(request.BitMaskedOpts, opts::jacobian_forward);
+    // Forward mode seeds one scalar parameter per column.
+    for (auto arg : args) {
+      if (isArrayOrPointerType(arg->getType())) {
+        if (forwardRequested)
+          diag(DiagnosticsEngine::Error,
+               request.Args ? request.Args->getEndLoc() : noLoc,
+               "Forward mode jacobian w.r.t. array or pointer parameter ('%0') "
+               "is not supported, use clad::opts::jacobian_reverse instead",
+               {arg->getNameAsString()});
+        return false;
+      }
+    }
+    if (forwardRequested)
+      return true;
+    // Otherwise pick the mode which needs the fewer sweeps: one per
+    // independent parameter in forward mode, one per output in reverse mode.
+    // Reverse mode is kept on ties and when the number of outputs cannot be
+    // determined.
+    OutputAssignmentsCollector Collector(m_Context, FD->parameters().back());
+    Collector.TraverseStmt(FD->getBody());
+    if (Collector.HasNonConstantIndex)
+      return false;
+    return args.size() < Collector.Indices.size();
+  }
+
   OverloadedDeclWithContext
   JacobianModeVisitor::Derive(const clang::FunctionDecl* FD,
                               const DiffRequest& request) {
     FD = FD->getDefinition();
+    m_Function = FD;
+    silenceDiags = !request.VerboseDiags;
     OverloadedDeclWithContext result{};
 
+    DiffParams args{};
+    if (request.Args)
+      std::tie(args, std::ignore) = parseDiffArgs(request.Args, FD);
+    else
+      std::copy(FD->param_begin(), FD->param_end(), std::back_inserter(args));
+    if (args.empty() || FD->getNumParams() == 0)
+      return {};
+
+    // Same naming as in reverse mode, nothing is appended to 'f_jac' if we
+    // differentiate w.r.t. all the parameters at once.
+    std::string jacobianName = request.BaseFunctionName + "_jac";
+    if (!(args.size() == FD->getNumParams() &&
+          std::equal(FD->param_begin(), FD->param_end(), std::begin(args)))) {
+      for (auto arg : args) {
+        auto it = std::find(FD->param_begin(), FD->param_end(), arg);
+        auto idx = std::distance(FD->param_begin(), it);
+        jacobianName += ('_' + std::to_string(idx));
+      }
+    }
+    // The last parameter is the output of the vector-valued function.
+    DiffParams independentArgs(args.begin(), std::prev(args.end()));
+
+    if (HasOption(request.BitMaskedOpts, opts::jacobian_sparse))
+      return DeriveSparse(FD, request, independentArgs,
+                          request.BaseFunctionName + "_sparse" +
+                              jacobianName.substr(
+                                  request.BaseFunctionName.size()));
+
+    if (ShouldUseForwardMode(FD, request, independentArgs))
+      return DeriveUsingForwardMode(FD, request, independentArgs,
+                                    jacobianName);
+
+    DiffRequest reverseRequest = request;
+    if (HasOption(request.BitMaskedOpts, opts::jacobian_replay)) {
+      OutputAssignmentsCollector Collector(m_Context, FD->parameters().back());
+      Collector.TraverseStmt(FD->getBody());
+      if (Collector.HasNonConstantIndex || Collector.HasLoopOrReturn ||
+          Collector.Indices.empty()) {
+        diag(DiagnosticsEngine::Warning,
+             request.Args ? request.Args->getEndLoc() : noLoc,
+             "replaying the reverse sweep requires a function without loops "
+             "and returns whose outputs are assigned with constant indices, "
+             "computing the jacobian without replay");
+      } else {
+        // One reverse sweep per row of the Jacobian, rows are indexed by the
+        // indices of the output.
+        reverseRequest.JacobianNumRows = *Collector.Indices.rbegin() + 1;
+      }
+    }
+
     ReverseModeVisitor V(this->builder);
-    result = V.Derive(FD, request);
+    result = V.Derive(FD, reverseRequest);
 
     return result;
   }
+
+  OverloadedDeclWithContext
+  JacobianModeVisitor::DeriveUsingForwardMode(const FunctionDecl* FD,
+                                              const DiffRequest& request,
+                                              DiffParams args,
+                                              const std::string& jacobianName) {
+    // Derive the function in forward mode once per independent parameter,
+    // each derivative fills one column of the Jacobian matrix.
+    std::vector<FunctionDecl*> columns;
+    for (unsigned i = 0, e = args.size(); i < e; ++i) {
+      DiffRequest columnRequest = request;
+      columnRequest.Mode = DiffMode::forward;
+      columnRequest.Args =
+          utils::CreateStringLiteral(m_Context, args[i]->getName());
+      columnRequest.CallUpdateRequired = false;
+      columnRequest.BitMaskedOpts = 0;
+      columnRequest.JacobianNumColumns = e;
+      columnRequest.JacobianColumn = i;
+      // FIXME: Find a way to do this without accessing plugin namespace
+      // functions
+      FunctionDecl* column =
+          plugin::ProcessDiffRequest(m_CladPlugin, columnRequest);
+      if (!column)
+        return {};
+      columns.push_back(column);
+    }
+
+    // Create the jacobian function, it has the same type as the one generated
+    // in reverse mode, i.e. void(A1, A2, ..., An, R*, R*).
+    auto originalFnProtoType = cast<FunctionProtoType>(FD->getType());
+    llvm::SmallVector<QualType, 16> paramTypes(
+        originalFnProtoType->param_type_begin(),
+        originalFnProtoType->param_type_end());
+    QualType outputType = paramTypes.back();
+    paramTypes.push_back(outputType);
+    QualType jacobianFnType =
+        m_Context.getFunctionType(m_Context.VoidTy, paramTypes,
+                                  originalFnProtoType->getExtProtoInfo());
+
+    IdentifierInfo* II = &m_Context.Idents.get(jacobianName);
+    DeclarationNameInfo name(II, noLoc);
+    DeclContext* DC = const_cast<DeclContext*>(FD->getDeclContext());
+    llvm::SaveAndRestore<DeclContext*> SaveContext(m_Sema.CurContext);
+    llvm::SaveAndRestore<Scope*> SaveScope(m_CurScope);
+    m_Sema.CurContext = DC;
+    DeclWithContext result =
+        m_Builder.cloneFunction(FD, *this, DC, m_Sema, m_Context, noLoc, name,
+                                jacobianFnType);
+    FunctionDecl* jacobianFD = result.first;
+    m_Derivative = jacobianFD;
+
+    beginScope(Scope::FunctionPrototypeScope | Scope::FunctionDeclarationScope |
+               Scope::DeclScope);
+    m_Sema.PushFunctionScope();
+    m_Sema.PushDeclContext(getCurrentScope(), jacobianFD);
+
+    llvm::SmallVector<ParmVarDecl*, 8> params;
+    for (auto* PVD : FD->parameters()) {
+      auto VD = ParmVarDecl::Create(
+          m_Context, jacobianFD, noLoc, noLoc, PVD->getIdentifier(),
+          PVD->getType(), PVD->getTypeSourceInfo(), PVD->getStorageClass(),
+          // Clone default arg if present.
+          PVD->hasDefaultArg() ? Clone(PVD->getDefaultArg()) : nullptr);
+      if (VD->getIdentifier())
+        m_Sema.PushOnScopeChains(VD, getCurrentScope(),
+                                 /*AddToContext=*/false);
+      params.push_back(VD);
+    }
+    // The output parameter "jacobianMatrix".
+    params.push_back(ParmVarDecl::Create(
+        m_Context, jacobianFD, noLoc, noLoc,
+        &m_Context.Idents.get("jacobianMatrix"), outputType,
+        m_Context.getTrivialTypeSourceInfo(outputType, noLoc),
+        params.front()->getStorageClass(),
+        /*DefArg=*/nullptr));
+    m_Sema.PushOnScopeChains(params.back(), getCurrentScope(),
+                             /*AddToContext=*/false);
+    jacobianFD->setParams(params);
+
+    beginScope(Scope::FnScope | Scope::DeclScope);
+    m_DerivativeFnScope = getCurrentScope();
+    beginBlock();
+    // Call the column derivatives with the same arguments.
+    for (FunctionDecl* column : columns) {
+      llvm::SmallVector<Expr*, 8> callArgs;
+      for (ParmVarDecl* PVD : params)
+        callArgs.push_back(BuildDeclRef(PVD));
+      addToCurrentBlock(BuildCallExprToFunction(column, callArgs));
+    }
+    jacobianFD->setBody(endBlock());
+
+    endScope(); // Function body scope
+    m_Sema.PopFunctionScopeInfo();
+    m_Sema.PopDeclContext();
+    endScope(); // Function decl scope
+
+    return OverloadedDeclWithContext{result.first, result.second,
+                                     /*OverloadFunctionDecl=*/nullptr};
+  }
+
+  OverloadedDeclWithContext
+  JacobianModeVisitor::DeriveSparse(const FunctionDecl* FD,
+                                    const DiffRequest& request,
+                                    DiffParams args,
+                                    const std::string& jacobianName) {
+    for (auto arg : args) {
+      if (isArrayOrPointerType(arg->getType())) {
+        diag(DiagnosticsEngine::Error,
+             request.Args ? request.Args->getEndLoc() : noLoc,
+             "Sparse jacobian w.r.t. array or pointer parameter ('%0') is not "
+             "supported",
+             {arg->getNameAsString()});
+        return {};
+      }
+    }
+    SparsityPatternCollector Collector(m_Context, FD, args);
+    Collector.Collect(FD->getBody());
+    if (!Collector.IsSupported) {
+      diag(DiagnosticsEngine::Error,
+           request.Args ? request.Args->getEndLoc() : noLoc,
+           "the sparsity pattern of '%0' cannot be detected, its outputs must "
+           "be accessed with constant indices and its variables must not be "
+           "modified through pointers, references or members",
+           {FD->getNameAsString()});
+      return {};
+    }
+
+    // Enumerate the nonzeros in row-major order and collect the rows each
+    // column has nonzeros in.
+    std::vector<std::pair<int64_t, unsigned>> nonzeros;
+    std::vector<std::vector<int64_t>> columnRows(args.size());
+    for (auto& row : Collector.Pattern) {
+      for (unsigned col : row.second) {
+        nonzeros.emplace_back(row.first, col);
+        columnRows[col].push_back(row.first);
+      }
+    }
+    int64_t numRows =
+        Collector.Pattern.empty() ? 0 : Collector.Pattern.rbegin()->first + 1;
+
+    // Greedily color the columns such that no two columns of the same color
+    // have nonzeros in the same row. Columns without nonzeros are not
+    // computed at all.
+    const unsigned noColor = ~0U;
+    std::vector<unsigned> colors(args.size(), noColor);
+    unsigned numColors = 0;
+    for (unsigned col = 0, e = args.size(); col < e; ++col) {
+      if (columnRows[col].empty())
+        continue;
+      std::set<unsigned> forbidden;
+      for (unsigned other = 0; other < col; ++other) {
+        for (int64_t row : columnRows[col]) {
+          if (colors[other] != noColor &&
+              Collector.Pattern[row].count(other)) {
+            forbidden.insert(colors[other]);
+            break;
+          }
+        }
+      }
+      unsigned color = 0;
+      while (forbidden.count(color))
+        ++color;
+      colors[col] = color;
+      numColors = std::max(numColors, color + 1);
+    }
+
+    // Derive one compressed column per color, the derivative of output[i]
+    // in this column is the nonzero of row i in the column of this color.
+    std::vector<FunctionDecl*> columns;
+    for (unsigned color = 0; color < numColors; ++color) {
+      std::vector<int> entries(numRows, -1);
+      for (unsigned i = 0, e = nonzeros.size(); i < e; ++i)
+        if (colors[nonzeros[i].second] == color)
+          entries[nonzeros[i].first] = i;
+      std::string seeds;
+      for (unsigned col = 0, e = args.size(); col < e; ++col) {
+        if (colors[col] != color)
+          continue;
+        if (!seeds.empty())
+          seeds += ", ";
+        seeds += args[col]->getNameAsString();
+      }
+      DiffRequest columnRequest = request;
+      columnRequest.Mode = DiffMode::forward;
+      columnRequest.BaseFunctionName = jacobianName;
+      columnRequest.Args = utils::CreateStringLiteral(m_Context, seeds);
+      columnRequest.CallUpdateRequired = false;
+      columnRequest.BitMaskedOpts = 0;
+      columnRequest.JacobianNumColumns = numColors;
+      columnRequest.JacobianColumn = color;
+      columnRequest.JacobianSparseEntries = std::move(entries);
+      // FIXME: Find a way to do this without accessing plugin namespace
+      // functions
+      FunctionDecl* column =
+          plugin::ProcessDiffRequest(m_CladPlugin, columnRequest);
+      if (!column)
+        return {};
+      columns.push_back(column);
+    }
+
+    // Create the sparse jacobian function, i.e.
+    // size_t(A1, A2, ..., An, R*, R*, size_t*, size_t*).
+    auto originalFnProtoType = cast<FunctionProtoType>(FD->getType());
+    llvm::SmallVector<QualType, 16> paramTypes(
+        originalFnProtoType->param_type_begin(),
+        originalFnProtoType->param_type_end());
+    QualType outputType = paramTypes.back();
+    QualType sizeType = m_Context.getSizeType();
+    QualType indicesType = m_Context.getPointerType(sizeType);
+    paramTypes.push_back(outputType);
+    paramTypes.push_back(indicesType);
+    paramTypes.push_back(indicesType);
+    QualType jacobianFnType =
+        m_Context.getFunctionType(sizeType, paramTypes,
+                                  originalFnProtoType->getExtProtoInfo());
+
+    IdentifierInfo* II = &m_Context.Idents.get(jacobianName);
+    DeclarationNameInfo name(II, noLoc);
+    DeclContext* DC = const_cast<DeclContext*>(FD->getDeclContext());
+    llvm::SaveAndRestore<DeclContext*> SaveContext(m_Sema.CurContext);
+    llvm::SaveAndRestore<Scope*> SaveScope(m_CurScope);
+    m_Sema.CurContext = DC;
+    DeclWithContext result =
+        m_Builder.cloneFunction(FD, *this, DC, m_Sema, m_Context, noLoc, name,
+                                jacobianFnType);
+    FunctionDecl* jacobianFD = result.first;
+    m_Derivative = jacobianFD;
+
+    beginScope(Scope::FunctionPrototypeScope | Scope::FunctionDeclarationScope |
+               Scope::DeclScope);
+    m_Sema.PushFunctionScope();
+    m_Sema.PushDeclContext(getCurrentScope(), jacobianFD);
+
+    llvm::SmallVector<ParmVarDecl*, 8> params;
+    for (auto* PVD : FD->parameters()) {
+      auto VD = ParmVarDecl::Create(
+          m_Context, jacobianFD, noLoc, noLoc, PVD->getIdentifier(),
+          PVD->getType(), PVD->getTypeSourceInfo(), PVD->getStorageClass(),
+          // Clone default arg if present.
+          PVD->hasDefaultArg() ? Clone(PVD->getDefaultArg()) : nullptr);
+      if (VD->getIdentifier())
+        m_Sema.PushOnScopeChains(VD, getCurrentScope(),
+                                 /*AddToContext=*/false);
+      params.push_back(VD);
+    }
+    // The values of the matrix and their row and column indices.
+    std::pair<const char*, QualType> extraParams[] = {
+        {"jacobianValues", outputType},
+        {"rowIndices", indicesType},
+        {"columnIndices", indicesType}};
+    for (auto& extraParam : extraParams) {
+      params.push_back(ParmVarDecl::Create(
+          m_Context, jacobianFD, noLoc, noLoc,
+          &m_Context.Idents.get(extraParam.first), extraParam.second,
+          m_Context.getTrivialTypeSourceInfo(extraParam.second, noLoc),
+          params.front()->getStorageClass(),
+          /*DefArg=*/nullptr));
+      m_Sema.PushOnScopeChains(params.back(), getCurrentScope(),
+                               /*AddToContext=*/false);
+    }
+    jacobianFD->setParams(params);
+
+    beginScope(Scope::FnScope | Scope::DeclScope);
+    m_DerivativeFnScope = getCurrentScope();
+    beginBlock();
+    // Call the compressed columns with the arguments and the values.
+    for (FunctionDecl* column : columns) {
+      llvm::SmallVector<Expr*, 8> callArgs;
+      for (unsigned i = 0, e = FD->getNumParams() + 1; i < e; ++i)
+        callArgs.push_back(BuildDeclRef(params[i]));
+      addToCurrentBlock(BuildCallExprToFunction(column, callArgs));
+    }
+
+    // The sparsity pattern is known at compile time and is only stored if
+    // the arrays of indices are passed, e.g.
+    // if (rowIndices && columnIndices) {
+    //   rowIndices[0] = 0UL;
+    //   columnIndices[0] = 1UL;
+    //   ...
+    // }
+    unsigned sizeTypeBits = m_Context.getIntWidth(sizeType);
+    auto BuildSizeLiteral = [&](uint64_t value) -> Expr* {
+      return IntegerLiteral::Create(m_Context,
+                                    llvm::APInt(sizeTypeBits, value),
+                                    sizeType, noLoc);
+    };
+    ParmVarDecl* rowIndices = params[params.size() - 2];
+    ParmVarDecl* columnIndices = params.back();
+    if (!nonzeros.empty()) {
+      beginBlock();
+      for (unsigned i = 0, e = nonzeros.size(); i < e; ++i) {
+        auto storeIndex = [&](ParmVarDecl* indices, uint64_t value) {
+          Expr* entry = m_Sema
+                            .CreateBuiltinArraySubscriptExpr(
+                                BuildDeclRef(indices), noLoc,
+                                BuildSizeLiteral(i), noLoc)
+                            .get();
+          addToCurrentBlock(
+              BuildOp(BO_Assign, entry, BuildSizeLiteral(value)));
+        };
+        storeIndex(rowIndices, nonzeros[i].first);
+        storeIndex(columnIndices, nonzeros[i].second);
+      }
+      Stmt* storePattern = endBlock();
+      Expr* cond = BuildOp(BO_LAnd, BuildDeclRef(rowIndices),
+                           BuildDeclRef(columnIndices));
+      addToCurrentBlock(clad_compat::IfStmt_Create(m_Context, noLoc,
+                                                   /*IsConstexpr=*/false,
+                                                   /*Init=*/nullptr,
+                                                   /*Var=*/nullptr, cond,
+                                                   noLoc, noLoc, storePattern));
+    }
+    addToCurrentBlock(m_Sema
+                          .ActOnReturnStmt(noLoc,
+                                           BuildSizeLiteral(nonzeros.size()),
+                                           getCurrentScope())
+                          .get());
+    jacobianFD->setBody(endBlock());
+
+    endScope(); // Function body scope
+    m_Sema.PopFunctionScopeInfo();
+    m_Sema.PopDeclContext();
+    endScope(); // Function decl scope
+
+    return OverloadedDeclWithContext{result.first, result.second,
+                                     /*OverloadFunctionDecl=*/nullptr};
+  }
 } // end namespace clad
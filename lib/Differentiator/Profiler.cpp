@@ -0,0 +1,168 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#include "clad/Differentiator/Profiler.h"
+
+#include "clang/Basic/Version.h"
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#if CLANG_VERSION_MAJOR >= 9
+#include "llvm/Support/TimeProfiler.h"
+#endif
+
+#include <cassert>
+
+namespace clad {
+  static const char* const PhaseNames[] = {
+      "collection", "instantiation",          "visitor", "cloning",
+      "custom_derivative_lookup", "sema_building", "codegen"};
+  static const char* const TimeTraceNames[] = {
+      "CladCollection", "CladInstantiation",          "CladVisitor",
+      "CladCloning",    "CladCustomDerivativeLookup", "CladSemaBuilding",
+      "CladCodeGen"};
+  static_assert(sizeof(PhaseNames) / sizeof(PhaseNames[0]) ==
+                    static_cast<unsigned>(ProfilePhase::NumPhases),
+                "Missing phase name");
+
+  static double toSeconds(std::chrono::steady_clock::duration D) {
+    return std::chrono::duration<double>(D).count();
+  }
+
+  static void printString(llvm::raw_ostream& OS, llvm::StringRef S) {
+    OS << '"';
+    for (char C : S) {
+      if (C == '"' || C == '\\')
+        OS << '\\' << C;
+      else if (static_cast<unsigned char>(C) < 0x20)
+        OS << llvm::format("\\u%04x", C);
+      else
+        OS << C;
+    }
+    OS << '"';
+  }
+
+  static void printPhases(llvm::raw_ostream& OS, const double* PhaseTimes,
+                          llvm::StringRef Indent) {
+    OS << "{\n";
+    for (unsigned I = 0; I < static_cast<unsigned>(ProfilePhase::NumPhases);
+         ++I) {
+      OS << Indent << "  \"" << PhaseNames[I]
+         << "\": " << llvm::format("%.6f", PhaseTimes[I]);
+      if (I + 1 < static_cast<unsigned>(ProfilePhase::NumPhases))
+        OS << ',';
+      OS << '\n';
+    }
+    OS << Indent << '}';
+  }
+
+  Profiler::Profiler(bool WantReport) {
+#if CLANG_VERSION_MAJOR >= 9
+    m_TimeTrace = llvm::timeTraceProfilerEnabled();
+#endif
+    m_Enabled = WantReport || m_TimeTrace;
+  }
+
+  llvm::StringRef Profiler::getPhaseName(ProfilePhase Phase) {
+    return PhaseNames[static_cast<unsigned>(Phase)];
+  }
+
+  void Profiler::flush(Clock::time_point Now) {
+    if (m_PhaseStack.empty())
+      return;
+    ActivePhase& Top = m_PhaseStack.back();
+    double Elapsed = toSeconds(Now - Top.Start);
+    unsigned Index = static_cast<unsigned>(Top.Phase);
+    m_PhaseTimes[Index] += Elapsed;
+    if (!m_FunctionStack.empty())
+      m_Functions[m_FunctionStack.back()].PhaseTimes[Index] += Elapsed;
+    Top.Start = Now;
+  }
+
+  void Profiler::startPhase(ProfilePhase Phase) {
+    Clock::time_point Now = Clock::now();
+    flush(Now);
+    m_PhaseStack.push_back({Phase, Now});
+#if CLANG_VERSION_MAJOR >= 9
+    if (m_TimeTrace)
+      llvm::timeTraceProfilerBegin(
+          TimeTraceNames[static_cast<unsigned>(Phase)], "");
+#endif
+  }
+
+  void Profiler::stopPhase() {
+    assert(!m_PhaseStack.empty() && "No phase was started");
+#if CLANG_VERSION_MAJOR >= 9
+    if (m_TimeTrace)
+      llvm::timeTraceProfilerEnd();
+#endif
+    Clock::time_point Now = Clock::now();
+    flush(Now);
+    m_PhaseStack.pop_back();
+  }
+
+  void Profiler::startFunction(llvm::StringRef Function, std::size_t Memory) {
+    Clock::time_point Now = Clock::now();
+    flush(Now);
+    m_FunctionStack.push_back(m_Functions.size());
+    m_Functions.emplace_back();
+    FunctionRecord& Record = m_Functions.back();
+    Record.Function = Function.str();
+    Record.Memory = Memory;
+    Record.Start = Now;
+#if CLANG_VERSION_MAJOR >= 9
+    if (m_TimeTrace)
+      llvm::timeTraceProfilerBegin("CladDerivative", Function);
+#endif
+  }
+
+  void Profiler::stopFunction(llvm::StringRef Derivative, unsigned NumNodes,
+                              std::size_t Memory) {
+    assert(!m_FunctionStack.empty() && "No function was started");
+#if CLANG_VERSION_MAJOR >= 9
+    if (m_TimeTrace)
+      llvm::timeTraceProfilerEnd();
+#endif
+    Clock::time_point Now = Clock::now();
+    flush(Now);
+    FunctionRecord& Record = m_Functions[m_FunctionStack.back()];
+    m_FunctionStack.pop_back();
+    Record.Derivative = Derivative.str();
+    Record.TotalTime = toSeconds(Now - Record.Start);
+    Record.NumNodes = NumNodes;
+    Record.Memory = Memory - Record.Memory;
+  }
+
+  void Profiler::addClonedNodes(unsigned NumCloned, unsigned NumShared) {
+    if (m_FunctionStack.empty())
+      return;
+    FunctionRecord& Record = m_Functions[m_FunctionStack.back()];
+    Record.NumClonedNodes += NumCloned;
+    Record.NumSharedNodes += NumShared;
+  }
+
+  void Profiler::printJSON(llvm::raw_ostream& OS) const {
+    OS << "{\n  \"phases\": ";
+    printPhases(OS, m_PhaseTimes, "  ");
+    OS << ",\n  \"functions\": [";
+    for (std::size_t I = 0, E = m_Functions.size(); I < E; ++I) {
+      const FunctionRecord& Record = m_Functions[I];
+      OS << (I ? ",\n" : "\n") << "    {\n      \"function\": ";
+      printString(OS, Record.Function);
+      OS << ",\n      \"derivative\": ";
+      printString(OS, Record.Derivative);
+      OS << ",\n      \"time\": " << llvm::format("%.6f", Record.TotalTime)
+         << ",\n      \"nodes\": " << Record.NumNodes
+         << ",\n      \"cloned_nodes\": " << Record.NumClonedNodes
+         << ",\n      \"shared_nodes\": " << Record.NumSharedNodes
+         << ",\n      \"memory\": " << Record.Memory
+         << ",\n      \"phases\": ";
+      printPhases(OS, Record.PhaseTimes, "      ");
+      OS << "\n    }";
+    }
+    OS << (m_Functions.empty() ? "]\n}\n" : "\n  ]\n}\n");
+  }
+} // namespace clad
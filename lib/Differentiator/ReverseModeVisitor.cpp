@@ -199,6 +199,7 @@ namespace clad {
     m_Function = FD;
     assert(m_Function && "Must not be null.");
     m_ErrorEstimationEnabled = request.Mode == DiffMode::error_estimation;
+    m_GenericFP = HasOption(request.BitMaskedOpts, opts::generic_fp);
 
     DiffParams args{};
     if (request.Args)
@@ -213,8 +214,12 @@ namespace clad {
     clang::QualType DerivedOutputParamType;
     if (request.Mode == DiffMode::jacobian) {
       isVectorValued = true;
+      m_NumOutputs = request.JacobianNumRows;
       unsigned lastArgN = m_Function->getNumParams() - 1;
-      outputArrayStr = m_Function->getParamDecl(lastArgN)->getNameAsString();
+      // When the reverse sweep is replayed, the output is handled as any other
+      // array.
+      if (!m_NumOutputs)
+        outputArrayStr = m_Function->getParamDecl(lastArgN)->getNameAsString();
       DerivedOutputParamType = m_Function->getParamDecl(lastArgN)->getType();
     } else {
       DerivedOutputParamType =
@@ -400,7 +405,20 @@ namespace clad {
     gradientFD->setParams(paramsRef);
     gradientFD->setBody(nullptr);
 
-    if (isVectorValued) {
+    if (m_NumOutputs) {
+      // The body is differentiated as for a gradient w.r.t. the independent
+      // args and the output, and the reverse sweep is run once per output:
+      //   for (unsigned long _row = 0; _row < M; ++_row) {
+      //     double _d_output[M] = {};
+      //     _d_output[_row] = 1;
+      //     <reverse sweep>
+      //   }
+      // where the adjoint of the i-th independent arg is
+      // jacobianMatrix[_row * N + i].
+      m_Result = BuildDeclRef(params.back());
+      numParams = args.size();
+      isVectorValued = false;
+    } else if (isVectorValued) {
       // Reference to the output parameter.
       m_Result = BuildDeclRef(params.back());
       numParams = args.size();
@@ -438,6 +456,52 @@ namespace clad {
     beginScope(Scope::FnScope | Scope::DeclScope);
     m_DerivativeFnScope = getCurrentScope();
     beginBlock();
+    VarDecl* rowVD = nullptr;
+    VarDecl* dOutputVD = nullptr;
+    if (m_NumOutputs) {
+      auto size_type = m_Context.getSizeType();
+      unsigned size_type_bits = m_Context.getIntWidth(size_type);
+      rowVD = BuildVarDecl(size_type, "_row",
+                           ConstantFolder::synthesizeLiteral(size_type,
+                                                             m_Context, 0));
+      Expr* row = BuildDeclRef(rowVD);
+      auto numParamsLiteral =
+          IntegerLiteral::Create(m_Context,
+                                 llvm::APInt(size_type_bits, numParams),
+                                 size_type, noLoc);
+      size_t idx = 0;
+      for (auto arg : args) {
+        // FIXME: array/pointer inputs are not treated as independent
+        // variables, as in the non-replayed jacobian.
+        if (!isArrayOrPointerType(arg->getType())) {
+          // Create the jacobianMatrix[_row * N + idx] expression.
+          auto i = IntegerLiteral::Create(m_Context,
+                                          llvm::APInt(size_type_bits, idx),
+                                          size_type, noLoc);
+          Expr* entry =
+              BuildOp(BO_Add, BuildOp(BO_Mul, row, numParamsLiteral), i);
+          m_Variables[arg] =
+              m_Sema.CreateBuiltinArraySubscriptExpr(m_Result, noLoc, entry,
+                                                     noLoc)
+                  .get();
+          m_IndependentVars.push_back(arg);
+        }
+        idx += 1;
+      }
+      // The adjoint of the output, _d_output[M] = {}.
+      const ParmVarDecl* output = nonDiffParams.back();
+      QualType outputElemType =
+          QualType(output->getType()->getPointeeOrArrayElementType(),
+                   /*Quals=*/0);
+      QualType dOutputType = clad_compat::getConstantArrayType(
+          m_Context, outputElemType,
+          llvm::APInt(size_type_bits, m_NumOutputs),
+          /*SizeExpr=*/nullptr, ArrayType::ArraySizeModifier::Normal,
+          /*IndexTypeQuals=*/0);
+      dOutputVD = BuildVarDecl(dOutputType, "_d_" + output->getNameAsString(),
+                               getZeroInit(dOutputType));
+      m_Variables[output] = BuildDeclRef(dOutputVD);
+    }
     // create derived variables for parameters which are not part of
     // independent variables (args).
     for (ParmVarDecl* param : nonDiffParams) {
@@ -456,7 +520,7 @@ namespace clad {
           BuildVarDecl(VDDerivedType, "_d_" + param->getNameAsString(),
                        getZeroInit(VDDerivedType));
       m_Variables[param] = BuildDeclRef(VDDerived);
-      addToBlock(BuildDeclStmt(VDDerived), m_Globals);
+      AddAdjointDecl(BuildDeclStmt(VDDerived));
     }
     // Start the visitation process which outputs the statements in the current
     // block.
@@ -474,7 +538,39 @@ namespace clad {
     else
       addToCurrentBlock(Forward, forward);
     // Reverse pass.
-    if (auto RCS = dyn_cast<CompoundStmt>(Reverse))
+    if (m_NumOutputs) {
+      // Replay the reverse sweep for every output over the stored
+      // intermediates of the single forward sweep.
+      beginBlock();
+      addToCurrentBlock(BuildDeclStmt(dOutputVD));
+      for (Stmt* S : m_SweepAdjoints)
+        addToCurrentBlock(S);
+      auto one = ConstantFolder::synthesizeLiteral(m_Context.IntTy, m_Context,
+                                                   1);
+      Expr* dOutputAtRow = m_Sema
+                               .CreateBuiltinArraySubscriptExpr(
+                                   BuildDeclRef(dOutputVD), noLoc,
+                                   BuildDeclRef(rowVD), noLoc)
+                               .get();
+      addToCurrentBlock(BuildOp(BO_Assign, dOutputAtRow, one));
+      if (auto RCS = dyn_cast<CompoundStmt>(Reverse))
+        for (Stmt* S : RCS->body())
+          addToCurrentBlock(S);
+      else
+        addToCurrentBlock(Reverse);
+      Stmt* SweepBody = endBlock();
+      auto size_type = m_Context.getSizeType();
+      auto numOutputsLiteral = IntegerLiteral::Create(
+          m_Context,
+          llvm::APInt(m_Context.getIntWidth(size_type), m_NumOutputs),
+          size_type, noLoc);
+      Stmt* Sweeps = new (m_Context)
+          ForStmt(m_Context, BuildDeclStmt(rowVD),
+                  BuildOp(BO_LT, BuildDeclRef(rowVD), numOutputsLiteral),
+                  /*condVar=*/nullptr, BuildOp(UO_PreInc, BuildDeclRef(rowVD)),
+                  SweepBody, noLoc, noLoc, noLoc);
+      addToCurrentBlock(Sweeps, forward);
+    } else if (auto RCS = dyn_cast<CompoundStmt>(Reverse))
       for (Stmt* S : RCS->body())
         addToCurrentBlock(S, forward);
     else
@@ -616,7 +712,7 @@ namespace clad {
       VarDeclDiff condVarDeclDiff = DifferentiateVarDecl(condVarDecl);
       condVarClone = condVarDeclDiff.getDecl();
       if (condVarDeclDiff.getDecl_dx())
-        addToBlock(BuildDeclStmt(condVarDeclDiff.getDecl_dx()), m_Globals);
+        AddAdjointDecl(BuildDeclStmt(condVarDeclDiff.getDecl_dx()));
     }
 
     // Condition is just cloned as it is, not derived.
@@ -1112,7 +1208,28 @@ namespace clad {
         }
         // Create the (_d_param[idx] += dfdx) statement.
         if (dfdx()) {
-          Expr* add_assign = BuildOp(BO_AddAssign, it->second, dfdx());
+          Expr* dVar = it->second;
+          // A local array passed to a function, e.g. `addArr(v, 3)`, gets its
+          // adjoint as a clad::array_ref, view `_d_v` as one to add it.
+          const ConstantArrayType* CAT =
+              m_Context.getAsConstantArrayType(dVar->getType());
+          if (CAT && !CAT->getElementType()->isArrayType() &&
+              isArrayRefType(dfdx()->getType())) {
+            llvm::SmallVector<Expr*, 2> refArgs{
+                dVar, ConstantFolder::synthesizeLiteral(
+                          m_Context.getSizeType(), m_Context,
+                          CAT->getSize().getZExtValue())};
+            Expr* init =
+                m_Sema.ActOnParenListExpr(noLoc, noLoc, refArgs).get();
+            VarDecl* ref = BuildVarDecl(
+                GetCladArrayRefOfType(CAT->getElementType()),
+                "_d_" + decl->getName().str() + "_ref", init,
+                /*DirectInit=*/true, /*TSI=*/nullptr,
+                VarDecl::InitializationStyle::CallInit);
+            addToCurrentBlock(BuildDeclStmt(ref), reverse);
+            dVar = BuildDeclRef(ref);
+          }
+          Expr* add_assign = BuildOp(BO_AddAssign, dVar, dfdx());
           // Add it to the body statements.
           addToCurrentBlock(add_assign, reverse);
         }
@@ -1289,25 +1406,27 @@ namespace clad {
           ResultII = CreateUniqueIdentifier(funcPostfix());
           if (arg && (isArrayRefType(arg->getType()) ||
                       isArrayOrPointerType(arg->getType()))) {
-            Expr* SizeE;
             if (auto CAT = dyn_cast<ConstantArrayType>(arg->getType())) {
-              SizeE = ConstantFolder::synthesizeLiteral(m_Context.getSizeType(),
-                                                        m_Context,
-                                                        CAT->getSize()
-                                                            .getZExtValue());
+              // The size is known, store the elements inline.
+              // Declare: clad::array<ArrayDiffArgType, arrLen> _gradX = {};
+              QualType FixedArrayType = GetCladArrayOfType(
+                  CEType.getCanonicalType(), CAT->getSize().getZExtValue());
+              Expr* ZeroInitBraces =
+                  m_Sema.ActOnInitList(noLoc, {}, noLoc).get();
+              ResultDecl =
+                  BuildVarDecl(FixedArrayType, ResultII, ZeroInitBraces);
             } else {
               assert(isArrayRefType(arg->getType()) &&
                      "Size couldn't be determined. Please make sure the diff "
                      "variables are either constant sized arrays or of type "
                      "clad::array_ref");
-              SizeE = BuildArrayRefSizeExpr(arg);
+              Expr* SizeE = BuildArrayRefSizeExpr(arg);
+              // Declare: clad::array<ArrayDiffArgType> _gradX(arrLen);
+              ResultDecl = BuildVarDecl(ArrayDiffArgType, ResultII, SizeE,
+                                        /*DirectInit=*/false,
+                                        /*TSI=*/nullptr,
+                                        VarDecl::InitializationStyle::CallInit);
             }
-
-            // Declare: clad::array_ref<ArrayDiffArgType> _gradX(arrLen);
-            ResultDecl = BuildVarDecl(ArrayDiffArgType, ResultII, SizeE,
-                                      /*DirectInit=*/false,
-                                      /*TSI=*/nullptr,
-                                      VarDecl::InitializationStyle::CallInit);
             Result = BuildDeclRef(ResultDecl);
             ResultExpr = Result;
             Expr* E = BuildOp(BO_MulAssign, Result, dfdx());
@@ -1364,6 +1483,8 @@ namespace clad {
         request.Function = FD;
         request.BaseFunctionName = FD->getNameAsString();
         request.Mode = DiffMode::reverse;
+        if (m_GenericFP)
+          request.BitMaskedOpts = opts::generic_fp;
         // Silence diag outputs in nested derivation process.
         request.VerboseDiags = false;
 
@@ -2005,7 +2126,7 @@ namespace clad {
 
     Stmt* DSClone = BuildDeclStmt(decls);
     Stmt* DSDiff = BuildDeclStmt(declsDiff);
-    addToBlock(DSDiff, m_Globals);
+    AddAdjointDecl(DSDiff);
     return StmtDiff(DSClone);
   }
 
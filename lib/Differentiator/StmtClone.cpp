@@ -55,6 +55,12 @@ Stmt* StmtClone::Visit ## CLASS(CLASS *Node)            \
   return result;                                        \
 }
 
+#define DEFINE_SHARE_EXPR(CLASS)                        \
+Stmt* StmtClone::Visit ## CLASS(CLASS *Node)            \
+{                                                       \
+  return Node;                                          \
+}
+
 #define DEFINE_CLONE_EXPR_CO11(CLASS, CTORARGS)         \
 Stmt* StmtClone::Visit ## CLASS(CLASS *Node)            \
 {                                                       \
@@ -70,9 +76,9 @@ Stmt* StmtClone::VisitDeclRefExpr(DeclRefExpr *Node) {
   Node->copyTemplateArgumentsInto(TAListInfo);
   return DeclRefExpr::Create(Ctx, Node->getQualifierLoc(), Node->getTemplateKeywordLoc(), Node->getDecl(), Node->refersToEnclosingVariableOrCapture(), Node->getNameInfo(), Node->getType(), Node->getValueKind(), Node->getFoundDecl(), &TAListInfo);
 }
-DEFINE_CREATE_EXPR(IntegerLiteral, (Ctx, Node->getValue(), Node->getType(), Node->getLocation()))
+DEFINE_SHARE_EXPR(IntegerLiteral)
 DEFINE_CLONE_EXPR_CO(PredefinedExpr, (CLAD_COMPAT_CLANG8_Ctx_ExtraParams Node->getLocation(), Node->getType(), Node->getIdentKind(), Node->getFunctionName()))
-DEFINE_CLONE_EXPR(CharacterLiteral, (Node->getValue(), Node->getKind(), Node->getType(), Node->getLocation()))
+DEFINE_SHARE_EXPR(CharacterLiteral)
 DEFINE_CLONE_EXPR(ImaginaryLiteral, (Clone(Node->getSubExpr()), Node->getType()))
 DEFINE_CLONE_EXPR(ParenExpr, (Node->getLParen(), Node->getRParen(), Clone(Node->getSubExpr())))
 DEFINE_CLONE_EXPR(ArraySubscriptExpr, (Clone(Node->getLHS()), Clone(Node->getRHS()), Node->getType(), Node->getValueKind(), Node->getObjectKind(), Node->getRBracketLoc()))
@@ -124,33 +130,19 @@ DEFINE_CLONE_EXPR(ConditionalOperator, (Clone(Node->getCond()), Node->getQuestio
 DEFINE_CLONE_EXPR(AddrLabelExpr, (Node->getAmpAmpLoc(), Node->getLabelLoc(), Node->getLabel(), Node->getType()))
 DEFINE_CLONE_EXPR(StmtExpr, (Clone(Node->getSubStmt()), Node->getType(), Node->getLParenLoc(), Node->getRParenLoc() CLAD_COMPAT_CLANG10_StmtExpr_Create_ExtraParams ))
 DEFINE_CLONE_EXPR(ChooseExpr, (Node->getBuiltinLoc(), Clone(Node->getCond()), Clone(Node->getLHS()), Clone(Node->getRHS()), Node->getType(), Node->getValueKind(), Node->getObjectKind(), Node->getRParenLoc(), Node->isConditionTrue() CLAD_COMPAT_CLANG11_ChooseExpr_EtraParams_Removed))
-DEFINE_CLONE_EXPR(GNUNullExpr, (Node->getType(), Node->getTokenLocation()))
+DEFINE_SHARE_EXPR(GNUNullExpr)
 DEFINE_CLONE_EXPR(VAArgExpr, (Node->getBuiltinLoc(), Clone(Node->getSubExpr()), Node->getWrittenTypeInfo(), Node->getRParenLoc(), Node->getType(), Node->isMicrosoftABI()))
 DEFINE_CLONE_EXPR(ImplicitValueInitExpr, (Node->getType()))
 DEFINE_CLONE_EXPR(ExtVectorElementExpr, (Node->getType(), Node->getValueKind(), Clone(Node->getBase()), Node->getAccessor(), Node->getAccessorLoc()))
-DEFINE_CLONE_EXPR(CXXBoolLiteralExpr, (Node->getValue(), Node->getType(), Node->getSourceRange().getBegin()))
-DEFINE_CLONE_EXPR(CXXNullPtrLiteralExpr, (Node->getType(), Node->getSourceRange().getBegin()))
+DEFINE_SHARE_EXPR(CXXBoolLiteralExpr)
+DEFINE_SHARE_EXPR(CXXNullPtrLiteralExpr)
 DEFINE_CLONE_EXPR(CXXThisExpr, (Node->getSourceRange().getBegin(), Node->getType(), Node->isImplicit()))
 DEFINE_CLONE_EXPR(CXXThrowExpr, (Clone(Node->getSubExpr()), Node->getType(), Node->getThrowLoc(), Node->isThrownVariableInScope()))
 //BlockExpr
 //BlockDeclRefExpr
 
-Stmt* StmtClone::VisitStringLiteral(StringLiteral* Node) {
-  llvm::SmallVector<SourceLocation, 4> concatLocations(Node->tokloc_begin(),
-                                                       Node->tokloc_end());
-  return StringLiteral::Create(Ctx, Node->getString(), Node->getKind(),
-                               Node->isPascal(), Node->getType(),
-                               &concatLocations[0], concatLocations.size());
-}
-
-Stmt* StmtClone::VisitFloatingLiteral(FloatingLiteral* Node) {
-  FloatingLiteral* clone = FloatingLiteral::Create(Ctx, Node->getValue(),
-                                                   Node->isExact(),
-                                                   Node->getType(),
-                                                   Node->getLocation());
-  clone->setSemantics(Node->getSemantics());
-  return clone;
-}
+DEFINE_SHARE_EXPR(StringLiteral)
+DEFINE_SHARE_EXPR(FloatingLiteral)
 
 Stmt* StmtClone::VisitInitListExpr(InitListExpr* Node) {
   llvm::SmallVector<Expr*, 8> initExprs(Node->getNumInits());
@@ -0,0 +1,928 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#include "clad/Differentiator/TaylorModeVisitor.h"
+
+#include "ConstantFolder.h"
+
+#include "clad/Differentiator/DiffPlanner.h"
+#include "clad/Differentiator/StmtClone.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/TemplateBase.h"
+#include "clang/Sema/Lookup.h"
+#include "clang/Sema/Overload.h"
+#include "clang/Sema/Scope.h"
+#include "clang/Sema/Sema.h"
+#include "clang/Sema/SemaInternal.h"
+
+#include "llvm/Support/SaveAndRestore.h"
+
+#include <algorithm>
+
+#include "clad/Differentiator/Compatibility.h"
+
+using namespace clang;
+
+namespace clad {
+  /// Returns true if variables of type `T` carry a Taylor series. Integral
+  /// variables are treated as constants, their derivatives are always 0.
+  static bool isTaylorTracked(QualType T) { return T->isRealFloatingType(); }
+
+  TaylorModeVisitor::TaylorModeVisitor(DerivativeBuilder& builder)
+      : VisitorBase(builder) {}
+
+  TaylorModeVisitor::~TaylorModeVisitor() {}
+
+  OverloadedDeclWithContext
+  TaylorModeVisitor::Derive(const FunctionDecl* FD,
+                            const DiffRequest& request) {
+    silenceDiags = !request.VerboseDiags;
+    m_Function = FD;
+    m_Functor = request.Functor;
+    assert(!m_DerivativeInFlight &&
+           "Doesn't support recursive diff. Use DiffPlan.");
+    m_DerivativeInFlight = true;
+
+    DiffParams args{};
+    if (request.Args)
+      args = parseDiffArgs(request.Args, FD).first;
+    else
+      std::copy(FD->param_begin(), FD->param_end(), std::back_inserter(args));
+    if (args.empty())
+      return {};
+    if (args.size() > 1) {
+      diag(DiagnosticsEngine::Error,
+           request.Args ? request.Args->getEndLoc() : noLoc,
+           "Taylor mode computes the derivatives w.r.t. a single parameter, "
+           "call 'clad::differentiate' for each parameter separately");
+      return {};
+    }
+    m_IndependentVar = args.back();
+    if (!isa<ParmVarDecl>(m_IndependentVar) ||
+        !isTaylorTracked(m_IndependentVar->getType())) {
+      diag(DiagnosticsEngine::Error,
+           m_IndependentVar->getEndLoc(),
+           "Taylor mode differentiation w.r.t. '%0' is not supported, only "
+           "floating point parameters can be used as independent variables",
+           {m_IndependentVar->getNameAsString()});
+      return {};
+    }
+    QualType returnType = FD->getReturnType();
+    if (!isTaylorTracked(returnType)) {
+      diag(DiagnosticsEngine::Error,
+           FD->getEndLoc(),
+           "Taylor mode differentiation of function '%0' is not supported, "
+           "its return type must be a floating point type",
+           {FD->getNameAsString()});
+      return {};
+    }
+    m_Order = request.RequestedDerivativeOrder;
+    m_TaylorType = GetCladTaylorOfType(returnType, m_Order);
+    if (m_TaylorType.isNull())
+      return {};
+
+    unsigned argIndex =
+        std::distance(FD->param_begin(),
+                      std::find(FD->param_begin(), FD->param_end(),
+                                m_IndependentVar));
+    IdentifierInfo* II = &m_Context.Idents.get(
+        request.BaseFunctionName + "_taylor" + std::to_string(m_Order) +
+        "arg" + std::to_string(argIndex));
+    return BuildDerivative(II, "derivatives");
+  }
+
+  OverloadedDeclWithContext TaylorModeVisitor::DeriveHessian(
+      const FunctionDecl* FD, const DiffRequest& request,
+      llvm::ArrayRef<std::pair<const ParmVarDecl*, IndexInterval>>
+          independentArgs,
+      const std::string& hessianFuncName) {
+    silenceDiags = !request.VerboseDiags;
+    m_Function = FD;
+    m_Functor = request.Functor;
+    assert(!m_DerivativeInFlight &&
+           "Doesn't support recursive diff. Use DiffPlan.");
+    m_DerivativeInFlight = true;
+
+    unsigned numIndependentVars = 0;
+    for (auto& independentArg : independentArgs) {
+      const ParmVarDecl* PVD = independentArg.first;
+      QualType T = PVD->getType();
+      if (isArrayOrPointerType(T))
+        T = QualType(T->getPointeeOrArrayElementType(), /*Quals=*/0);
+      if (!isTaylorTracked(T)) {
+        diag(DiagnosticsEngine::Error,
+             PVD->getEndLoc(),
+             "Hessian propagation w.r.t. '%0' is not supported, only floating "
+             "point parameters or arrays can be used as independent variables",
+             {PVD->getNameAsString()});
+        return {};
+      }
+      IndexInterval interval = independentArg.second;
+      numIndependentVars += isArrayOrPointerType(PVD->getType())
+                                ? interval.size()
+                                : 1;
+    }
+    if (!numIndependentVars)
+      return {};
+    QualType returnType = FD->getReturnType();
+    if (!isTaylorTracked(returnType)) {
+      diag(DiagnosticsEngine::Error,
+           FD->getEndLoc(),
+           "Hessian propagation of function '%0' is not supported, its return "
+           "type must be a floating point type",
+           {FD->getNameAsString()});
+      return {};
+    }
+    // The full series costs O(n^2) per operation and is held by every local.
+    if (request.Mode != DiffMode::hessian_diagonal &&
+        numIndependentVars > HessianSeriesMaxVariables) {
+      diag(DiagnosticsEngine::Error, FD->getLocation(),
+           "the fused Hessian of '%0' has %1 independent variables, at most "
+           "%2 are supported; use the default mode instead",
+           {FD->getNameAsString(), std::to_string(numIndependentVars),
+            std::to_string(HessianSeriesMaxVariables)});
+      return {};
+    }
+    m_HessianArgs.assign(independentArgs.begin(), independentArgs.end());
+    m_PackedHessian = HasOption(request.BitMaskedOpts, opts::hessian_packed);
+    // Only the pure second derivatives are propagated for the diagonal.
+    if (request.Mode == DiffMode::hessian_diagonal)
+      m_TaylorType =
+          GetCladHessianDiagonalSeriesOfType(returnType, numIndependentVars);
+    else
+      m_TaylorType = GetCladHessianSeriesOfType(returnType, numIndependentVars);
+    if (m_TaylorType.isNull())
+      return {};
+    return BuildDerivative(&m_Context.Idents.get(hessianFuncName),
+                           request.Mode == DiffMode::hessian_diagonal
+                               ? "hessianDiagonal"
+                               : "hessianMatrix");
+  }
+
+  OverloadedDeclWithContext
+  TaylorModeVisitor::BuildDerivative(IdentifierInfo* II,
+                                     llvm::StringRef outputName) {
+    const FunctionDecl* FD = m_Function;
+    QualType returnType = FD->getReturnType();
+    SourceLocation loc{m_Function->getLocation()};
+    DeclarationNameInfo name(II, loc);
+
+    // The derivative has the signature of the original function with an
+    // additional output parameter receiving the derivatives,
+    // i.e. `void f_taylorNargK(Args..., clad::array_ref<R> derivatives)`.
+    llvm::SmallVector<QualType, 16> paramTypes;
+    for (const ParmVarDecl* PVD : FD->parameters())
+      paramTypes.push_back(PVD->getType());
+    paramTypes.push_back(GetCladArrayRefOfType(returnType));
+    auto originalFnProtoType = cast<FunctionProtoType>(FD->getType());
+    QualType derivativeType =
+        m_Context.getFunctionType(m_Context.VoidTy, paramTypes,
+                                  originalFnProtoType->getExtProtoInfo());
+
+    llvm::SaveAndRestore<DeclContext*> SaveContext(m_Sema.CurContext);
+    llvm::SaveAndRestore<Scope*> SaveScope(m_CurScope);
+    DeclContext* DC = const_cast<DeclContext*>(m_Function->getDeclContext());
+    m_Sema.CurContext = DC;
+    DeclWithContext result =
+        m_Builder.cloneFunction(FD, *this, DC, m_Sema, m_Context, loc, name,
+                                derivativeType);
+    FunctionDecl* derivedFD = result.first;
+    m_Derivative = derivedFD;
+
+    // Function declaration scope
+    beginScope(Scope::FunctionPrototypeScope | Scope::FunctionDeclarationScope |
+               Scope::DeclScope);
+    m_Sema.PushFunctionScope();
+    m_Sema.PushDeclContext(getCurrentScope(), m_Derivative);
+
+    llvm::SmallVector<ParmVarDecl*, 4> params;
+    for (const ParmVarDecl* PVD : FD->parameters()) {
+      Expr* clonedPVDDefaultArg = nullptr;
+      if (PVD->hasDefaultArg())
+        clonedPVDDefaultArg = Clone(PVD->getDefaultArg());
+      ParmVarDecl* newPVD = ParmVarDecl::Create(m_Context,
+                                                m_Sema.CurContext,
+                                                noLoc,
+                                                noLoc,
+                                                PVD->getIdentifier(),
+                                                PVD->getType(),
+                                                PVD->getTypeSourceInfo(),
+                                                PVD->getStorageClass(),
+                                                clonedPVDDefaultArg);
+      if (PVD == m_IndependentVar)
+        m_IndependentVar = newPVD;
+      params.push_back(newPVD);
+      if (newPVD->getIdentifier())
+        m_Sema.PushOnScopeChains(newPVD,
+                                 getCurrentScope(),
+                                 /*AddToContext*/ false);
+    }
+    m_Output = ParmVarDecl::Create(
+        m_Context,
+        m_Sema.CurContext,
+        noLoc,
+        noLoc,
+        &m_Context.Idents.get(outputName),
+        paramTypes.back(),
+        m_Context.getTrivialTypeSourceInfo(paramTypes.back(), noLoc),
+        SC_None,
+        /*DefArg=*/nullptr);
+    params.push_back(m_Output);
+    m_Sema.PushOnScopeChains(m_Output,
+                             getCurrentScope(),
+                             /*AddToContext*/ false);
+    derivedFD->setParams(llvm::makeArrayRef(params.data(), params.size()));
+    derivedFD->setBody(nullptr);
+
+    // Function body scope
+    beginScope(Scope::FnScope | Scope::DeclScope);
+    m_DerivativeFnScope = getCurrentScope();
+    beginBlock();
+    // For each floating point parameter, create the variable holding its
+    // Taylor series, e.g.:
+    // void f_taylor2arg0(double x, double y, clad::array_ref<double> ...) {
+    //   clad::taylor<double, 2> _d_x = x;
+    //   _d_x.make_independent();
+    //   clad::taylor<double, 2> _d_y = y;
+    //   ...
+    // The series of the independent variables of a Hessian are seeded with
+    // their index in the Hessian, e.g. for "x, p[1:2]":
+    //   clad::hessian_series<double, 3> _d_x = x;
+    //   _d_x.make_independent(0);
+    //   clad::hessian_series<double, 3> _d_p[2] = {};
+    //   for (unsigned long _k = 0; _k < 2UL; ++_k) {
+    //     _d_p[_k] = p[_k + 1UL];
+    //     _d_p[_k].make_independent(_k + 1UL);
+    //   }
+    size_t hessianIndex = 0;
+    for (unsigned i = 0, e = FD->getNumParams(); i < e; ++i) {
+      const ParmVarDecl* PVD = FD->getParamDecl(i);
+      ParmVarDecl* param = params[i];
+      auto hessianArg =
+          std::find_if(m_HessianArgs.begin(), m_HessianArgs.end(),
+                       [PVD](const std::pair<const ParmVarDecl*,
+                                             IndexInterval>& arg) {
+                         return arg.first == PVD;
+                       });
+      bool isHessianArg = hessianArg != m_HessianArgs.end();
+      if (isHessianArg && isArrayOrPointerType(param->getType())) {
+        IndexInterval interval = hessianArg->second;
+        auto size_type = m_Context.getSizeType();
+        unsigned size_type_bits = m_Context.getIntWidth(size_type);
+        auto sizeLiteral = [&](size_t n) {
+          return IntegerLiteral::Create(m_Context,
+                                        llvm::APInt(size_type_bits, n),
+                                        size_type, noLoc);
+        };
+        QualType seriesArrayType = clad_compat::getConstantArrayType(
+            m_Context, m_TaylorType,
+            llvm::APInt(size_type_bits, interval.size()),
+            /*SizeExpr=*/nullptr, ArrayType::ArraySizeModifier::Normal,
+            /*IndexTypeQuals=*/0);
+        VarDecl* seriesDecl = BuildVarDecl(seriesArrayType,
+                                           "_d_" + param->getNameAsString(),
+                                           getZeroInit(seriesArrayType));
+        addToCurrentBlock(BuildDeclStmt(seriesDecl));
+        m_ArraySeries[param] = {seriesDecl, interval};
+
+        beginScope(Scope::DeclScope | Scope::ControlScope |
+                   Scope::BreakScope | Scope::ContinueScope);
+        VarDecl* kVD = BuildVarDecl(size_type, "_k", sizeLiteral(0));
+        beginBlock();
+        Expr* element = m_Sema
+                            .CreateBuiltinArraySubscriptExpr(
+                                BuildDeclRef(seriesDecl), noLoc,
+                                BuildDeclRef(kVD), noLoc)
+                            .get();
+        Expr* paramElement =
+            m_Sema
+                .CreateBuiltinArraySubscriptExpr(
+                    BuildDeclRef(param), noLoc,
+                    BuildOp(BO_Add, BuildDeclRef(kVD),
+                            sizeLiteral(interval.Start)),
+                    noLoc)
+                .get();
+        addToCurrentBlock(BuildOp(BO_Assign, element, paramElement));
+        element = m_Sema
+                      .CreateBuiltinArraySubscriptExpr(BuildDeclRef(seriesDecl),
+                                                       noLoc,
+                                                       BuildDeclRef(kVD), noLoc)
+                      .get();
+        Expr* index = BuildOp(BO_Add, BuildDeclRef(kVD),
+                              sizeLiteral(hessianIndex));
+        addToCurrentBlock(BuildCallExprToMemFn(element, /*isArrow=*/false,
+                                               "make_independent", index));
+        Stmt* seedBody = endBlock();
+        Stmt* seedLoop = new (m_Context)
+            ForStmt(m_Context, BuildDeclStmt(kVD),
+                    BuildOp(BO_LT, BuildDeclRef(kVD),
+                            sizeLiteral(interval.size())),
+                    /*condVar=*/nullptr, BuildOp(UO_PreInc, BuildDeclRef(kVD)),
+                    seedBody, noLoc, noLoc, noLoc);
+        endScope();
+        addToCurrentBlock(seedLoop);
+        hessianIndex += interval.size();
+        continue;
+      }
+      if (!isTaylorTracked(param->getType()))
+        continue;
+      VarDecl* seriesDecl = BuildVarDecl(m_TaylorType,
+                                         "_d_" + param->getNameAsString(),
+                                         BuildDeclRef(param));
+      addToCurrentBlock(BuildDeclStmt(seriesDecl));
+      Expr* series = BuildDeclRef(seriesDecl);
+      if (param == m_IndependentVar)
+        addToCurrentBlock(BuildCallExprToMemFn(series, /*isArrow=*/false,
+                                               "make_independent", {}));
+      if (isHessianArg) {
+        Expr* index = ConstantFolder::synthesizeLiteral(m_Context.UnsignedIntTy,
+                                                        m_Context,
+                                                        hessianIndex++);
+        addToCurrentBlock(BuildCallExprToMemFn(series, /*isArrow=*/false,
+                                               "make_independent", index));
+      }
+      m_Variables[param] = series;
+    }
+
+    Stmt* BodyDiff = Visit(FD->getBody()).getStmt();
+    if (auto CS = dyn_cast<CompoundStmt>(BodyDiff))
+      for (Stmt* S : CS->body())
+        addToCurrentBlock(S);
+    else
+      addToCurrentBlock(BodyDiff);
+    Stmt* derivativeBody = endBlock();
+    derivedFD->setBody(derivativeBody);
+
+    endScope(); // Function body scope
+    m_Sema.PopFunctionScopeInfo();
+    m_Sema.PopDeclContext();
+    endScope(); // Function decl scope
+
+    m_DerivativeInFlight = false;
+
+    if (m_Unsupported)
+      return {};
+    return OverloadedDeclWithContext{result.first, result.second,
+                                     /*OverloadFunctionDecl=*/nullptr};
+  }
+
+  Expr*
+  TaylorModeVisitor::BuildTaylorRuleCall(llvm::StringRef Name,
+                                         llvm::MutableArrayRef<Expr*> Args) {
+    NamespaceDecl* CladNS = GetCladNamespace();
+    CXXScopeSpec CSS;
+    CSS.Extend(m_Context, CladNS, noLoc, noLoc);
+    LookupResult R(m_Sema, &m_Context.Idents.get(Name), noLoc,
+                   Sema::LookupOrdinaryName);
+    m_Sema.LookupQualifiedName(R, CladNS, CSS);
+    if (R.empty())
+      return nullptr;
+    Expr* UnresolvedLookup =
+        m_Sema.BuildDeclarationNameExpr(CSS, R, /*ADL*/ false).get();
+    if (m_Builder.noOverloadExists(UnresolvedLookup, Args))
+      return nullptr;
+    return m_Sema
+        .ActOnCallExpr(getCurrentScope(), UnresolvedLookup, noLoc, Args, noLoc)
+        .get();
+  }
+
+  Stmt* TaylorModeVisitor::VisitBody(const Stmt* Body) {
+    if (!Body)
+      return nullptr;
+    if (isa<CompoundStmt>(Body))
+      return Visit(Body).getStmt();
+    beginScope(Scope::DeclScope);
+    beginBlock();
+    StmtDiff BodyDiff = Visit(Body);
+    for (Stmt* S : BodyDiff.getBothStmts())
+      addToCurrentBlock(S);
+    CompoundStmt* Block = endBlock();
+    endScope();
+    if (Block->size() == 1)
+      return Block->body_front();
+    return Block;
+  }
+
+  StmtDiff TaylorModeVisitor::VisitStmt(const Stmt* S) {
+    diag(DiagnosticsEngine::Warning,
+         S->getBeginLoc(),
+         "attempted to differentiate unsupported statement in Taylor mode, no "
+         "changes applied");
+    // Unknown stmt, just clone it.
+    return StmtDiff(Clone(S));
+  }
+
+  StmtDiff TaylorModeVisitor::VisitExpr(const Expr* E) {
+    // Literals, member and array accesses, etc. are treated as constants.
+    return StmtDiff(Clone(E));
+  }
+
+  StmtDiff TaylorModeVisitor::VisitNullStmt(const NullStmt* NS) {
+    return StmtDiff(Clone(NS));
+  }
+
+  StmtDiff TaylorModeVisitor::VisitBreakStmt(const BreakStmt* BS) {
+    return StmtDiff(Clone(BS));
+  }
+
+  StmtDiff TaylorModeVisitor::VisitContinueStmt(const ContinueStmt* CS) {
+    return StmtDiff(Clone(CS));
+  }
+
+  StmtDiff TaylorModeVisitor::VisitCompoundStmt(const CompoundStmt* CS) {
+    beginScope(Scope::DeclScope);
+    beginBlock();
+    for (Stmt* S : CS->body()) {
+      StmtDiff SDiff = Visit(S);
+      addToCurrentBlock(SDiff.getStmt_dx());
+      addToCurrentBlock(SDiff.getStmt());
+    }
+    CompoundStmt* Result = endBlock();
+    endScope();
+    return StmtDiff(Result);
+  }
+
+  StmtDiff TaylorModeVisitor::VisitIfStmt(const IfStmt* If) {
+    beginScope(Scope::DeclScope | Scope::ControlScope);
+    beginBlock();
+    const Stmt* init = If->getInit();
+    StmtDiff initResult = init ? Visit(init) : StmtDiff{};
+    addToCurrentBlock(initResult.getStmt_dx());
+
+    VarDecl* condVarClone = nullptr;
+    if (const VarDecl* condVarDecl = If->getConditionVariable()) {
+      VarDeclDiff condVarDeclDiff = DifferentiateVarDecl(condVarDecl);
+      condVarClone = condVarDeclDiff.getDecl();
+      if (condVarDeclDiff.getDecl_dx())
+        addToCurrentBlock(BuildDeclStmt(condVarDeclDiff.getDecl_dx()));
+    }
+    // Branching only depends on the primal values.
+    Expr* cond = Clone(If->getCond());
+
+    Stmt* thenDiff = VisitBody(If->getThen());
+    Stmt* elseDiff = VisitBody(If->getElse());
+
+    Stmt* ifDiff = clad_compat::IfStmt_Create(m_Context,
+                                              noLoc,
+                                              If->isConstexpr(),
+                                              initResult.getStmt(),
+                                              condVarClone,
+                                              cond,
+                                              noLoc,
+                                              noLoc,
+                                              thenDiff,
+                                              noLoc,
+                                              elseDiff);
+    addToCurrentBlock(ifDiff);
+    CompoundStmt* Block = endBlock();
+    endScope();
+    return (Block->size() == 1) ? StmtDiff(ifDiff) : StmtDiff(Block);
+  }
+
+  StmtDiff TaylorModeVisitor::VisitForStmt(const ForStmt* FS) {
+    beginScope(Scope::DeclScope | Scope::ControlScope | Scope::BreakScope |
+               Scope::ContinueScope);
+    beginBlock();
+    const Stmt* init = FS->getInit();
+    StmtDiff initDiff = init ? Visit(init) : StmtDiff{};
+    addToCurrentBlock(initDiff.getStmt_dx());
+    VarDecl* condVarClone = nullptr;
+    if (const VarDecl* condVar = FS->getConditionVariable()) {
+      // Re-initialized at each iteration, treated as a constant.
+      condVarClone =
+          BuildVarDecl(condVar->getType(), condVar->getNameAsString(),
+                       Clone(condVar->getInit()), condVar->isDirectInit());
+    }
+    Expr* cond = FS->getCond() ? Clone(FS->getCond()) : nullptr;
+
+    const Expr* inc = FS->getInc();
+    beginBlock();
+    StmtDiff incDiff = inc ? Visit(inc) : StmtDiff{};
+    CompoundStmt* decls = endBlock();
+    Expr* incResult = nullptr;
+    if (decls->size()) {
+      // The increment produced temporaries, wrap it in a lambda since only
+      // expressions are allowed in the increment part of the loop.
+      incResult = wrapInLambda(*this, m_Sema, inc, [&] {
+        StmtDiff incDiff = Visit(inc);
+        addToCurrentBlock(incDiff.getStmt_dx());
+        addToCurrentBlock(incDiff.getStmt());
+      });
+    } else if (incDiff.getExpr_dx() && !isUnusedResult(incDiff.getExpr_dx())) {
+      incResult = BuildOp(BO_Comma,
+                          BuildParens(incDiff.getExpr_dx()),
+                          BuildParens(incDiff.getExpr()));
+    } else {
+      incResult = incDiff.getExpr();
+    }
+
+    beginScope(Scope::DeclScope);
+    Stmt* bodyResult = VisitBody(FS->getBody());
+    endScope();
+
+    Stmt* forStmtDiff = new (m_Context) ForStmt(m_Context,
+                                                initDiff.getStmt(),
+                                                cond,
+                                                condVarClone,
+                                                incResult,
+                                                bodyResult,
+                                                noLoc,
+                                                noLoc,
+                                                noLoc);
+    addToCurrentBlock(forStmtDiff);
+    CompoundStmt* Block = endBlock();
+    endScope();
+    return (Block->size() == 1) ? StmtDiff(forStmtDiff) : StmtDiff(Block);
+  }
+
+  StmtDiff TaylorModeVisitor::VisitWhileStmt(const WhileStmt* WS) {
+    beginScope(Scope::ContinueScope | Scope::BreakScope | Scope::DeclScope |
+               Scope::ControlScope);
+    Sema::ConditionResult condRes;
+    if (const VarDecl* condVar = WS->getConditionVariable()) {
+      // The condition variable is re-initialized at each iteration and is
+      // treated as a constant, as are all values used for branching.
+      VarDecl* condVarClone =
+          BuildVarDecl(condVar->getType(), condVar->getNameAsString(),
+                       Clone(condVar->getInit()), condVar->isDirectInit());
+      condRes = m_Sema.ActOnConditionVariable(condVarClone, noLoc,
+                                              Sema::ConditionKind::Boolean);
+    } else {
+      condRes = m_Sema.ActOnCondition(getCurrentScope(), noLoc,
+                                      Clone(WS->getCond()),
+                                      Sema::ConditionKind::Boolean);
+    }
+    Stmt* bodyResult = VisitBody(WS->getBody());
+    Stmt* WSDiff =
+        clad_compat::Sema_ActOnWhileStmt(m_Sema, condRes, bodyResult).get();
+    endScope();
+    return StmtDiff(WSDiff);
+  }
+
+  StmtDiff TaylorModeVisitor::VisitDoStmt(const DoStmt* DS) {
+    beginScope(Scope::ContinueScope | Scope::BreakScope);
+    Expr* clonedCond = DS->getCond() ? Clone(DS->getCond()) : nullptr;
+    Stmt* bodyResult = VisitBody(DS->getBody());
+    Stmt* S = m_Sema
+                  .ActOnDoStmt(/*DoLoc=*/noLoc, bodyResult, /*WhileLoc=*/noLoc,
+                               /*CondLParen=*/noLoc, clonedCond,
+                               /*CondRParen=*/noLoc)
+                  .get();
+    endScope();
+    return StmtDiff(S);
+  }
+
+  StmtDiff TaylorModeVisitor::VisitReturnStmt(const ReturnStmt* RS) {
+    StmtDiff retValDiff = Visit(RS->getRetValue());
+    // Write the derivatives of the returned value to the output, e.g.
+    // return x * y;
+    // ->
+    // (_d_x * _d_y).store_derivatives(derivatives);
+    // return;
+    // or store_packed_derivatives for the upper triangle of a Hessian.
+    Expr* series = retValDiff.getExpr_dx();
+    if (series)
+      series = BuildParens(series);
+    else
+      series = StoreAndRef(retValDiff.getExpr(), m_TaylorType,
+                           getCurrentBlock(), "_t",
+                           /*forceDeclCreation=*/true);
+    Expr* output = BuildDeclRef(m_Output);
+    Expr* store = BuildCallExprToMemFn(series, /*isArrow=*/false,
+                                       m_PackedHessian
+                                           ? "store_packed_derivatives"
+                                           : "store_derivatives",
+                                       output);
+    Stmt* returnStmt =
+        m_Sema.ActOnReturnStmt(noLoc, nullptr, getCurrentScope()).get();
+    return StmtDiff(returnStmt, store);
+  }
+
+  StmtDiff TaylorModeVisitor::VisitParenExpr(const ParenExpr* PE) {
+    StmtDiff subStmtDiff = Visit(PE->getSubExpr());
+    return StmtDiff(BuildParens(subStmtDiff.getExpr()),
+                    BuildParens(subStmtDiff.getExpr_dx()));
+  }
+
+  StmtDiff
+  TaylorModeVisitor::VisitCXXDefaultArgExpr(const CXXDefaultArgExpr* DE) {
+    return Visit(DE->getExpr());
+  }
+
+  StmtDiff TaylorModeVisitor::VisitDeclRefExpr(const DeclRefExpr* DRE) {
+    DeclRefExpr* clonedDRE = nullptr;
+    if (auto VD = dyn_cast<VarDecl>(DRE->getDecl())) {
+      auto it = m_DeclReplacements.find(VD);
+      if (it != std::end(m_DeclReplacements))
+        clonedDRE = BuildDeclRef(it->second);
+      else
+        clonedDRE = cast<DeclRefExpr>(Clone(DRE));
+      if (clonedDRE->getDecl()->getDeclContext() != m_Sema.CurContext) {
+        auto referencedDecl = cast<VarDecl>(clonedDRE->getDecl());
+        clonedDRE = cast<DeclRefExpr>(BuildDeclRef(referencedDecl));
+      }
+    } else
+      clonedDRE = cast<DeclRefExpr>(Clone(DRE));
+
+    if (auto VD = dyn_cast<VarDecl>(clonedDRE->getDecl())) {
+      auto it = m_Variables.find(VD);
+      if (it != std::end(m_Variables)) {
+        Expr* series = it->second;
+        if (auto seriesDRE = dyn_cast<DeclRefExpr>(series)) {
+          auto seriesVar = cast<VarDecl>(seriesDRE->getDecl());
+          if (seriesVar->getDeclContext() != m_Sema.CurContext)
+            series = BuildDeclRef(seriesVar);
+        }
+        return StmtDiff(clonedDRE, series);
+      }
+    }
+    // Not related to the independent variable.
+    return StmtDiff(clonedDRE);
+  }
+
+  StmtDiff
+  TaylorModeVisitor::VisitArraySubscriptExpr(const ArraySubscriptExpr* ASE) {
+    Expr* base = Visit(ASE->getBase()).getExpr();
+    Expr* idx = Visit(ASE->getIdx()).getExpr();
+    Expr* cloned =
+        m_Sema.CreateBuiltinArraySubscriptExpr(base, noLoc, idx, noLoc).get();
+    auto DRE = dyn_cast<DeclRefExpr>(base->IgnoreParenImpCasts());
+    if (!DRE)
+      return StmtDiff(cloned);
+    auto it = m_ArraySeries.find(DRE->getDecl());
+    if (it == std::end(m_ArraySeries))
+      return StmtDiff(cloned);
+    VarDecl* seriesArray = it->second.first;
+    IndexInterval interval = it->second.second;
+    // Only the requested elements have a series, e.g. for p[1:2] the element
+    // p[i] has the series _d_p[i - 1], the other elements are constants.
+    llvm::APSInt intIdx;
+    if (clad_compat::Expr_EvaluateAsInt(idx, intIdx, m_Context)) {
+      int64_t i = intIdx.getExtValue();
+      if (i < (int64_t)interval.Start || i >= (int64_t)interval.Finish)
+        return StmtDiff(cloned);
+      auto seriesIdx = ConstantFolder::synthesizeLiteral(
+          m_Context.IntTy, m_Context, i - interval.Start);
+      return StmtDiff(cloned,
+                      m_Sema
+                          .CreateBuiltinArraySubscriptExpr(
+                              BuildDeclRef(seriesArray), noLoc, seriesIdx,
+                              noLoc)
+                          .get());
+    }
+    // (1 <= i && i < 3 ? _d_p[i - 1] : p[i])
+    // The result is not an lvalue, assignments to it are not tracked.
+    auto start = ConstantFolder::synthesizeLiteral(m_Context.IntTy, m_Context,
+                                                   interval.Start);
+    auto finish = ConstantFolder::synthesizeLiteral(m_Context.IntTy, m_Context,
+                                                    interval.Finish);
+    Expr* inInterval = BuildOp(BO_LT, Clone(idx), finish);
+    Expr* seriesIdx = Clone(idx);
+    if (interval.Start) {
+      inInterval =
+          BuildOp(BO_LAnd, BuildOp(BO_LE, start, Clone(idx)), inInterval);
+      seriesIdx = BuildOp(BO_Sub, seriesIdx,
+                          ConstantFolder::synthesizeLiteral(
+                              m_Context.IntTy, m_Context, interval.Start));
+    }
+    Expr* seriesEntry = m_Sema
+                            .CreateBuiltinArraySubscriptExpr(
+                                BuildDeclRef(seriesArray), noLoc, seriesIdx,
+                                noLoc)
+                            .get();
+    Expr* constantEntry =
+        m_Sema
+            .CreateBuiltinArraySubscriptExpr(Clone(base), noLoc, Clone(idx),
+                                             noLoc)
+            .get();
+    Expr* entry = m_Sema
+                      .ActOnConditionalOp(noLoc, noLoc, inInterval,
+                                          seriesEntry, constantEntry)
+                      .get();
+    return StmtDiff(cloned, BuildParens(entry));
+  }
+
+  StmtDiff
+  TaylorModeVisitor::VisitImplicitCastExpr(const ImplicitCastExpr* ICE) {
+    StmtDiff subExprDiff = Visit(ICE->getSubExpr());
+    // Conversions to integral types or bool drop the series.
+    if (!isTaylorTracked(ICE->getType()))
+      return StmtDiff(subExprDiff.getExpr());
+    return subExprDiff;
+  }
+
+  StmtDiff
+  TaylorModeVisitor::VisitExplicitCastExpr(const ExplicitCastExpr* ECE) {
+    StmtDiff subExprDiff = Visit(ECE->getSubExpr());
+    Expr* cast = Clone(ECE);
+    if (!isTaylorTracked(ECE->getType()))
+      return StmtDiff(cast);
+    return StmtDiff(cast, subExprDiff.getExpr_dx());
+  }
+
+  StmtDiff
+  TaylorModeVisitor::VisitConditionalOperator(const ConditionalOperator* CO) {
+    Expr* cond = StoreAndRef(Clone(CO->getCond()));
+    cond = m_Sema
+               .ActOnCondition(m_CurScope, noLoc, cond,
+                               Sema::ConditionKind::Boolean)
+               .get()
+               .second;
+    // FIXME: fix potential side-effects from evaluating both sides of
+    // conditional.
+    StmtDiff ifTrueDiff = Visit(CO->getTrueExpr());
+    StmtDiff ifFalseDiff = Visit(CO->getFalseExpr());
+    Expr* condExpr = m_Sema
+                         .ActOnConditionalOp(noLoc, noLoc, cond,
+                                             ifTrueDiff.getExpr(),
+                                             ifFalseDiff.getExpr())
+                         .get();
+    if (!ifTrueDiff.getExpr_dx() && !ifFalseDiff.getExpr_dx())
+      return StmtDiff(condExpr);
+    // Both branches must have the type of the series.
+    auto toSeries = [this](StmtDiff& Diff) {
+      if (Diff.getExpr_dx())
+        return Diff.getExpr_dx();
+      return StoreAndRef(Diff.getExpr(), m_TaylorType, getCurrentBlock(), "_t",
+                         /*forceDeclCreation=*/true);
+    };
+    Expr* condExprDiff = m_Sema
+                             .ActOnConditionalOp(noLoc, noLoc, cond,
+                                                 toSeries(ifTrueDiff),
+                                                 toSeries(ifFalseDiff))
+                             .get();
+    return StmtDiff(condExpr, condExprDiff);
+  }
+
+  StmtDiff TaylorModeVisitor::VisitCallExpr(const CallExpr* CE) {
+    llvm::SmallVector<StmtDiff, 4> argDiffs;
+    bool isActive = false;
+    for (const Expr* arg : CE->arguments()) {
+      argDiffs.push_back(Visit(arg));
+      isActive |= argDiffs.back().getExpr_dx() != nullptr;
+    }
+    // The primal arguments are used twice if the call is active, store them
+    // to avoid evaluating them again.
+    llvm::SmallVector<Expr*, 4> CallArgs{};
+    llvm::SmallVector<Expr*, 4> SeriesArgs{};
+    for (StmtDiff& argDiff : argDiffs) {
+      if (isActive && !argDiff.getExpr_dx())
+        argDiff = StmtDiff(StoreAndRef(argDiff.getExpr()));
+      CallArgs.push_back(argDiff.getExpr());
+      SeriesArgs.push_back(getSeries(argDiff));
+    }
+    Expr* call = m_Sema
+                     .ActOnCallExpr(getCurrentScope(),
+                                    Clone(CE->getCallee()),
+                                    noLoc,
+                                    llvm::MutableArrayRef<Expr*>(CallArgs),
+                                    noLoc)
+                     .get();
+    if (!isActive)
+      return StmtDiff(call);
+
+    const FunctionDecl* FD = CE->getDirectCallee();
+    Expr* callDiff = nullptr;
+    if (FD && FD->getDeclName().isIdentifier())
+      callDiff = BuildTaylorRuleCall(FD->getName(), SeriesArgs);
+    if (!callDiff) {
+      // Treating the result as a constant would silently give wrong higher
+      // order derivatives, fail the request instead.
+      diag(DiagnosticsEngine::Error,
+           CE->getBeginLoc(),
+           "function '%0' has no Taylor mode propagation rule, Taylor mode "
+           "only supports calls to the elementary functions of clad::taylor",
+           {FD ? FD->getNameAsString() : "<indirect call>"});
+      m_Unsupported = true;
+      return StmtDiff(call);
+    }
+    return StmtDiff(call, callDiff);
+  }
+
+  StmtDiff TaylorModeVisitor::VisitUnaryOperator(const UnaryOperator* UnOp) {
+    StmtDiff diff = Visit(UnOp->getSubExpr());
+    auto opKind = UnOp->getOpcode();
+    Expr* op = BuildOp(opKind, diff.getExpr());
+    if (!diff.getExpr_dx())
+      return StmtDiff(op);
+    if (opKind == UO_Plus || opKind == UO_Minus || opKind == UO_PostInc ||
+        opKind == UO_PostDec || opKind == UO_PreInc || opKind == UO_PreDec)
+      return StmtDiff(op, BuildOp(opKind, diff.getExpr_dx()));
+    if (opKind != UO_LNot)
+      diag(DiagnosticsEngine::Warning,
+           UnOp->getEndLoc(),
+           "attempt to differentiate unsupported operator in Taylor mode, "
+           "its result is treated as a constant");
+    return StmtDiff(op);
+  }
+
+  StmtDiff TaylorModeVisitor::VisitBinaryOperator(const BinaryOperator* BinOp) {
+    StmtDiff Ldiff = Visit(BinOp->getLHS());
+    StmtDiff Rdiff = Visit(BinOp->getRHS());
+    auto opCode = BinOp->getOpcode();
+    Expr* opDiff = nullptr;
+
+    if (BinOp->isAssignmentOp()) {
+      Expr* target = Ldiff.getExpr_dx();
+      // Series of array elements accessed with a non-constant index are
+      // temporaries, see VisitArraySubscriptExpr.
+      if (target && !target->isLValue())
+        target = nullptr;
+      if (!target) {
+        if (Rdiff.getExpr_dx() && isTaylorTracked(BinOp->getType()))
+          diag(DiagnosticsEngine::Warning,
+               BinOp->getEndLoc(),
+               "Taylor mode does not track the assigned location, the "
+               "derivatives of the assigned value are dropped");
+      } else if (opCode == BO_Assign || opCode == BO_AddAssign ||
+                 opCode == BO_SubAssign || opCode == BO_MulAssign ||
+                 opCode == BO_DivAssign) {
+        if (!Rdiff.getExpr_dx())
+          Rdiff = StmtDiff(StoreAndRef(Rdiff.getExpr()));
+        opDiff = BuildOp(opCode, target, getSeries(Rdiff));
+      } else {
+        diag(DiagnosticsEngine::Warning,
+             BinOp->getEndLoc(),
+             "attempt to differentiate unsupported operator in Taylor mode, "
+             "derivatives of the assigned value are dropped");
+      }
+    } else if (Ldiff.getExpr_dx() || Rdiff.getExpr_dx()) {
+      if (opCode == BO_Add || opCode == BO_Sub || opCode == BO_Mul ||
+          opCode == BO_Div) {
+        // The constant operand is used by both the primal and the series
+        // operation, store it to avoid evaluating it twice.
+        if (!Ldiff.getExpr_dx())
+          Ldiff = StmtDiff(StoreAndRef(Ldiff.getExpr()));
+        if (!Rdiff.getExpr_dx())
+          Rdiff = StmtDiff(StoreAndRef(Rdiff.getExpr()));
+        opDiff = BuildOp(opCode, getSeries(Ldiff), getSeries(Rdiff));
+      } else if (opCode == BO_Comma) {
+        if (Ldiff.getExpr_dx() && !isUnusedResult(Ldiff.getExpr_dx()))
+          opDiff = BuildOp(BO_Comma, BuildParens(Ldiff.getExpr_dx()),
+                           BuildParens(getSeries(Rdiff)));
+        else
+          opDiff = Rdiff.getExpr_dx();
+      } else if (!BinOp->isComparisonOp() && !BinOp->isLogicalOp()) {
+        diag(DiagnosticsEngine::Warning,
+             BinOp->getEndLoc(),
+             "attempt to differentiate unsupported operator in Taylor mode, "
+             "its result is treated as a constant");
+      }
+    }
+    // Recover the original operation from the Ldiff and Rdiff instead of
+    // cloning the tree.
+    Expr* op = BuildOp(opCode, Ldiff.getExpr(), Rdiff.getExpr());
+    return StmtDiff(op, opDiff);
+  }
+
+  VarDeclDiff TaylorModeVisitor::DifferentiateVarDecl(const VarDecl* VD) {
+    StmtDiff initDiff = VD->getInit() ? Visit(VD->getInit()) : StmtDiff{};
+    bool isTracked = isTaylorTracked(VD->getType());
+    if (isTracked && initDiff.getExpr() && !initDiff.getExpr_dx())
+      initDiff = StmtDiff(StoreAndRef(initDiff.getExpr()));
+    VarDecl* VDClone = BuildVarDecl(VD->getType(),
+                                    VD->getNameAsString(),
+                                    initDiff.getExpr(),
+                                    VD->isDirectInit());
+    if (!isTracked)
+      return VarDeclDiff(VDClone);
+    VarDecl* VDDerived = BuildVarDecl(m_TaylorType,
+                                      "_d_" + VD->getNameAsString(),
+                                      getSeries(initDiff));
+    m_Variables.emplace(VDClone, BuildDeclRef(VDDerived));
+    return VarDeclDiff(VDClone, VDDerived);
+  }
+
+  StmtDiff TaylorModeVisitor::VisitDeclStmt(const DeclStmt* DS) {
+    llvm::SmallVector<Decl*, 4> decls;
+    llvm::SmallVector<Decl*, 4> declsDiff;
+    // For each floating point variable v, create another declaration _d_v
+    // holding its series, e.g.
+    // double y = x * x;
+    // ->
+    // clad::taylor<double, N> _d_y = _d_x * _d_x; double y = x * x;
+    for (auto D : DS->decls()) {
+      if (auto VD = dyn_cast<VarDecl>(D)) {
+        VarDeclDiff VDDiff = DifferentiateVarDecl(VD);
+        if (VDDiff.getDecl()->getDeclName() != VD->getDeclName())
+          m_DeclReplacements[VD] = VDDiff.getDecl();
+        decls.push_back(VDDiff.getDecl());
+        if (VDDiff.getDecl_dx())
+          declsDiff.push_back(VDDiff.getDecl_dx());
+      } else {
+        diag(DiagnosticsEngine::Warning,
+             D->getEndLoc(),
+             "Unsupported declaration");
+      }
+    }
+
+    Stmt* DSClone = BuildDeclStmt(decls);
+    Stmt* DSDiff = declsDiff.empty() ? nullptr : BuildDeclStmt(declsDiff);
+    return StmtDiff(DSClone, DSDiff);
+  }
+} // end namespace clad
@@ -10,6 +10,7 @@
 
 #include "clad/Differentiator/DiffPlanner.h"
 #include "clad/Differentiator/ErrorEstimator.h"
+#include "clad/Differentiator/Profiler.h"
 #include "clad/Differentiator/StmtClone.h"
 
 #include "clang/AST/ASTContext.h"
@@ -221,7 +222,7 @@ namespace clad {
                                      Expr* Init, bool DirectInit,
                                      TypeSourceInfo* TSI,
                                      VarDecl::InitializationStyle IS) {
-
+    ProfileScope Scope(m_Builder.m_Profiler, ProfilePhase::SemaBuilding);
     auto VD =
         VarDecl::Create(m_Context, m_Sema.CurContext, m_Function->getLocation(),
                         m_Function->getLocation(), Identifier, Type, TSI,
@@ -438,7 +439,14 @@ namespace clad {
   }
 
   Stmt* VisitorBase::Clone(const Stmt* S) {
-    Stmt* clonedStmt = m_Builder.m_NodeCloner->Clone(S);
+    ProfileScope Scope(m_Builder.m_Profiler, ProfilePhase::Cloning);
+    utils::StmtClone& Cloner = *m_Builder.m_NodeCloner;
+    unsigned NumCloned = Cloner.getNumCloned();
+    unsigned NumShared = Cloner.getNumShared();
+    Stmt* clonedStmt = Cloner.Clone(S);
+    if (m_Builder.m_Profiler.isEnabled())
+      m_Builder.m_Profiler.addClonedNodes(Cloner.getNumCloned() - NumCloned,
+                                          Cloner.getNumShared() - NumShared);
     updateReferencesOf(clonedStmt);
     return clonedStmt;
   }
@@ -451,6 +459,7 @@ namespace clad {
                              SourceLocation OpLoc) {
     if (!E)
       return nullptr;
+    ProfileScope Scope(m_Builder.m_Profiler, ProfilePhase::SemaBuilding);
     return m_Sema.BuildUnaryOp(nullptr, OpLoc, OpCode, E).get();
   }
 
@@ -458,6 +467,7 @@ namespace clad {
                              SourceLocation OpLoc) {
     if (!L || !R)
       return nullptr;
+    ProfileScope Scope(m_Builder.m_Profiler, ProfilePhase::SemaBuilding);
     return m_Sema.BuildBinOp(nullptr, OpLoc, OpCode, L, R).get();
   }
 
@@ -490,7 +500,7 @@ namespace clad {
   }
 
   NamespaceDecl* VisitorBase::GetCladNamespace() {
-    static NamespaceDecl* Result = nullptr;
+    NamespaceDecl*& Result = m_Builder.m_RuntimeDecls.Namespace;
     if (Result)
       return Result;
     DeclarationName CladName = &m_Context.Idents.get("clad");
@@ -505,7 +515,8 @@ namespace clad {
     return Result;
   }
 
-  TemplateDecl* VisitorBase::GetCladClassDecl(llvm::StringRef ClassName) {
+  TemplateDecl* VisitorBase::GetCladClassDecl(llvm::StringRef ClassName,
+                                              llvm::StringRef Header) {
     NamespaceDecl* CladNS = GetCladNamespace();
     CXXScopeSpec CSS;
     CSS.Extend(m_Context, CladNS, noLoc, noLoc);
@@ -516,8 +527,14 @@ namespace clad {
                        Sema::LookupUsingDeclName,
                        clad_compat::Sema_ForVisibleRedeclaration);
     m_Sema.LookupQualifiedName(TapeR, CladNS, CSS);
-    assert(!TapeR.empty() && isa<TemplateDecl>(TapeR.getFoundDecl()) &&
-           "cannot find clad::tape");
+    if (TapeR.empty() || !isa<TemplateDecl>(TapeR.getFoundDecl())) {
+      // Never silenced, the derivative cannot be built without the header.
+      m_Builder.diag(DiagnosticsEngine::Error,
+                     m_Function ? m_Function->getLocation() : noLoc,
+                     "'clad::%0' is not declared, include '%1'",
+                     {ClassName, Header});
+      return nullptr;
+    }
     return cast<TemplateDecl>(TapeR.getFoundDecl());
   }
 
@@ -531,9 +548,17 @@ namespace clad {
       TLI.addArgument(
           TemplateArgumentLoc(TA, m_Context.getTrivialTypeSourceInfo(T)));
     }
+    return GetCladClassOfType(CladClassDecl, TLI);
+  }
+
+  QualType
+  VisitorBase::GetCladClassOfType(TemplateDecl* CladClassDecl,
+                                  TemplateArgumentListInfo& TemplateArgs) {
+    if (!CladClassDecl)
+      return QualType();
     // This will instantiate tape<T> type and return it.
-    QualType TT =
-        m_Sema.CheckTemplateIdType(TemplateName(CladClassDecl), noLoc, TLI);
+    QualType TT = m_Sema.CheckTemplateIdType(TemplateName(CladClassDecl),
+                                             noLoc, TemplateArgs);
     // Get clad namespace and its identifier clad::.
     CXXScopeSpec CSS;
     CSS.Extend(m_Context, GetCladNamespace(), noLoc, noLoc);
@@ -545,7 +570,7 @@ namespace clad {
   }
 
   TemplateDecl* VisitorBase::GetCladTapeDecl() {
-    static TemplateDecl* Result = nullptr;
+    TemplateDecl*& Result = m_Builder.m_RuntimeDecls.Tape;
     if (!Result)
       Result = GetCladClassDecl(/*ClassName=*/"tape");
     return Result;
@@ -564,7 +589,7 @@ namespace clad {
   }
 
   LookupResult& VisitorBase::GetCladTapePush() {
-    static llvm::Optional<LookupResult> Result{};
+    llvm::Optional<LookupResult>& Result = m_Builder.m_RuntimeDecls.TapePush;
     if (Result)
       return Result.getValue();
     Result = LookupCladTapeMethod("push");
@@ -572,7 +597,7 @@ namespace clad {
   }
 
   LookupResult& VisitorBase::GetCladTapePop() {
-    static llvm::Optional<LookupResult> Result{};
+    llvm::Optional<LookupResult>& Result = m_Builder.m_RuntimeDecls.TapePop;
     if (Result)
       return Result.getValue();
     Result = LookupCladTapeMethod("pop");
@@ -580,7 +605,7 @@ namespace clad {
   }
 
   LookupResult& VisitorBase::GetCladTapeBack() {
-    static llvm::Optional<LookupResult> Result{};
+    llvm::Optional<LookupResult>& Result = m_Builder.m_RuntimeDecls.TapeBack;
     if (Result)
       return Result.getValue();
     Result = LookupCladTapeMethod("back");
@@ -594,6 +619,7 @@ namespace clad {
   Expr* VisitorBase::BuildCallExprToMemFn(Expr* Base, bool isArrow,
                                           StringRef MemberFunctionName,
                                           MutableArrayRef<Expr*> ArgExprs) {
+    ProfileScope Scope(m_Builder.m_Profiler, ProfilePhase::SemaBuilding);
     UnqualifiedId Member;
     Member.setIdentifier(&m_Context.Idents.get(MemberFunctionName), noLoc);
     CXXScopeSpec SS;
@@ -623,6 +649,7 @@ namespace clad {
   Expr* VisitorBase::BuildCallExprToMemFn(
       clang::CXXMethodDecl* FD, llvm::MutableArrayRef<clang::Expr*> argExprs,
       bool useRefQualifiedThisObj) {
+    ProfileScope Scope(m_Builder.m_Profiler, ProfilePhase::SemaBuilding);
     Expr* thisExpr = clad_compat::Sema_BuildCXXThisExpr(m_Sema, FD);
     bool isArrow = true;
 
@@ -660,6 +687,7 @@ namespace clad {
   VisitorBase::BuildCallExprToFunction(FunctionDecl* FD,
                                        llvm::MutableArrayRef<Expr*> argExprs,
                                        bool useRefQualifiedThisObj) {
+    ProfileScope Scope(m_Builder.m_Profiler, ProfilePhase::SemaBuilding);
     Expr* call = nullptr;
     if (auto derMethod = dyn_cast<CXXMethodDecl>(FD)) {
       call = BuildCallExprToMemFn(derMethod, argExprs, useRefQualifiedThisObj);
@@ -678,7 +706,7 @@ namespace clad {
   }
 
   TemplateDecl* VisitorBase::GetCladArrayRefDecl() {
-    static TemplateDecl* Result = nullptr;
+    TemplateDecl*& Result = m_Builder.m_RuntimeDecls.ArrayRef;
     if (!Result)
       Result = GetCladClassDecl(/*ClassName=*/"array_ref");
     return Result;
@@ -689,7 +717,7 @@ namespace clad {
   }
 
   TemplateDecl* VisitorBase::GetCladArrayDecl() {
-    static TemplateDecl* Result = nullptr;
+    TemplateDecl*& Result = m_Builder.m_RuntimeDecls.Array;
     if (!Result)
       Result = GetCladClassDecl(/*ClassName=*/"array");
     return Result;
@@ -699,6 +727,93 @@ namespace clad {
     return GetCladClassOfType(GetCladArrayDecl(), {T});
   }
 
+  TemplateDecl* VisitorBase::GetCladTaylorDecl() {
+    TemplateDecl*& Result = m_Builder.m_RuntimeDecls.Taylor;
+    if (!Result)
+      Result = GetCladClassDecl(/*ClassName=*/"taylor",
+                                /*Header=*/"clad/Differentiator/Taylor.h");
+    return Result;
+  }
+
+  /// Returns the template arguments <T, N> of the clad series types, e.g.
+  /// clad::taylor<T, N>, and of clad::array<T, N>, where N is an unsigned
+  /// non-type template argument.
+  static TemplateArgumentListInfo GetSeriesTemplateArgs(ASTContext& C,
+                                                        QualType T,
+                                                        unsigned N) {
+    TemplateArgumentListInfo TLI{};
+    TLI.addArgument(TemplateArgumentLoc(TemplateArgument(T),
+                                        C.getTrivialTypeSourceInfo(T)));
+    // N is a non-type template argument, pass it as an expression.
+    Expr* NExpr = ConstantFolder::synthesizeLiteral(C.UnsignedIntTy, C, N);
+    TLI.addArgument(TemplateArgumentLoc(TemplateArgument(NExpr), NExpr));
+    return TLI;
+  }
+
+  QualType VisitorBase::GetCladArrayOfType(clang::QualType T, unsigned N) {
+    TemplateArgumentListInfo TLI = GetSeriesTemplateArgs(m_Context, T, N);
+    return GetCladClassOfType(GetCladArrayDecl(), TLI);
+  }
+
+  QualType VisitorBase::GetCladTaylorOfType(clang::QualType T, unsigned N) {
+    TemplateArgumentListInfo TLI = GetSeriesTemplateArgs(m_Context, T, N);
+    return GetCladClassOfType(GetCladTaylorDecl(), TLI);
+  }
+
+  TemplateDecl* VisitorBase::GetCladHessianSeriesDecl() {
+    TemplateDecl*& Result = m_Builder.m_RuntimeDecls.HessianSeries;
+    if (!Result)
+      Result = GetCladClassDecl(
+          /*ClassName=*/"hessian_series",
+          /*Header=*/"clad/Differentiator/HessianSeries.h");
+    return Result;
+  }
+
+  QualType VisitorBase::GetCladHessianSeriesOfType(clang::QualType T,
+                                                   unsigned N) {
+    TemplateArgumentListInfo TLI = GetSeriesTemplateArgs(m_Context, T, N);
+    return GetCladClassOfType(GetCladHessianSeriesDecl(), TLI);
+  }
+
+  TemplateDecl* VisitorBase::GetCladHessianDiagonalSeriesDecl() {
+    TemplateDecl*& Result = m_Builder.m_RuntimeDecls.HessianDiagonalSeries;
+    if (!Result)
+      Result = GetCladClassDecl(
+          /*ClassName=*/"hessian_diagonal_series",
+          /*Header=*/"clad/Differentiator/HessianSeries.h");
+    return Result;
+  }
+
+  QualType VisitorBase::GetCladHessianDiagonalSeriesOfType(clang::QualType T,
+                                                           unsigned N) {
+    TemplateArgumentListInfo TLI = GetSeriesTemplateArgs(m_Context, T, N);
+    return GetCladClassOfType(GetCladHessianDiagonalSeriesDecl(), TLI);
+  }
+
+  QualType VisitorBase::GetCladTaskGroupType() {
+    QualType& Result = m_Builder.m_RuntimeDecls.TaskGroup;
+    if (!Result.isNull())
+      return Result;
+    NamespaceDecl* CladNS = GetCladNamespace();
+    CXXScopeSpec CSS;
+    CSS.Extend(m_Context, CladNS, noLoc, noLoc);
+    DeclarationName Name = &m_Context.Idents.get("task_group");
+    LookupResult R(m_Sema, Name, noLoc, Sema::LookupTagName);
+    m_Sema.LookupQualifiedName(R, CladNS, CSS);
+    if (R.empty() || !isa<CXXRecordDecl>(R.getFoundDecl())) {
+      m_Builder.diag(DiagnosticsEngine::Error,
+                     m_Function ? m_Function->getLocation() : noLoc,
+                     "'clad::%0' is not declared, include '%1'",
+                     {"task_group", "clad/Differentiator/TaskGroup.h"});
+      return QualType();
+    }
+    QualType T =
+        m_Context.getRecordType(cast<CXXRecordDecl>(R.getFoundDecl()));
+    // i.e. task_group -> clad::task_group
+    Result = m_Context.getElaboratedType(ETK_None, CSS.getScopeRep(), T);
+    return Result;
+  }
+
   Expr* VisitorBase::BuildArrayRefSizeExpr(Expr* Base) {
     return BuildCallExprToMemFn(Base, /*isArrow=*/false,
                                 /*MemberFunctionName=*/"size", {});
@@ -790,6 +905,15 @@ namespace clad {
 
   void VisitorBase::CallExprDiffDiagnostics(llvm::StringRef funcName,
                                  SourceLocation srcLoc, bool isDerived){
+    // Without the builtin derivatives the math functions have no derivative.
+    // Never silenced, the derivative would be wrong.
+    if (!isDerived && !m_Builder.hasCustomDerivatives()) {
+      m_Builder.diag(DiagnosticsEngine::Error, srcLoc,
+                     "function '%0' was not differentiated, the builtin "
+                     "derivatives are not declared, include '%1'",
+                     {funcName, "clad/Differentiator/BuiltinDerivatives.h"});
+      return;
+    }
     if (!isDerived) {
       // Function was not derived => issue a warning.
       diag(DiagnosticsEngine::Warning,
@@ -0,0 +1,247 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+//
+// clad-gen generates ahead of time the derivatives requested by the sources of
+// a compilation database. The translation units are parsed in parallel, each
+// worker thread runs the plugin in its own CompilerInstance. The derivatives
+// are written once, however many translation units request them, to
+// Derivatives.h and Derivatives.cpp, or Derivatives_<i>.cpp with -split, which
+// can be compiled without clad, see DerivativeEmitter:
+//
+//   clad-gen -p build/ -o gen/ [-j N] [-split N] [-include h] [source...]
+//
+// Only the derivatives declared at namespace scope are written. The
+// non-inline functions of the main files they call, e.g. the differentiated
+// functions called by a forward mode derivative, are declared. The other
+// declarations they use are not; the headers given with -include are included
+// in Derivatives.h for them.
+//------------------------------------------------------------------------------
+
+#include "ClangPlugin.h"
+#include "DerivativeEmitter.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#if CLANG_VERSION_MAJOR >= 8
+#include "llvm/Support/VirtualFileSystem.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using namespace clang;
+using namespace clad::plugin;
+
+static llvm::cl::OptionCategory CladGenCategory("clad-gen options");
+
+static llvm::cl::opt<std::string>
+    BuildPath("p", llvm::cl::desc("The build directory containing "
+                                  "compile_commands.json"),
+              llvm::cl::Required, llvm::cl::cat(CladGenCategory));
+
+static llvm::cl::list<std::string>
+    SourcePaths(llvm::cl::Positional,
+                llvm::cl::desc("[<source>...] (default: all the sources of "
+                               "the compilation database)"),
+                llvm::cl::cat(CladGenCategory));
+
+static llvm::cl::opt<std::string>
+    OutputDir("o", llvm::cl::desc("The directory of Derivatives.h and "
+                                  "Derivatives.cpp"),
+              llvm::cl::init("."), llvm::cl::cat(CladGenCategory));
+
+static llvm::cl::opt<unsigned>
+    NumThreads("j", llvm::cl::desc("The number of worker threads, 0 for one "
+                                   "per hardware thread"),
+               llvm::cl::init(0), llvm::cl::cat(CladGenCategory));
+
+static llvm::cl::opt<unsigned>
+    NumParts("split", llvm::cl::desc("The number of source files the "
+                                     "definitions are split into"),
+             llvm::cl::init(1), llvm::cl::cat(CladGenCategory));
+
+static llvm::cl::list<std::string>
+    Includes("include", llvm::cl::desc("A header included by Derivatives.h, "
+                                       "declaring what the derivatives use"),
+             llvm::cl::cat(CladGenCategory));
+
+namespace {
+  /// Runs the plugin over a translation unit and hands the derivatives it
+  /// generated to the emitter.
+  class CladGenConsumer : public CladPlugin {
+    DerivativeEmitter& m_Out;
+    std::string m_File;
+
+  public:
+    CladGenConsumer(CompilerInstance& CI, DifferentiationOptions& DO,
+                    DerivativeEmitter& Out, llvm::StringRef File)
+        : CladPlugin(CI, DO), m_Out(Out), m_File(File.str()) {}
+
+    void HandleTranslationUnit(ASTContext& C) override {
+      CladPlugin::HandleTranslationUnit(C);
+      if (C.getDiagnostics().hasErrorOccurred())
+        return;
+      // Print the derivatives as the plugin does.
+      LangOptions LangOpts;
+      LangOpts.CPlusPlus = true;
+      PrintingPolicy Policy(LangOpts);
+      Policy.Bool = true;
+      m_Out.add(C.getTranslationUnitDecl(), getDerivatives(), Policy, m_File);
+    }
+  };
+
+  class CladGenAction : public ASTFrontendAction {
+    DerivativeEmitter& m_Out;
+    DifferentiationOptions m_DO;
+
+  public:
+    explicit CladGenAction(DerivativeEmitter& Out) : m_Out(Out) {}
+
+  protected:
+    std::unique_ptr<ASTConsumer>
+    CreateASTConsumer(CompilerInstance& CI, llvm::StringRef InFile) override {
+      return std::unique_ptr<ASTConsumer>(
+          new CladGenConsumer(CI, m_DO, m_Out, InFile));
+    }
+  };
+
+  /// Parses a compile command of the database in a new CompilerInstance.
+  class CladGenToolAction : public tooling::ToolAction {
+    DerivativeEmitter& m_Out;
+
+  public:
+    explicit CladGenToolAction(DerivativeEmitter& Out) : m_Out(Out) {}
+
+    bool
+    runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                  FileManager* Files,
+                  std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                  DiagnosticConsumer* DiagConsumer) override {
+      CompilerInstance CI(std::move(PCHContainerOps));
+      CI.setInvocation(std::move(Invocation));
+      CI.setFileManager(Files);
+      CI.createDiagnostics(DiagConsumer, /*ShouldOwnClient=*/false);
+      if (!CI.hasDiagnostics())
+        return false;
+      CI.createSourceManager(*Files);
+      CladGenAction Action(m_Out);
+      return CI.ExecuteAction(Action);
+    }
+  };
+
+  /// Drops the plugins loaded by the compile commands, clad-gen runs clad
+  /// itself.
+  tooling::CommandLineArguments
+  StripPlugins(const tooling::CommandLineArguments& Args,
+               llvm::StringRef /*Filename*/) {
+    tooling::CommandLineArguments Result;
+    for (std::size_t i = 0, e = Args.size(); i != e; ++i) {
+      llvm::StringRef Arg = Args[i];
+      if (Arg.startswith("-fplugin="))
+        continue;
+      // -Xclang -load -Xclang <plugin> and -Xclang -add-plugin -Xclang clad.
+      if (Arg == "-Xclang" && i + 3 < e &&
+          (Args[i + 1] == "-load" || Args[i + 1] == "-add-plugin" ||
+           llvm::StringRef(Args[i + 1]).startswith("-plugin-arg-"))) {
+        i += 3;
+        continue;
+      }
+      Result.push_back(Args[i]);
+    }
+    return Result;
+  }
+} // namespace
+
+int main(int argc, const char** argv) {
+  llvm::cl::HideUnrelatedOptions(CladGenCategory);
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv, "clad-gen: generates the derivatives requested by a "
+                  "project ahead of time\n");
+
+  std::string ErrorMessage;
+  std::unique_ptr<tooling::CompilationDatabase> DB =
+      tooling::CompilationDatabase::autoDetectFromDirectory(BuildPath,
+                                                            ErrorMessage);
+  if (!DB) {
+    llvm::errs() << "clad-gen: error: " << ErrorMessage << "\n";
+    return 1;
+  }
+
+  std::vector<std::string> Files(SourcePaths.begin(), SourcePaths.end());
+  if (Files.empty())
+    Files = DB->getAllFiles();
+  std::sort(Files.begin(), Files.end());
+  Files.erase(std::unique(Files.begin(), Files.end()), Files.end());
+
+  unsigned NumWorkers = NumThreads;
+  if (!NumWorkers)
+    NumWorkers = std::max(1u, std::thread::hardware_concurrency());
+  NumWorkers = std::min<std::size_t>(NumWorkers, Files.size());
+
+  DerivativeEmitter Out;
+  std::atomic<std::size_t> NextFile(0);
+  std::atomic<unsigned> NumFailed(0);
+#if CLANG_VERSION_MAJOR < 8
+  // ClangTool::run changes the working directory of the process to the one
+  // of the compile command, the translation units are parsed one at a time.
+  std::mutex RunMutex;
+#endif
+  auto Work = [&]() {
+#if CLANG_VERSION_MAJOR >= 8
+    // ClangTool::run changes the working directory of its file system to
+    // the one of the compile command. Each thread has a file system of its
+    // own, the real one has a single working directory for the process.
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS(
+        llvm::vfs::createPhysicalFileSystem().release());
+#endif
+    for (std::size_t I = NextFile++; I < Files.size(); I = NextFile++) {
+#if CLANG_VERSION_MAJOR >= 8
+      tooling::ClangTool Tool(*DB, Files[I],
+                              std::make_shared<PCHContainerOperations>(),
+                              BaseFS);
+#else
+      std::lock_guard<std::mutex> Lock(RunMutex);
+      tooling::ClangTool Tool(*DB, Files[I]);
+#endif
+      Tool.appendArgumentsAdjuster(StripPlugins);
+      CladGenToolAction Action(Out);
+      if (Tool.run(&Action))
+        ++NumFailed;
+    }
+  };
+  std::vector<std::thread> Workers;
+  for (unsigned i = 0; i < NumWorkers; ++i)
+    Workers.emplace_back(Work);
+  for (std::thread& Worker : Workers)
+    Worker.join();
+
+  std::string Error;
+  if (!Out.write(OutputDir, "Derivatives", NumParts, Includes, /*Weak=*/false,
+                 Error)) {
+    llvm::errs() << "clad-gen: error: " << Error << "\n";
+    return 1;
+  }
+  if (NumFailed) {
+    llvm::errs() << "clad-gen: error: " << NumFailed
+                 << " translation unit(s) failed\n";
+    return 1;
+  }
+  return 0;
+}
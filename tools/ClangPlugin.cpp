@@ -11,19 +11,29 @@
 
 #include "clad/Differentiator/Version.h"
 
+#include "DerivativeEmitter.h"
+
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Attr.h"
+#include "clang/AST/DeclTemplate.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Basic/Version.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendPluginRegistry.h"
 #include "clang/Frontend/MultiplexConsumer.h"
 #include "clang/Lex/LexDiagnostic.h"
+#include "clang/Lex/MacroInfo.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
 #include "clang/Sema/Sema.h"
 #include "clang/Sema/Lookup.h"
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Registry.h"
+#include "llvm/Support/SaveAndRestore.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -58,13 +68,155 @@ namespace {
       }
     }
   };
+
+  /// \returns a spelling of everything but the function which identifies the
+  /// derivative computed for the request.
+  std::string GetRequestSpelling(const clad::DiffRequest& request,
+                                 const PrintingPolicy& Policy) {
+    std::string Spelling;
+    llvm::raw_string_ostream OS(Spelling);
+    OS << static_cast<unsigned>(request.Mode) << ' ' << request.BitMaskedOpts
+       << ' ' << request.CurrentDerivativeOrder << ' '
+       << request.RequestedDerivativeOrder << ' ' << request.BaseFunctionName
+       << ' ' << request.JacobianNumColumns << ' ' << request.JacobianColumn
+       << ' ' << request.JacobianNumRows << ' '
+       << request.DirectionalDerivative;
+    for (int Index : request.JacobianSparseEntries)
+      OS << ' ' << Index;
+    OS << ' ';
+    if (request.Args)
+      request.Args->printPretty(OS, /*Helper=*/nullptr, Policy);
+    return OS.str();
+  }
+
+  /// Counts the statements and the declarations of a declaration.
+  class ASTNodeCounter : public RecursiveASTVisitor<ASTNodeCounter> {
+  public:
+    unsigned NumNodes = 0;
+    bool VisitDecl(Decl*) {
+      ++NumNodes;
+      return true;
+    }
+    bool VisitStmt(Stmt*) {
+      ++NumNodes;
+      return true;
+    }
+  };
+
+  /// Finds the expressions and the declarations of a floating-point type
+  /// which does not depend on the template parameters.
+  class NonDependentFPFinder
+      : public RecursiveASTVisitor<NonDependentFPFinder> {
+  public:
+    bool Found = false;
+    bool VisitExpr(Expr* E) {
+      Found = !E->isTypeDependent() && E->getType()->isRealFloatingType();
+      return !Found;
+    }
+    bool VisitValueDecl(ValueDecl* VD) {
+      QualType T = VD->getType().getNonReferenceType();
+      Found = !T->isDependentType() && T->isRealFloatingType();
+      return !Found;
+    }
+  };
+
+  /// Finds the calls which do not resolve to the same kind of callee for
+  /// every specialization, such as overloads for float and double. The
+  /// derivative template can call the derivatives of function templates and
+  /// the custom derivatives only.
+  class UnsupportedCallFinder
+      : public RecursiveASTVisitor<UnsupportedCallFinder> {
+    Sema& m_Sema;
+    /// The namespace of the custom derivatives, if it is declared.
+    NamespaceDecl* m_CustomDerivatives = nullptr;
+
+    bool HasCustomDerivative(DeclarationName Name) {
+      if (!m_CustomDerivatives || !Name.isIdentifier())
+        return false;
+      ASTContext& C = m_Sema.getASTContext();
+      IdentifierInfo* II = &C.Idents.get(Name.getAsString() + "_darg0");
+      LookupResult R(m_Sema, II, SourceLocation(), Sema::LookupOrdinaryName);
+      m_Sema.LookupQualifiedName(R, m_CustomDerivatives);
+      return !R.empty();
+    }
+
+  public:
+    bool Found = false;
+    explicit UnsupportedCallFinder(Sema& S) : m_Sema(S) {
+      ASTContext& C = S.getASTContext();
+      LookupResult R(S, &C.Idents.get("custom_derivatives"), SourceLocation(),
+                     Sema::LookupNamespaceName);
+      S.LookupQualifiedName(R, C.getTranslationUnitDecl());
+      m_CustomDerivatives = R.getAsSingle<NamespaceDecl>();
+    }
+    bool VisitCallExpr(CallExpr* CE) {
+      // The calls which do not depend on the template parameters are the same
+      // in every specialization. The operators on the floating-point type
+      // are builtin.
+      if (!CE->isTypeDependent() || isa<CXXOperatorCallExpr>(CE))
+        return true;
+      auto* OE = dyn_cast<OverloadExpr>(CE->getCallee()->IgnoreParens());
+      if (!OE) {
+        Found = true;
+        return false;
+      }
+      if (HasCustomDerivative(OE->getName()))
+        return true;
+      for (NamedDecl* ND : OE->decls())
+        if (!isa<FunctionTemplateDecl>(ND->getUnderlyingDecl()))
+          Found = true;
+      return !Found;
+    }
+  };
+
+  /// \returns the function template of which the request differentiates a
+  /// specialization, if the forward mode derivative of every specialization
+  /// over a floating-point type is an instantiation of the same derivative
+  /// template, see -fderivative-templates.
+  FunctionTemplateDecl*
+  GetDerivativeTemplatePattern(const clad::DiffRequest& request, Sema& S) {
+    const FunctionDecl* FD = request.Function;
+    if (request.Mode != clad::DiffMode::forward ||
+        request.RequestedDerivativeOrder != 1 || isa<CXXMethodDecl>(FD) ||
+        FD->getTemplateSpecializationKind() != TSK_ImplicitInstantiation)
+      return nullptr;
+    FunctionTemplateDecl* FTD = FD->getPrimaryTemplate();
+    if (!FTD)
+      return nullptr;
+    const TemplateParameterList* TPL = FTD->getTemplateParameters();
+    if (TPL->size() != 1)
+      return nullptr;
+    const auto* TTP = dyn_cast<TemplateTypeParmDecl>(TPL->getParam(0));
+    if (!TTP || TTP->isParameterPack())
+      return nullptr;
+    const TemplateArgument& Arg = FD->getTemplateSpecializationArgs()->get(0);
+    if (Arg.getKind() != TemplateArgument::Type ||
+        !Arg.getAsType()->isRealFloatingType())
+      return nullptr;
+    // The derivative template replaces the floating-point type of the first
+    // parameter with its own parameter. It must be the template parameter,
+    // and no other floating-point type may be used.
+    FunctionDecl* Pattern = FTD->getTemplatedDecl();
+    if (!Pattern->getNumParams() ||
+        !Pattern->getParamDecl(0)->getType().getNonReferenceType()
+             ->isTemplateTypeParmType())
+      return nullptr;
+    NonDependentFPFinder Finder;
+    Finder.TraverseDecl(Pattern);
+    if (Finder.Found)
+      return nullptr;
+    UnsupportedCallFinder CallFinder(S);
+    CallFinder.TraverseDecl(Pattern);
+    return CallFinder.Found ? nullptr : FTD;
+  }
 }
 
 namespace clad {
   namespace plugin {
-    /// Keeps track if we encountered #pragma clad on/off.
+    /// Keeps track if we encountered #pragma clad on/off. Each thread parsing
+    /// a translation unit has its own, see clad-gen.
     // FIXME: Figure out how to make it a member of CladPlugin.
-    std::vector<clang::SourceRange> CladEnabledRange;
+    thread_local std::vector<clang::SourceRange> CladEnabledRange;
 
     // Define a pragma handler for #pragma clad
     class CladPragmaHandler : public PragmaHandler {
@@ -97,8 +249,41 @@ namespace clad {
       }
     };
 
+    /// Records the expansions of the macros which may spell a call to clad.
+    /// The DiffCollector skips the declarations which expand none of them and
+    /// do not spell such a call themselves.
+    class CladMacroRecorder : public PPCallbacks {
+      const SourceManager& m_SM;
+      CladMacroExpansions& m_Expansions;
+
+    public:
+      CladMacroRecorder(const SourceManager& SM,
+                        CladMacroExpansions& Expansions)
+          : m_SM(SM), m_Expansions(Expansions) {}
+
+      void MacroExpands(const Token& MacroNameTok, const MacroDefinition& MD,
+                        SourceRange Range, const MacroArgs* Args) override {
+        const MacroInfo* MI = MD.getMacroInfo();
+        if (!MI)
+          return;
+        for (const Token& Tok : MI->tokens())
+          if (Tok.is(tok::identifier) &&
+              isCladAPIIdentifier(Tok.getIdentifierInfo()->getName())) {
+            m_Expansions.push_back(m_SM.getExpansionLoc(Range.getBegin()));
+            return;
+          }
+      }
+    };
+
     CladPlugin::CladPlugin(CompilerInstance& CI, DifferentiationOptions& DO)
-      : m_CI(CI), m_DO(DO), m_HasRuntime(false) { }
+      : m_CI(CI), m_DO(DO), m_Profiler(!DO.ProfileReportFile.empty()),
+        m_HasRuntime(false) {
+      // The ranges of a translation unit previously parsed by this thread.
+      CladEnabledRange.clear();
+      Preprocessor& PP = CI.getPreprocessor();
+      PP.addPPCallbacks(std::unique_ptr<PPCallbacks>(
+          new CladMacroRecorder(PP.getSourceManager(), m_MacroExpansions)));
+    }
     CladPlugin::~CladPlugin() {}
 
     // We cannot use HandleTranslationUnit because codegen already emits code on
@@ -107,10 +292,9 @@ namespace clad {
       if (!CheckBuiltins())
         return true;
 
-      Sema& S = m_CI.getSema();
-
       if (!m_DerivativeBuilder)
-        m_DerivativeBuilder.reset(new DerivativeBuilder(m_CI.getSema(), *this));
+        m_DerivativeBuilder.reset(
+            new DerivativeBuilder(m_CI.getSema(), *this, m_Profiler));
 
       // if HandleTopLevelDecl was called through clad we don't need to process
       // it for diff requests
@@ -118,30 +302,96 @@ namespace clad {
         return true;
 
       DiffSchedule requests{};
-      DiffCollector collector(DGR, CladEnabledRange, m_Derivatives, requests,
-                              m_CI.getSema());
-
-      // FIXME: Remove the PerformPendingInstantiations altogether. We should
-      // somehow make the relevant functions referenced.
-      // Instantiate all pending for instantiations templates, because we will
-      // need the full bodies to produce derivatives.
-      if (!m_PendingInstantiationsInFlight) {
-        m_PendingInstantiationsInFlight = true;
-        S.PerformPendingInstantiations();
-        m_PendingInstantiationsInFlight = false;
+      {
+        ProfileScope Scope(m_Profiler, ProfilePhase::Collection);
+        DiffCollector collector(DGR, CladEnabledRange, m_MacroExpansions,
+                                m_Derivatives, requests, m_CI.getSema());
       }
 
+      // Sema hands over the template instantiations in the middle of a
+      // declaration or at the end of the file, the cached derivatives cannot
+      // be parsed then.
+      bool CanLoadCached = true;
+      if (DGR.isSingleDecl())
+        if (auto* FD = dyn_cast<FunctionDecl>(DGR.getSingleDecl()))
+          CanLoadCached = !FD->isTemplateInstantiation();
+      llvm::SaveAndRestore<bool> SaveCanLoadCached(m_CanLoadCached,
+                                                   CanLoadCached);
       for (DiffRequest& request : requests)
         ProcessDiffRequest(request);
       return true; // Happiness
     }
 
+    void CladPlugin::HandleTranslationUnit(ASTContext& C) {
+      if (getenv("LIBCLAD_TIMING") &&
+          (m_NumNestedHits || m_NumNestedMisses))
+        llvm::errs() << "Nested derivative requests: " << m_NumNestedHits
+                     << " hits, " << m_NumNestedMisses << " misses\n";
+
+      // If enabled, write the profile of the differentiation.
+      if (!m_DO.ProfileReportFile.empty()) {
+        std::error_code EC;
+        llvm::raw_fd_ostream OS(m_DO.ProfileReportFile, EC,
+                                CLAD_COMPAT_llvm_sys_fs_Text);
+        if (EC) {
+          DiagnosticsEngine& Diags = m_CI.getDiagnostics();
+          unsigned diagID = Diags.getCustomDiagID(
+              DiagnosticsEngine::Error,
+              "cannot write the profile report '%0': %1");
+          Diags.Report(diagID) << m_DO.ProfileReportFile << EC.message();
+          return;
+        }
+        m_Profiler.printJSON(OS);
+      }
+
+      // If enabled, write the derivatives as a header and a source file named
+      // after the main file, which compile without clad.
+      if (m_DO.GenerateSourceFile)
+        WriteSourceFiles(C);
+    }
+
+    void CladPlugin::WriteSourceFiles(ASTContext& C) {
+      SourceManager& SM = C.getSourceManager();
+      const FileEntry* MainFile = SM.getFileEntryForID(SM.getMainFileID());
+      if (!MainFile)
+        return;
+      llvm::SmallString<128> Origin(MainFile->getName());
+      llvm::sys::fs::make_absolute(Origin);
+      LangOptions LangOpts;
+      LangOpts.CPlusPlus = true;
+      PrintingPolicy Policy(LangOpts);
+      Policy.Bool = true;
+
+      // The files are written next to the main file, so that the main files
+      // of the same name in different directories do not share them.
+      llvm::StringRef Dir = llvm::sys::path::parent_path(Origin);
+      std::string Name = (llvm::sys::path::stem(Origin) + ".derivatives").str();
+
+      DerivativeEmitter Emitter;
+      Emitter.add(C.getTranslationUnitDecl(), m_Derivatives, Policy, Origin);
+      // Several translation units may define the same derivative, the linker
+      // keeps one of the weak definitions.
+      std::string Error;
+      if (!Emitter.write(Dir, Name, /*NumParts=*/1, /*Includes=*/{},
+                         /*Weak=*/true, Error)) {
+        DiagnosticsEngine& Diags = m_CI.getDiagnostics();
+        unsigned diagID =
+            Diags.getCustomDiagID(DiagnosticsEngine::Error, "%0");
+        Diags.Report(diagID) << Error;
+      }
+    }
+
     void CladPlugin::ProcessTopLevelDecl(Decl* D) {
+      ProfileScope Scope(m_Profiler, ProfilePhase::CodeGen);
       m_HandleTopLevelDeclInternal = true;
       m_CI.getASTConsumer().HandleTopLevelDecl(DeclGroupRef(D));
       m_HandleTopLevelDeclInternal = false;
     }
 
+    FunctionDecl* ProcessDiffRequest(CladPlugin& P, DiffRequest& request) {
+      return P.ProcessDiffRequest(request);
+    }
+
     FunctionDecl* CladPlugin::ProcessDiffRequest(DiffRequest& request) {
       const FunctionDecl* FD = request.Function;
       // set up printing policy
@@ -149,6 +399,42 @@ namespace clad {
       LangOpts.CPlusPlus = true;
       clang::PrintingPolicy Policy(LangOpts);
       Policy.Bool = true;
+
+      // The functions called at several places are differentiated once, the
+      // nested requests are not tied to a call to clad::differentiate/gradient.
+      std::pair<const FunctionDecl*, std::string> NestedKey;
+      if (!request.CallUpdateRequired) {
+        NestedKey = {FD->getCanonicalDecl(),
+                     GetRequestSpelling(request, Policy)};
+        auto Found = m_NestedDerivatives.find(NestedKey);
+        if (Found != m_NestedDerivatives.end()) {
+          ++m_NumNestedHits;
+          return Found->second;
+        }
+        ++m_NumNestedMisses;
+      }
+      // If enabled, profile the request, including the derivatives it needs.
+      ASTContext& C = m_CI.getASTContext();
+      if (m_Profiler.isEnabled())
+        m_Profiler.startFunction(FD->getQualifiedNameAsString(),
+                                 C.getASTAllocatedMemory());
+      FunctionDecl* Result = ProcessDiffRequestImpl(request, Policy);
+      if (m_Profiler.isEnabled()) {
+        ASTNodeCounter Counter;
+        if (Result)
+          Counter.TraverseDecl(Result);
+        m_Profiler.stopFunction(Result ? Result->getNameAsString() : "",
+                                Counter.NumNodes, C.getASTAllocatedMemory());
+      }
+      if (NestedKey.first)
+        m_NestedDerivatives[NestedKey] = Result;
+      return Result;
+    }
+
+    FunctionDecl*
+    CladPlugin::ProcessDiffRequestImpl(DiffRequest& request,
+                                       const PrintingPolicy& Policy) {
+      const FunctionDecl* FD = request.Function;
       // if enabled, print source code of the original functions
       if (m_DO.DumpSourceFn) {
         FD->print(llvm::outs(), Policy);
@@ -185,6 +471,25 @@ namespace clad {
         m_DerivativeBuilder->setNumDiffErrDiag(true);
       }
 
+      // With -fderivative-templates, the specializations of a function
+      // template over the other floating-point types instantiate the template
+      // emitted for the derivative of the first one.
+      std::pair<const FunctionTemplateDecl*, std::string> TemplateKey;
+      if (m_DO.DerivativeTemplates)
+        if (FunctionTemplateDecl* FTD =
+                GetDerivativeTemplatePattern(request, m_CI.getSema())) {
+          // The template emitted for clad::opts::generic_fp is the same.
+          DiffRequest KeyRequest = request;
+          KeyRequest.BitMaskedOpts &= ~opts::generic_fp;
+          TemplateKey = {FTD->getCanonicalDecl(),
+                         GetRequestSpelling(KeyRequest, Policy)};
+          auto Found = m_DerivativeTemplates.find(TemplateKey);
+          if (Found != m_DerivativeTemplates.end() && Found->second)
+            if (FunctionDecl* Spec = InstantiateDerivativeTemplate(
+                    Found->second, request, Policy))
+              return Spec;
+        }
+
       FunctionDecl* DerivativeDecl = nullptr;
       Decl* DerivativeDeclContext = nullptr;
       FunctionDecl* OverloadedDerivativeDecl = nullptr;
@@ -196,19 +501,54 @@ namespace clad {
         SimpleTimer Timer(WantTiming);
         Timer.setOutput("Generation time for " + FD->getNameAsString());
 
-        // TODO: Maybe find a better way to declare and use
-        //  OverloadedDeclWithContext
-        std::tie(DerivativeDecl, DerivativeDeclContext,
-                 OverloadedDerivativeDecl) =
-            m_DerivativeBuilder->Derive(FD, request);
+        // If enabled, reuse the derivative generated by a previous
+        // compilation.
+        std::string CacheKey;
+        bool CacheHit = false;
+        if (!m_DO.DerivativeCacheDir.empty()) {
+          if (!m_DerivativeCache)
+            m_DerivativeCache.reset(
+                new DerivativeCache(m_CI, m_DO.DerivativeCacheDir));
+          CacheKey = m_DerivativeCache->getKey(
+              request, m_DO.PrintNumDiffErrorInfo ? "num-diff-errors" : "",
+              Policy);
+          if (!CacheKey.empty() && m_CanLoadCached &&
+              m_DerivativeCache->canLoad()) {
+            llvm::SmallVector<Decl*, 4> DepDecls;
+            CacheHit = m_DerivativeCache->load(
+                CacheKey, m_Derivatives, Policy, DepDecls, DerivativeDecl,
+                DerivativeDeclContext, OverloadedDerivativeDecl);
+            for (Decl* D : DepDecls)
+              ProcessTopLevelDecl(D);
+            if (CacheHit)
+              Timer.setOutput("Generation time for " + FD->getNameAsString() +
+                              " (cached)");
+          }
+        }
+
+        if (!CacheHit) {
+          DiagnosticConsumer& Diags = m_CI.getDiagnosticClient();
+          unsigned NumErrors = Diags.getNumErrors();
+          // TODO: Maybe find a better way to declare and use
+          //  OverloadedDeclWithContext
+          std::tie(DerivativeDecl, DerivativeDeclContext,
+                   OverloadedDerivativeDecl) =
+              m_DerivativeBuilder->Derive(FD, request);
+          if (DerivativeDecl && !CacheKey.empty() &&
+              Diags.getNumErrors() == NumErrors)
+            m_DerivativeCache->store(CacheKey, m_Derivatives, Policy,
+                                     DerivativeDecl, OverloadedDerivativeDecl);
+        }
       }
 
       if (DerivativeDecl) {
         auto I = m_Derivatives.insert(DerivativeDecl);
         (void)I;
         assert(I.second);
-        bool lastDerivativeOrder = 
-          (request.CurrentDerivativeOrder == request.RequestedDerivativeOrder);
+        // Taylor mode computes all the requested orders at once.
+        bool lastDerivativeOrder =
+            request.Mode == DiffMode::taylor ||
+            request.CurrentDerivativeOrder == request.RequestedDerivativeOrder;
         // If this is the last required derivative order, replace the function
         // inside a call to clad::differentiate/gradient with its derivative.
         if (request.CallUpdateRequired && lastDerivativeOrder)
@@ -223,14 +563,6 @@ namespace clad {
         if (m_DO.DumpDerivedAST) {
           DerivativeDecl->dumpColor();
         }
-        // if enabled, print the derivatives in a file.
-        if (m_DO.GenerateSourceFile) {
-          std::error_code err;
-          llvm::raw_fd_ostream f("Derivatives.cpp",
-                                 err, CLAD_COMPAT_llvm_sys_fs_Append);
-          DerivativeDecl->print(f, Policy);
-          f.flush();
-        }
         // Call CodeGen only if the produced decl is a top-most decl.
         Decl* DerivativeDeclOrEnclosingContext = DerivativeDeclContext ?
           DerivativeDeclContext : DerivativeDecl;
@@ -242,6 +574,33 @@ namespace clad {
             ProcessTopLevelDecl(OverloadedDerivativeDecl);
         }
 
+        // With clad::opts::generic_fp the derivative is also emitted as a
+        // function template over the floating-point type.
+        // The derivative template may exist already, emitted for another
+        // spelling of the request, e.g. naming the independent parameter.
+        FunctionTemplateDecl* GenericTemplate = nullptr;
+        if (TemplateKey.first)
+          for (const auto& KV : m_DerivativeTemplates)
+            if (KV.first.first == TemplateKey.first && KV.second &&
+                KV.second->getDeclName() == DerivativeDecl->getDeclName())
+              GenericTemplate = KV.second;
+        if (!GenericTemplate && lastDerivativeOrder &&
+            HasOption(request.BitMaskedOpts, opts::generic_fp) &&
+            (request.Mode == DiffMode::forward ||
+             request.Mode == DiffMode::reverse))
+          GenericTemplate = ProcessGenericFP(DerivativeDecl, request, Policy);
+        // The first specialization differentiated emits the derivative
+        // template for the others, quietly since the user did not ask for it.
+        if (TemplateKey.first && !m_DerivativeTemplates.count(TemplateKey)) {
+          if (!GenericTemplate) {
+            DiffRequest QuietRequest = request;
+            QuietRequest.VerboseDiags = false;
+            GenericTemplate =
+                ProcessGenericFP(DerivativeDecl, QuietRequest, Policy);
+          }
+          m_DerivativeTemplates[TemplateKey] = GenericTemplate;
+        }
+
         // Last requested order was computed, return the result.
         if (lastDerivativeOrder)
           return DerivativeDecl;
@@ -254,8 +613,73 @@ namespace clad {
       return nullptr;
     }
 
+    FunctionTemplateDecl*
+    CladPlugin::ProcessGenericFP(FunctionDecl* DerivativeDecl,
+                                 const DiffRequest& request,
+                                 const PrintingPolicy& Policy) {
+      FunctionDecl* GenericDecl = nullptr;
+      Decl* GenericDeclContext = nullptr;
+      std::tie(GenericDecl, GenericDeclContext) =
+          m_DerivativeBuilder->DeriveGenericFP(DerivativeDecl, request);
+      if (!GenericDecl)
+        return nullptr;
+      FunctionTemplateDecl* FTD = GenericDecl->getDescribedFunctionTemplate();
+      m_Derivatives.insert(FTD);
+      if (m_DO.DumpDerivedFn)
+        FTD->print(llvm::outs(), Policy);
+      if (m_DO.DumpDerivedAST)
+        FTD->dumpColor();
+      Decl* GenericDeclOrEnclosingContext =
+          GenericDeclContext ? GenericDeclContext : FTD;
+      if (GenericDeclOrEnclosingContext->getDeclContext()->isTranslationUnit())
+        ProcessTopLevelDecl(GenericDeclOrEnclosingContext);
+
+      // The uses of the template through a declaration written by the user
+      // were not instantiated, because there was no definition yet.
+      llvm::SmallVector<FunctionDecl*, 4> Specializations(
+          FTD->specializations().begin(), FTD->specializations().end());
+      Sema& S = m_CI.getSema();
+      ProfileScope Scope(m_Profiler, ProfilePhase::Instantiation);
+      m_HandleTopLevelDeclInternal = true;
+      for (FunctionDecl* Spec : Specializations)
+        if (!Spec->isDefined() &&
+            Spec->getTemplateSpecializationKind() == TSK_ImplicitInstantiation)
+          S.InstantiateFunctionDefinition(Spec->getPointOfInstantiation(),
+                                          Spec, /*Recursive=*/true);
+      m_HandleTopLevelDeclInternal = false;
+      return FTD;
+    }
+
+    FunctionDecl*
+    CladPlugin::InstantiateDerivativeTemplate(FunctionTemplateDecl* Template,
+                                              DiffRequest& request,
+                                              const PrintingPolicy& Policy) {
+      const FunctionDecl* FD = request.Function;
+      QualType FPType =
+          FD->getTemplateSpecializationArgs()->get(0).getAsType();
+      SourceLocation Loc = request.CallContext
+                               ? request.CallContext->getBeginLoc()
+                               : FD->getPointOfInstantiation();
+      // Sema hands the instantiation over to CodeGen.
+      m_HandleTopLevelDeclInternal = true;
+      FunctionDecl* DerivativeDecl =
+          m_DerivativeBuilder->InstantiateGenericFP(Template, FPType, Loc);
+      m_HandleTopLevelDeclInternal = false;
+      if (!DerivativeDecl)
+        return nullptr;
+      m_Derivatives.insert(DerivativeDecl);
+      if (request.CallUpdateRequired)
+        request.updateCall(DerivativeDecl, /*OverloadedFD=*/nullptr,
+                           m_CI.getSema());
+      if (m_DO.DumpDerivedFn)
+        DerivativeDecl->print(llvm::outs(), Policy);
+      if (m_DO.DumpDerivedAST)
+        DerivativeDecl->dumpColor();
+      return DerivativeDecl;
+    }
+
     bool CladPlugin::CheckBuiltins() {
-      // If we have included "clad/Differentiator/Differentiator.h" return.
+      // If we have included "clad/Differentiator/CladCore.h" return.
       if (m_HasRuntime)
         return true;
 
@@ -273,6 +697,15 @@ namespace clad {
       SemaR.LookupQualifiedName(R, C.getTranslationUnitDecl(),
                                 /*allowBuiltinCreation*/ false);
       m_HasRuntime = !R.empty();
+      // The #pragma clad ON of a runtime read from a precompiled header or a
+      // header unit is not seen again, enable clad for the whole main file
+      // unless the translation unit has a pragma of its own.
+      if (m_HasRuntime && CladEnabledRange.empty() &&
+          R.getRepresentativeDecl()->getCanonicalDecl()->isFromASTFile()) {
+        const SourceManager& SM = SemaR.getSourceManager();
+        CladEnabledRange.push_back(SourceRange(
+            SM.getLocForStartOfFile(SM.getMainFileID()), SourceLocation()));
+      }
       return m_HasRuntime;
     }
   } // end namespace plugin
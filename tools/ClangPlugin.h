@@ -9,8 +9,11 @@
 
 #include "clad/Differentiator/DerivativeBuilder.h"
 #include "clad/Differentiator/DiffPlanner.h"
+#include "clad/Differentiator/Profiler.h"
 #include "clad/Differentiator/Version.h"
 
+#include "DerivativeCache.h"
+
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Basic/Version.h"
@@ -18,6 +21,9 @@
 
 #include "llvm/ADT/SmallVector.h"
 
+#include <map>
+#include <string>
+
 namespace clang {
   class ASTContext;
   class CallExpr;
@@ -25,7 +31,9 @@ namespace clang {
   class DeclGroupRef;
   class Expr;
   class FunctionDecl;
+  class FunctionTemplateDecl;
   class ParmVarDecl;
+  struct PrintingPolicy;
   class Sema;
 } // namespace clang
 
@@ -40,7 +48,9 @@ namespace clad {
           : DumpSourceFn(false), DumpSourceFnAST(false), DumpDerivedFn(false),
             DumpDerivedAST(false), GenerateSourceFile(false),
             ValidateClangVersion(false), CustomEstimationModel(false),
-            PrintNumDiffErrorInfo(false), CustomModelName("") {}
+            PrintNumDiffErrorInfo(false), DerivativeTemplates(false),
+            CustomModelName(""),
+            DerivativeCacheDir(""), ProfileReportFile("") {}
 
       bool DumpSourceFn : 1;
       bool DumpSourceFnAST : 1;
@@ -50,32 +60,85 @@ namespace clad {
       bool ValidateClangVersion : 1;
       bool CustomEstimationModel : 1;
       bool PrintNumDiffErrorInfo : 1;
+      /// Whether the forward mode derivatives of the specializations of a
+      /// function template over a floating-point type are instantiated from a
+      /// derivative template, see CladPlugin::ProcessDiffRequestImpl.
+      bool DerivativeTemplates : 1;
       std::string CustomModelName;
+      /// If not empty, the derivatives are saved in and reused from this
+      /// directory, see DerivativeCache.
+      std::string DerivativeCacheDir;
+      /// If not empty, the time spent in each phase of the differentiation
+      /// is written to this file as JSON, see Profiler.
+      std::string ProfileReportFile;
     };
 
     class CladPlugin : public clang::ASTConsumer {
       clang::CompilerInstance& m_CI;
       DifferentiationOptions m_DO;
+      Profiler m_Profiler;
       std::unique_ptr<DerivativeBuilder> m_DerivativeBuilder;
+      std::unique_ptr<DerivativeCache> m_DerivativeCache;
       DerivativesSet m_Derivatives;
+      CladMacroExpansions m_MacroExpansions;
       bool m_HasRuntime = false;
-      bool m_PendingInstantiationsInFlight = false;
       bool m_HandleTopLevelDeclInternal = false;
+      /// Set while the requests found in a top-level declaration parsed from
+      /// the source file are processed, the cached derivatives can only be
+      /// parsed then.
+      bool m_CanLoadCached = false;
+      /// The derivatives of the nested requests, e.g. of the functions called
+      /// by a differentiated function, keyed by the function and a spelling
+      /// of the mode, the order and the independent arguments. The failed
+      /// requests are recorded with a null derivative.
+      std::map<std::pair<const clang::FunctionDecl*, std::string>,
+               clang::FunctionDecl*>
+          m_NestedDerivatives;
+      unsigned m_NumNestedHits = 0;
+      unsigned m_NumNestedMisses = 0;
+      /// The derivative templates for -fderivative-templates, keyed by the
+      /// differentiated function template and a spelling of the request. The
+      /// templates which could not be emitted are recorded as null.
+      std::map<std::pair<const clang::FunctionTemplateDecl*, std::string>,
+               clang::FunctionTemplateDecl*>
+          m_DerivativeTemplates;
     public:
       CladPlugin(clang::CompilerInstance& CI, DifferentiationOptions& DO);
       ~CladPlugin();
       bool HandleTopLevelDecl(clang::DeclGroupRef DGR) override;
+      void HandleTranslationUnit(clang::ASTContext& C) override;
       clang::FunctionDecl* ProcessDiffRequest(DiffRequest& request);
+      /// \returns the derivatives generated so far in the translation unit.
+      const DerivativesSet& getDerivatives() const { return m_Derivatives; }
 
     private:
       bool CheckBuiltins();
+      clang::FunctionDecl*
+      ProcessDiffRequestImpl(DiffRequest& request,
+                             const clang::PrintingPolicy& Policy);
       void ProcessTopLevelDecl(clang::Decl* D);
+      /// Writes the derivatives for -fgenerate-source-file.
+      void WriteSourceFiles(clang::ASTContext& C);
+      /// Emits the derivative as a function template over the floating-point
+      /// type and instantiates the uses of the template, see
+      /// clad::opts::generic_fp.
+      /// \returns the function template, or null if it was not emitted.
+      clang::FunctionTemplateDecl*
+      ProcessGenericFP(clang::FunctionDecl* DerivativeDecl,
+                       const DiffRequest& request,
+                       const clang::PrintingPolicy& Policy);
+      /// Instantiates the derivative template for the specialization
+      /// differentiated by the request, see -fderivative-templates.
+      /// \returns the derivative, or null if the template cannot be
+      /// instantiated.
+      clang::FunctionDecl*
+      InstantiateDerivativeTemplate(clang::FunctionTemplateDecl* Template,
+                                    DiffRequest& request,
+                                    const clang::PrintingPolicy& Policy);
     };
 
     clang::FunctionDecl* ProcessDiffRequest(CladPlugin& P,
-                                            DiffRequest& request) {
-      return P.ProcessDiffRequest(request);
-    }
+                                            DiffRequest& request);
 
     template <typename ConsumerType>
     class Action : public clang::PluginASTAction {
@@ -130,6 +193,20 @@ namespace clad {
             m_DO.CustomModelName = args[i];
           } else if (args[i] == "-fprint-num-diff-errors") {
             m_DO.PrintNumDiffErrorInfo = true;
+          } else if (args[i] == "-fderivative-templates") {
+            m_DO.DerivativeTemplates = true;
+          } else if (args[i] == "-fderivative-cache") {
+            if (++i == e) {
+              llvm::errs() << "No cache directory was specified.";
+              return false;
+            }
+            m_DO.DerivativeCacheDir = args[i];
+          } else if (args[i] == "-fprofile-report") {
+            if (++i == e) {
+              llvm::errs() << "No profile report file was specified.";
+              return false;
+            }
+            m_DO.ProfileReportFile = args[i];
           } else if (args[i] == "-help") {
             // Print some help info.
             llvm::errs()
@@ -143,13 +220,24 @@ namespace clad {
                    "derivative.\n"
                 << "-fdump-derived-fn-ast - Prints out the AST of the "
                    "derivative.\n"
-                << "-fgenerate-source-file - Produces a file containing the "
-                   "derivatives.\n"
+                << "-fgenerate-source-file - Writes the derivatives to "
+                   "<file>.derivatives.h and <file>.derivatives.cpp next to "
+                   "the file, which compile without clad.\n"
                 << "-fcustom-estimation-model - allows user to send in a "
                    "shared object to use as the custom estimation model.\n"
                 << "-fprint-num-diff-errors - allows users to print the "
                    "calculated numerical diff errors, this flag is overriden "
-                   "by -DCLAD_NO_NUM_DIFF.\n";
+                   "by -DCLAD_NO_NUM_DIFF.\n"
+                << "-fderivative-templates - emits the forward mode "
+                   "derivative of a function template over a floating-point "
+                   "type as a template, instantiated for the other "
+                   "floating-point types instead of differentiating them.\n"
+                << "-fderivative-cache - reuses the derivatives generated by "
+                   "previous compilations, stored in the directory given as "
+                   "the next argument.\n"
+                << "-fprofile-report - writes the time spent in each phase of "
+                   "the differentiation, in total and per function, as JSON "
+                   "to the file given as the next argument.\n";
 
             llvm::errs() << "-help - Prints out this screen.\n\n";
           } else {
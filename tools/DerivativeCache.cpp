@@ -0,0 +1,617 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#include "DerivativeCache.h"
+
+#include "clad/Differentiator/Version.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Parse/Parser.h"
+#include "clang/Sema/Lookup.h"
+#include "clang/Sema/Scope.h"
+#include "clang/Sema/Sema.h"
+
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "clad/Differentiator/Compatibility.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace clang;
+
+namespace {
+  /// Prefix of the line starting each function of a cache entry.
+  const char* const EntryMarker = "//clad-cache: ";
+
+  /// Collects the declarations referenced by a function body, and those the
+  /// generated code depends on: the parents of the members and of the
+  /// enumerators, and the typedefs and the classes naming the types used.
+  class DeclCollector : public RecursiveASTVisitor<DeclCollector> {
+    llvm::SetVector<const Decl*>& m_Decls;
+
+  public:
+    DeclCollector(llvm::SetVector<const Decl*>& Decls) : m_Decls(Decls) {}
+
+    void Add(const Decl* D) {
+      if (auto* FD = dyn_cast<FunctionDecl>(D)) {
+        if (const FunctionDecl* Def = FD->getDefinition())
+          FD = Def;
+        if (auto* MD = dyn_cast<CXXMethodDecl>(FD))
+          Add(MD->getParent());
+        m_Decls.insert(FD);
+      } else if (auto* VD = dyn_cast<VarDecl>(D)) {
+        if (!VD->hasGlobalStorage() || VD->isStaticLocal())
+          return;
+        if (auto* RD = dyn_cast<CXXRecordDecl>(VD->getDeclContext()))
+          Add(RD);
+        m_Decls.insert(VD->getDefinition() ? VD->getDefinition() : VD);
+      } else if (auto* FieldD = dyn_cast<FieldDecl>(D)) {
+        Add(FieldD->getParent());
+      } else if (auto* ECD = dyn_cast<EnumConstantDecl>(D)) {
+        m_Decls.insert(cast<Decl>(ECD->getDeclContext()));
+      } else if (auto* TD = dyn_cast<TagDecl>(D)) {
+        m_Decls.insert(TD->getDefinition() ? TD->getDefinition() : TD);
+      } else if (auto* TND = dyn_cast<TypedefNameDecl>(D)) {
+        m_Decls.insert(TND);
+      }
+    }
+
+    /// Collects the declarations naming the types used by a declaration.
+    void AddTypes(const DeclaratorDecl* DD) {
+      if (TypeSourceInfo* TSI = DD->getTypeSourceInfo())
+        TraverseTypeLoc(TSI->getTypeLoc());
+    }
+
+    bool VisitDeclRefExpr(DeclRefExpr* DRE) {
+      Add(DRE->getDecl());
+      return true;
+    }
+    bool VisitMemberExpr(MemberExpr* ME) {
+      Add(ME->getMemberDecl());
+      return true;
+    }
+    bool VisitCXXConstructExpr(CXXConstructExpr* CE) {
+      Add(CE->getConstructor());
+      return true;
+    }
+    bool VisitTypedefTypeLoc(TypedefTypeLoc TL) {
+      Add(TL.getTypedefNameDecl());
+      return true;
+    }
+    bool VisitTagTypeLoc(TagTypeLoc TL) {
+      Add(TL.getDecl());
+      return true;
+    }
+  };
+
+  /// Collects the functions referenced by a function body.
+  class CalleeCollector : public RecursiveASTVisitor<CalleeCollector> {
+  public:
+    llvm::SetVector<const FunctionDecl*> Callees;
+
+    bool VisitDeclRefExpr(DeclRefExpr* DRE) {
+      if (auto* FD = dyn_cast<FunctionDecl>(DRE->getDecl()))
+        Callees.insert(FD);
+      return true;
+    }
+  };
+
+  /// Prints the custom derivatives whose names start with one of the given
+  /// names followed by an underscore, e.g. f_darg0 or f_pullback for f.
+  void PrintCustomDerivatives(const DeclContext* DC,
+                              const llvm::StringSet<>& Names,
+                              const PrintingPolicy& Policy,
+                              llvm::raw_ostream& OS) {
+    for (const Decl* D : DC->decls()) {
+      if (auto* NSD = dyn_cast<NamespaceDecl>(D)) {
+        PrintCustomDerivatives(NSD, Names, Policy, OS);
+        continue;
+      }
+      auto* ND = dyn_cast<NamedDecl>(D);
+      if (!ND || !ND->getIdentifier())
+        continue;
+      llvm::StringRef Name = ND->getName();
+      for (size_t Pos = Name.find('_'); Pos != llvm::StringRef::npos;
+           Pos = Name.find('_', Pos + 1))
+        if (Names.count(Name.substr(0, Pos))) {
+          D->print(OS, Policy);
+          OS << '\n';
+          break;
+        }
+    }
+  }
+
+  /// Prints the values of the language options, one per line.
+  void PrintLangOptions(const LangOptions& LO, llvm::raw_ostream& OS) {
+#define LANGOPT(Name, Bits, Default, Description)                              \
+  OS << #Name << ' ' << static_cast<unsigned>(LO.Name) << '\n';
+#define ENUM_LANGOPT(Name, Type, Bits, Default, Description)                   \
+  OS << #Name << ' ' << static_cast<unsigned>(LO.get##Name()) << '\n';
+#include "clang/Basic/LangOptions.def"
+  }
+
+  /// \returns true if the generated function shares its name with another
+  /// function of its context, other than the overload of the derivative.
+  /// The printed call names it, the parsed call may resolve to another
+  /// function.
+  bool IsOverloaded(const FunctionDecl* Callee,
+                    const clad::DerivativesSet& Derivatives,
+                    const FunctionDecl* OverloadedDerivativeDecl) {
+    if (!Derivatives.count(Callee) && Callee->getLocation().isValid())
+      return false;
+    for (const NamedDecl* ND :
+         Callee->getDeclContext()->getRedeclContext()->lookup(
+             Callee->getDeclName())) {
+      const FunctionDecl* FD = ND->getAsFunction();
+      if (FD && FD->getCanonicalDecl() != Callee->getCanonicalDecl() &&
+          FD != OverloadedDerivativeDecl)
+        return true;
+    }
+    return false;
+  }
+
+  /// Adds the generated derivatives called by FD to Deps, the ones called
+  /// by a derivative before it. \returns false if FD calls a generated
+  /// function which is not in Derivatives, it is unknown how to restore it,
+  /// or which is overloaded.
+  bool CollectDependencies(const FunctionDecl* FD,
+                           const clad::DerivativesSet& Derivatives,
+                           const FunctionDecl* OverloadedDerivativeDecl,
+                           llvm::SmallPtrSetImpl<const FunctionDecl*>& Visited,
+                           llvm::SetVector<const FunctionDecl*>& Deps) {
+    CalleeCollector Collector;
+    Collector.TraverseStmt(FD->getBody());
+    for (const FunctionDecl* Callee : Collector.Callees) {
+      if (IsOverloaded(Callee, Derivatives, OverloadedDerivativeDecl))
+        return false;
+      if (!Derivatives.count(Callee)) {
+        // The generated functions have no location.
+        if (Callee->getLocation().isInvalid() && !Visited.count(Callee))
+          return false;
+        continue;
+      }
+      if (!Visited.insert(Callee).second)
+        continue;
+      if (!CollectDependencies(Callee, Derivatives, OverloadedDerivativeDecl,
+                               Visited, Deps))
+        return false;
+      Deps.insert(Callee);
+    }
+    return true;
+  }
+} // namespace
+
+namespace clad {
+  namespace plugin {
+    DerivativeCache::DerivativeCache(CompilerInstance& CI, llvm::StringRef Dir)
+        : m_CI(CI), m_Dir(Dir) {}
+
+    std::string DerivativeCache::getKey(const DiffRequest& request,
+                                        llvm::StringRef Salt,
+                                        const PrintingPolicy& Policy) const {
+      const FunctionDecl* FD = request.Function;
+      // The derivatives of methods and templates are declared in contexts
+      // which cannot be reopened.
+      if (request.Functor || isa<CXXMethodDecl>(FD) ||
+          FD->isTemplateInstantiation() || FD->getDescribedFunctionTemplate() ||
+          HasOption(request.BitMaskedOpts, opts::generic_fp) ||
+          request.Mode == DiffMode::error_estimation)
+        return "";
+      for (const DeclContext* DC = FD->getDeclContext();
+           !DC->isTranslationUnit(); DC = DC->getParent()) {
+        auto* NSD = dyn_cast<NamespaceDecl>(DC);
+        if (!NSD || NSD->isAnonymousNamespace() || NSD->isInline())
+          return "";
+      }
+      if (!FD->getDefinition())
+        return "";
+
+      std::string Input;
+      llvm::raw_string_ostream OS(Input);
+      OS << clad::getCladRevision() << '\n'
+         << clang::getClangFullVersion() << '\n'
+         << m_CI.getTargetOpts().Triple << ' ' << Salt << '\n';
+      // The language options change how the saved code parses, e.g. the
+      // standard, -fno-exceptions or -fms-extensions.
+      PrintLangOptions(m_CI.getLangOpts(), OS);
+      OS << static_cast<unsigned>(request.Mode) << ' ' << request.BitMaskedOpts
+         << ' ' << request.CurrentDerivativeOrder << ' '
+         << request.RequestedDerivativeOrder << ' ' << request.BaseFunctionName
+         << ' ' << request.JacobianNumColumns << ' ' << request.JacobianColumn
+         << ' ' << request.JacobianNumRows << ' '
+         << request.DirectionalDerivative << ' ' << request.VerboseDiags;
+      for (int Index : request.JacobianSparseEntries)
+        OS << ' ' << Index;
+      OS << '\n';
+      if (request.Args)
+        request.Args->printPretty(OS, /*Helper=*/nullptr, Policy);
+      OS << '\n';
+
+      // The function and, transitively, the declarations it uses. Those
+      // from system headers are only named, they do not change between
+      // compilations.
+      const SourceManager& SM = m_CI.getSourceManager();
+      llvm::SetVector<const Decl*> Decls;
+      DeclCollector Collector(Decls);
+      Collector.Add(FD);
+      llvm::StringSet<> Names;
+      for (unsigned i = 0; i < Decls.size(); ++i) {
+        const Decl* D = Decls[i];
+        auto* ND = dyn_cast<NamedDecl>(D);
+        if (auto* F = dyn_cast<FunctionDecl>(D))
+          if (F->getIdentifier())
+            Names.insert(F->getName());
+        if (SM.isInSystemHeader(D->getLocation())) {
+          if (ND)
+            OS << ND->getQualifiedNameAsString() << '\n';
+          continue;
+        }
+        D->print(OS, Policy);
+        OS << '\n';
+        if (auto* F = dyn_cast<FunctionDecl>(D)) {
+          Collector.AddTypes(F);
+          if (F->hasBody())
+            Collector.TraverseStmt(F->getBody());
+        } else if (auto* VD = dyn_cast<VarDecl>(D)) {
+          Collector.AddTypes(VD);
+          if (VD->hasInit())
+            Collector.TraverseStmt(const_cast<Expr*>(VD->getInit()));
+        } else if (auto* TND = dyn_cast<TypedefNameDecl>(D)) {
+          Collector.TraverseTypeLoc(TND->getTypeSourceInfo()->getTypeLoc());
+        } else if (auto* RD = dyn_cast<RecordDecl>(D)) {
+          for (const FieldDecl* Field : RD->fields())
+            Collector.AddTypes(Field);
+        }
+      }
+
+      // The custom derivatives of the used functions.
+      ASTContext& C = m_CI.getASTContext();
+      Sema& S = m_CI.getSema();
+      LookupResult R(S, &C.Idents.get("custom_derivatives"), SourceLocation(),
+                     Sema::LookupNamespaceName);
+      S.LookupQualifiedName(R, C.getTranslationUnitDecl());
+      if (auto* CustomNSD = R.getAsSingle<NamespaceDecl>())
+        for (const NamespaceDecl* NSD : CustomNSD->redecls())
+          PrintCustomDerivatives(NSD, Names, Policy, OS);
+      OS.flush();
+
+      llvm::MD5 Hash;
+      Hash.update(Input);
+      llvm::MD5::MD5Result Result;
+      Hash.final(Result);
+      llvm::SmallString<32> Key;
+      llvm::MD5::stringifyResult(Result, Key);
+      return Key.str().str();
+    }
+
+    bool DerivativeCache::canLoad() const {
+      Sema& S = m_CI.getSema();
+      return S.getCurScope() == S.TUScope && S.CurContext->isTranslationUnit();
+    }
+
+    std::string DerivativeCache::getPath(llvm::StringRef Key) const {
+      llvm::SmallString<128> Path(m_Dir);
+      llvm::sys::path::append(Path, Key + ".cpp");
+      return Path.str().str();
+    }
+
+    bool DerivativeCache::PrintEntry(const NamedDecl* D,
+                                     const PrintingPolicy& Policy, Entry& E) {
+      const FunctionDecl* FD = D->getAsFunction();
+      if (!FD || isa<CXXMethodDecl>(FD))
+        return false;
+      llvm::SmallVector<const NamespaceDecl*, 4> Namespaces;
+      for (const DeclContext* DC = D->getDeclContext();
+           !DC->isTranslationUnit(); DC = DC->getParent()) {
+        auto* NSD = dyn_cast<NamespaceDecl>(DC);
+        if (!NSD || NSD->isAnonymousNamespace() || NSD->isInline())
+          return false;
+        Namespaces.push_back(NSD);
+      }
+      E.Name.clear();
+      E.Code.clear();
+      llvm::raw_string_ostream OS(E.Code);
+      for (auto I = Namespaces.rbegin(), End = Namespaces.rend(); I != End;
+           ++I) {
+        OS << "namespace " << (*I)->getName() << " {\n";
+        E.Name += (*I)->getName().str() + "::";
+      }
+      D->print(OS, Policy);
+      OS << '\n';
+      for (unsigned i = 0; i < Namespaces.size(); ++i)
+        OS << "}\n";
+      OS.flush();
+      E.Name += FD->getNameAsString();
+
+      E.Signature.clear();
+      PrintingPolicy TersePolicy(Policy);
+      TersePolicy.TerseOutput = true;
+      llvm::raw_string_ostream SOS(E.Signature);
+      D->print(SOS, TersePolicy);
+      SOS.flush();
+      std::replace(E.Signature.begin(), E.Signature.end(), '\n', ' ');
+      return true;
+    }
+
+    bool DerivativeCache::IsDefined(const Entry& E,
+                                    const DerivativesSet& Derivatives,
+                                    const PrintingPolicy& Policy) const {
+      ASTContext& C = m_CI.getASTContext();
+      Sema& S = m_CI.getSema();
+      llvm::SmallVector<llvm::StringRef, 4> Parts;
+      llvm::StringRef(E.Name).split(Parts, "::");
+      DeclContext* DC = C.getTranslationUnitDecl();
+      for (unsigned i = 0, e = Parts.size(); i != e; ++i) {
+        bool IsFunction = i + 1 == e;
+        LookupResult R(S, &C.Idents.get(Parts[i]), SourceLocation(),
+                       IsFunction ? Sema::LookupOrdinaryName
+                                  : Sema::LookupNamespaceName);
+        S.LookupQualifiedName(R, DC);
+        if (!IsFunction) {
+          DC = R.getAsSingle<NamespaceDecl>();
+          if (!DC)
+            return false;
+          continue;
+        }
+        for (NamedDecl* ND : R) {
+          auto* FD = dyn_cast<FunctionDecl>(ND);
+          Entry Existing;
+          if (FD && Derivatives.count(FD) &&
+              PrintEntry(FD, Policy, Existing) &&
+              Existing.Signature == E.Signature)
+            return true;
+        }
+      }
+      return false;
+    }
+
+    void DerivativeCache::Parse(llvm::StringRef Code,
+                                llvm::SmallVectorImpl<Decl*>& TopLevelDecls) {
+      // The parser of the translation unit already read the token following
+      // the last declaration. The code is parsed by a parser of its own, fed
+      // by a preprocessor of its own, with the identifiers of the translation
+      // unit so that Sema finds its declarations.
+      Preprocessor& PP = m_CI.getPreprocessor();
+      SourceManager& SM = m_CI.getSourceManager();
+      Sema& S = m_CI.getSema();
+      FileID FID = SM.createFileID(llvm::MemoryBuffer::getMemBufferCopy(
+          Code, "<clad derivative cache>"));
+      llvm::StringRef Buffer = SM.getBufferData(FID);
+      // The code was printed from the AST, the macros are already expanded.
+      Lexer RawLexer(SM.getLocForStartOfFile(FID), m_CI.getLangOpts(),
+                     Buffer.begin(), Buffer.begin(), Buffer.end());
+      llvm::SmallVector<Token, 256> Toks;
+      Token Tok;
+      for (RawLexer.LexFromRawLexer(Tok); Tok.isNot(tok::eof);
+           RawLexer.LexFromRawLexer(Tok)) {
+        if (Tok.is(tok::raw_identifier))
+          PP.LookUpIdentifierInfo(Tok);
+        Toks.push_back(Tok);
+      }
+      Toks.push_back(Tok);
+      std::unique_ptr<Token[]> Stream(new Token[Toks.size()]);
+      std::copy(Toks.begin(), Toks.end(), Stream.get());
+
+      std::unique_ptr<Preprocessor> CachePP =
+          clad_compat::Preprocessor_CreateSibling(PP, m_CI.getLangOpts());
+      CachePP->Initialize(m_CI.getTarget());
+      // An empty file lies below the tokens, the parser may look ahead past
+      // their end.
+      CachePP->enableIncrementalProcessing();
+      FileID EndFID = SM.createFileID(
+          llvm::MemoryBuffer::getMemBuffer("", "<clad derivative cache end>"));
+      CachePP->EnterSourceFile(EndFID, /*Dir=*/nullptr, SourceLocation());
+      clad_compat::Preprocessor_EnterTokenStream(
+          *CachePP, std::move(Stream), Toks.size(),
+          /*DisableMacroExpansion=*/true);
+
+      // The parser resets the current scope of Sema on construction and
+      // deletes it on destruction, it is the scope of the translation unit.
+      Scope* TUScope = S.getCurScope();
+      std::unique_ptr<Parser> P(
+          new Parser(*CachePP, S, /*SkipFunctionBodies=*/false));
+      S.CurScope = TUScope;
+      P->ConsumeToken();
+      Parser::DeclGroupPtrTy ADecl;
+      while (P->getCurToken().isNot(tok::eof)) {
+        P->ParseTopLevelDecl(ADecl);
+        if (ADecl)
+          for (Decl* D : ADecl.get())
+            TopLevelDecls.push_back(D);
+      }
+      S.CurScope = nullptr;
+      P.reset();
+      S.CurScope = TUScope;
+    }
+
+    bool DerivativeCache::load(llvm::StringRef Key, DerivativesSet& Derivatives,
+                               const PrintingPolicy& Policy,
+                               llvm::SmallVectorImpl<Decl*>& DepDecls,
+                               FunctionDecl*& DerivativeDecl,
+                               Decl*& DerivativeDeclContext,
+                               FunctionDecl*& OverloadedDerivativeDecl) {
+      std::string Path = getPath(Key);
+      auto Buffer = llvm::MemoryBuffer::getFile(Path);
+      if (!Buffer)
+        return false;
+
+      std::vector<Entry> Entries;
+      llvm::StringRef Rest = (*Buffer)->getBuffer();
+      while (!Rest.empty()) {
+        llvm::StringRef Line;
+        std::tie(Line, Rest) = Rest.split('\n');
+        if (Line.startswith(EntryMarker)) {
+          // //clad-cache: <kind> <name> <signature>
+          llvm::StringRef Kind, Name;
+          std::tie(Kind, Line) =
+              Line.drop_front(strlen(EntryMarker)).split(' ');
+          std::tie(Name, Line) = Line.split(' ');
+          Entries.push_back({Kind.str(), Name.str(), Line.str(), ""});
+        } else if (!Entries.empty()) {
+          Entries.back().Code += Line.str() + "\n";
+        }
+      }
+      // The dependencies come first, then the derivative and its overload.
+      unsigned NumDeps = 0;
+      while (NumDeps < Entries.size() && Entries[NumDeps].Kind == "dep")
+        ++NumDeps;
+      if (NumDeps == Entries.size() || Entries[NumDeps].Kind != "main" ||
+          Entries.size() > NumDeps + 2 ||
+          (Entries.size() == NumDeps + 2 && Entries.back().Kind != "overload"))
+        return false;
+
+      std::string Code;
+      std::vector<const Entry*> Parsed;
+      for (const Entry& E : Entries) {
+        if (E.Kind == "dep" && IsDefined(E, Derivatives, Policy))
+          continue;
+        Code += E.Code;
+        Parsed.push_back(&E);
+      }
+
+      // An entry which does not parse is not reported, it is removed and
+      // the derivative is generated again.
+      Sema& S = m_CI.getSema();
+      llvm::SmallVector<Decl*, 4> TopLevelDecls;
+      bool Valid;
+      {
+        DiagnosticErrorTrap Trap(S.Diags);
+        bool Suppressed = S.Diags.getSuppressAllDiagnostics();
+        S.Diags.setSuppressAllDiagnostics(true);
+        Parse(Code, TopLevelDecls);
+        S.Diags.setSuppressAllDiagnostics(Suppressed);
+        Valid = !Trap.hasErrorOccurred();
+      }
+
+      // Each entry declares a single function, possibly in namespaces.
+      llvm::SmallVector<FunctionDecl*, 4> Functions;
+      for (Decl* D : TopLevelDecls) {
+        while (auto* NSD = dyn_cast<NamespaceDecl>(D)) {
+          if (NSD->decls_empty())
+            break;
+          D = *NSD->decls_begin();
+        }
+        auto* FD = dyn_cast<FunctionDecl>(D);
+        Valid &= FD != nullptr;
+        if (FD)
+          Functions.push_back(FD);
+      }
+      if (!Valid || Functions.size() != Parsed.size()) {
+        for (FunctionDecl* FD : Functions)
+          Discard(FD);
+        llvm::sys::fs::remove(Path);
+        return false;
+      }
+
+      for (unsigned i = 0, e = Functions.size(); i != e; ++i) {
+        FunctionDecl* FD = Functions[i];
+        const std::string& Kind = Parsed[i]->Kind;
+        if (Kind == "dep") {
+          Derivatives.insert(FD);
+          DepDecls.push_back(TopLevelDecls[i]);
+        } else if (Kind == "main") {
+          DerivativeDecl = FD;
+          if (TopLevelDecls[i] != FD)
+            DerivativeDeclContext = TopLevelDecls[i];
+        } else {
+          OverloadedDerivativeDecl = FD;
+        }
+      }
+      return true;
+    }
+
+    void DerivativeCache::Discard(FunctionDecl* FD) {
+      Sema& S = m_CI.getSema();
+      FD->setInvalidDecl();
+      // A redeclaration replaced the previous declaration in the lookups.
+      if (FD->getPreviousDecl())
+        return;
+      DeclContext* DC = FD->getLexicalDeclContext();
+      DC->removeDecl(FD);
+      if (!DC->isTranslationUnit())
+        return;
+      // The unqualified lookups at file scope use the identifier chains.
+      for (auto I = S.IdResolver.begin(FD->getDeclName()),
+                E = S.IdResolver.end();
+           I != E; ++I)
+        if (*I == FD) {
+          S.TUScope->RemoveDecl(FD);
+          S.IdResolver.RemoveDecl(FD);
+          break;
+        }
+    }
+
+    void DerivativeCache::store(llvm::StringRef Key,
+                                const DerivativesSet& Derivatives,
+                                const PrintingPolicy& Policy,
+                                const FunctionDecl* DerivativeDecl,
+                                const FunctionDecl* OverloadedDerivativeDecl)
+        const {
+      llvm::SmallPtrSet<const FunctionDecl*, 8> Visited;
+      Visited.insert(DerivativeDecl);
+      if (OverloadedDerivativeDecl)
+        Visited.insert(OverloadedDerivativeDecl);
+      llvm::SetVector<const FunctionDecl*> Deps;
+      if (!CollectDependencies(DerivativeDecl, Derivatives,
+                               OverloadedDerivativeDecl, Visited, Deps))
+        return;
+      if (OverloadedDerivativeDecl &&
+          !CollectDependencies(OverloadedDerivativeDecl, Derivatives,
+                               OverloadedDerivativeDecl, Visited, Deps))
+        return;
+
+      std::vector<Entry> Entries;
+      for (const FunctionDecl* Dep : Deps) {
+        Entries.push_back({"dep", "", "", ""});
+        if (!PrintEntry(Dep, Policy, Entries.back()))
+          return;
+      }
+      Entries.push_back({"main", "", "", ""});
+      if (!PrintEntry(DerivativeDecl, Policy, Entries.back()))
+        return;
+      if (OverloadedDerivativeDecl) {
+        Entries.push_back({"overload", "", "", ""});
+        if (!PrintEntry(OverloadedDerivativeDecl, Policy, Entries.back()))
+          return;
+      }
+
+      // Write to a temporary file and rename it, so that the concurrent
+      // compilations never read a partial entry.
+      if (llvm::sys::fs::create_directories(m_Dir))
+        return;
+      std::string Path = getPath(Key);
+      int FD;
+      llvm::SmallString<128> TmpPath;
+      if (llvm::sys::fs::createUniqueFile(Path + "-%%%%%%%%.tmp", FD, TmpPath))
+        return;
+      {
+        llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        OS << "// Derivative cached by clad, do not edit.\n";
+        for (const Entry& E : Entries)
+          OS << EntryMarker << E.Kind << ' ' << E.Name << ' ' << E.Signature
+             << '\n'
+             << E.Code;
+      }
+      if (llvm::sys::fs::rename(TmpPath, Path))
+        llvm::sys::fs::remove(TmpPath);
+    }
+  } // end namespace plugin
+} // end namespace clad
@@ -0,0 +1,101 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#ifndef CLAD_DERIVATIVE_CACHE
+#define CLAD_DERIVATIVE_CACHE
+
+#include "clad/Differentiator/DiffPlanner.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+namespace clang {
+  class CompilerInstance;
+  class Decl;
+  class FunctionDecl;
+  struct PrintingPolicy;
+} // namespace clang
+
+namespace clad {
+  namespace plugin {
+    /// Stores the generated derivatives in a directory shared by the
+    /// compilations, see -fderivative-cache. A derivative is saved as source
+    /// code together with the generated derivatives it calls. The key is a
+    /// hash of the request and of the source of the function and of the
+    /// declarations it uses. On a hit the saved code is parsed instead of
+    /// differentiating the function again.
+    class DerivativeCache {
+      clang::CompilerInstance& m_CI;
+      std::string m_Dir;
+
+    public:
+      /// A function saved in a cache entry.
+      struct Entry {
+        /// Either "dep", "main" or "overload".
+        std::string Kind;
+        /// The qualified name of the function.
+        std::string Name;
+        /// The declaration of the function, on a single line.
+        std::string Signature;
+        /// The definition of the function in its enclosing namespaces.
+        std::string Code;
+      };
+
+      /// Prints the function or function template in its enclosing
+      /// namespaces. \returns false if it is not declared at namespace scope.
+      static bool PrintEntry(const clang::NamedDecl* D,
+                             const clang::PrintingPolicy& Policy, Entry& E);
+
+      DerivativeCache(clang::CompilerInstance& CI, llvm::StringRef Dir);
+
+      /// \returns the key of the request, or an empty string if its
+      /// derivative cannot be cached. The salt stands for the options of the
+      /// plugin which change the derivatives.
+      std::string getKey(const DiffRequest& request, llvm::StringRef Salt,
+                         const clang::PrintingPolicy& Policy) const;
+
+      /// \returns true if code can be parsed now, which is the case only
+      /// between two top-level declarations of the translation unit.
+      bool canLoad() const;
+
+      /// Parses the derivative saved under the key, preceded by the
+      /// derivatives it calls which are not yet defined. The latter are
+      /// added to the set of derivatives and their top-level declarations
+      /// are returned in DepDecls.
+      /// \returns false if there is no usable entry for the key. An entry
+      /// which does not parse is removed.
+      bool load(llvm::StringRef Key, DerivativesSet& Derivatives,
+                const clang::PrintingPolicy& Policy,
+                llvm::SmallVectorImpl<clang::Decl*>& DepDecls,
+                clang::FunctionDecl*& DerivativeDecl,
+                clang::Decl*& DerivativeDeclContext,
+                clang::FunctionDecl*& OverloadedDerivativeDecl);
+
+      /// Saves the derivative and the generated derivatives it calls under
+      /// the key. Nothing is saved if one of them is not declared at
+      /// namespace scope.
+      void store(llvm::StringRef Key, const DerivativesSet& Derivatives,
+                 const clang::PrintingPolicy& Policy,
+                 const clang::FunctionDecl* DerivativeDecl,
+                 const clang::FunctionDecl* OverloadedDerivativeDecl) const;
+
+    private:
+      std::string getPath(llvm::StringRef Key) const;
+      /// \returns true if the derivative is already defined.
+      bool IsDefined(const Entry& E, const DerivativesSet& Derivatives,
+                     const clang::PrintingPolicy& Policy) const;
+      /// Removes a function parsed from an invalid entry from the lookups.
+      void Discard(clang::FunctionDecl* FD);
+      /// Parses the code as if it followed the last top-level declaration.
+      void Parse(llvm::StringRef Code,
+                 llvm::SmallVectorImpl<clang::Decl*>& TopLevelDecls);
+    };
+  } // end namespace plugin
+} // end namespace clad
+
+#endif // CLAD_DERIVATIVE_CACHE
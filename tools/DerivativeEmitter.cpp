@@ -0,0 +1,275 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#include "DerivativeEmitter.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/AST/DeclTemplate.h"
+#include "clang/AST/PrettyPrinter.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Basic/SourceManager.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "clad/Differentiator/Compatibility.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace clang;
+
+namespace {
+  /// Adds the derivatives and derivative templates declared in the context
+  /// and in its namespaces.
+  void Collect(const DeclContext* DC, const clad::DerivativesSet& Derivatives,
+               llvm::SmallVectorImpl<const NamedDecl*>& Result) {
+    for (const Decl* D : DC->decls()) {
+      if (auto* NSD = dyn_cast<NamespaceDecl>(D))
+        Collect(NSD, Derivatives, Result);
+      else if (isa<FunctionDecl>(D) || isa<FunctionTemplateDecl>(D))
+        if (Derivatives.count(D))
+          Result.push_back(cast<NamedDecl>(D));
+    }
+  }
+
+  /// Finds the functions of the main file called by a derivative. The
+  /// sources do not see their definitions, so the header declares them.
+  /// Only the non-inline functions with external linkage are declared, the
+  /// others cannot be defined in another translation unit.
+  class UsedFunctionFinder
+      : public RecursiveASTVisitor<UsedFunctionFinder> {
+    const SourceManager& m_SM;
+    const clad::DerivativesSet& m_Derivatives;
+    llvm::SmallVectorImpl<const FunctionDecl*>& m_Used;
+
+  public:
+    UsedFunctionFinder(const SourceManager& SM,
+                       const clad::DerivativesSet& Derivatives,
+                       llvm::SmallVectorImpl<const FunctionDecl*>& Used)
+        : m_SM(SM), m_Derivatives(Derivatives), m_Used(Used) {}
+
+    bool VisitDeclRefExpr(DeclRefExpr* DRE) {
+      auto* FD = dyn_cast<FunctionDecl>(DRE->getDecl());
+      if (!FD || isa<CXXMethodDecl>(FD) || m_Derivatives.count(FD))
+        return true;
+      if (FD->isInlined() || !FD->isExternallyVisible() ||
+          FD->getTemplatedKind() != FunctionDecl::TK_NonTemplate)
+        return true;
+      if (m_SM.isInMainFile(m_SM.getExpansionLoc(FD->getLocation())))
+        m_Used.push_back(FD);
+      return true;
+    }
+  };
+
+  /// Prints the declaration of a function called by the derivatives, without
+  /// its default arguments which the main file defines too.
+  /// \returns false if it is not declared in named namespaces.
+  bool PrintUsedDeclaration(const FunctionDecl* FD,
+                            const PrintingPolicy& Policy,
+                            clad::plugin::DerivativeCache::Entry& E) {
+    E.Name = FD->getNameAsString();
+    for (const DeclContext* DC = FD->getDeclContext();
+         !DC->isTranslationUnit(); DC = DC->getParent()) {
+      if (isa<LinkageSpecDecl>(DC))
+        continue;
+      auto* NSD = dyn_cast<NamespaceDecl>(DC);
+      if (!NSD || NSD->isAnonymousNamespace() || NSD->isInline())
+        return false;
+      E.Name = NSD->getName().str() + "::" + E.Name;
+    }
+    PrintingPolicy DeclPolicy(Policy);
+    DeclPolicy.TerseOutput = true;
+    DeclPolicy.SuppressInitializers = true;
+    E.Signature.clear();
+    llvm::raw_string_ostream OS(E.Signature);
+    if (FD->isExternC())
+      OS << "extern \"C\" ";
+    FD->print(OS, DeclPolicy);
+    OS.flush();
+    std::replace(E.Signature.begin(), E.Signature.end(), '\n', ' ');
+    return true;
+  }
+
+  /// \returns the MD5 of the key of a derivative, which names its include
+  /// guard.
+  llvm::SmallString<32> GetDigest(llvm::StringRef Key) {
+    llvm::MD5 Hash;
+    Hash.update(Key);
+    llvm::MD5::MD5Result Result;
+    Hash.final(Result);
+    llvm::SmallString<32> Digest;
+    llvm::MD5::stringifyResult(Result, Digest);
+    return Digest;
+  }
+
+  /// Prints the declaration of the derivative in its enclosing namespaces.
+  void PrintDeclaration(llvm::raw_ostream& OS,
+                        const clad::plugin::DerivativeCache::Entry& E,
+                        llvm::StringRef Prefix = "") {
+    llvm::SmallVector<llvm::StringRef, 4> Namespaces;
+    llvm::StringRef(E.Name).split(Namespaces, "::");
+    Namespaces.pop_back();
+    for (llvm::StringRef NS : Namespaces)
+      OS << "namespace " << NS << " {\n";
+    OS << Prefix << E.Signature << ";\n";
+    for (unsigned i = 0; i < Namespaces.size(); ++i)
+      OS << "}\n";
+  }
+
+  /// Writes the file through a temporary one, so that a concurrent build
+  /// never reads a partial file.
+  bool WriteFile(llvm::StringRef Path, llvm::StringRef Contents,
+                 std::string& Error) {
+    int FD;
+    llvm::SmallString<128> TmpPath;
+    std::error_code EC =
+        llvm::sys::fs::createUniqueFile(Path + "-%%%%%%%%.tmp", FD, TmpPath);
+    if (!EC) {
+      {
+        llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        OS << Contents;
+      }
+      EC = llvm::sys::fs::rename(TmpPath, Path);
+      if (EC)
+        llvm::sys::fs::remove(TmpPath);
+    }
+    if (EC)
+      Error = "cannot write '" + Path.str() + "': " + EC.message();
+    return !EC;
+  }
+} // namespace
+
+namespace clad {
+  namespace plugin {
+    void DerivativeEmitter::add(const TranslationUnitDecl* TU,
+                                const DerivativesSet& Derivatives,
+                                const PrintingPolicy& Policy,
+                                llvm::StringRef Origin) {
+      llvm::SmallVector<const NamedDecl*, 16> Found;
+      Collect(TU, Derivatives, Found);
+      const SourceManager& SM = TU->getASTContext().getSourceManager();
+      std::lock_guard<std::mutex> Guard(m_Lock);
+      for (const NamedDecl* ND : Found) {
+        Derivative D;
+        if (!DerivativeCache::PrintEntry(ND, Policy, D.E))
+          continue;
+        const FunctionDecl* FD = ND->getAsFunction();
+        D.DefineInHeader = isa<FunctionTemplateDecl>(ND) || FD->isInlined() ||
+                           FD->getStorageClass() == SC_Static;
+        D.Origin = Origin.str();
+
+        llvm::SmallVector<const FunctionDecl*, 4> Used;
+        UsedFunctionFinder(SM, Derivatives, Used)
+            .TraverseDecl(const_cast<NamedDecl*>(ND));
+        for (const FunctionDecl* UsedFD : Used) {
+          DerivativeCache::Entry E;
+          if (PrintUsedDeclaration(UsedFD, Policy, E))
+            m_Used.insert({E.Name + '\n' + E.Signature, E});
+        }
+
+        std::string Key = D.E.Name + '\n' + D.E.Signature;
+        auto Inserted = m_Derivatives.insert({Key, D});
+        if (Inserted.second)
+          continue;
+        Derivative& Existing = Inserted.first->second;
+        if (Existing.E.Code != D.E.Code)
+          llvm::errs() << "clad: warning: '" << D.E.Name
+                       << "' is generated differently by " << Existing.Origin
+                       << " and " << D.Origin << "\n";
+        // Keep the derivative of the first translation unit by name, so that
+        // the output does not depend on the order of the translation units.
+        if (D.Origin < Existing.Origin)
+          Existing = D;
+      }
+    }
+
+    bool DerivativeEmitter::write(llvm::StringRef Dir, llvm::StringRef Name,
+                                  unsigned NumParts,
+                                  llvm::ArrayRef<std::string> Includes,
+                                  bool Weak, std::string& Error) const {
+      if (std::error_code EC = llvm::sys::fs::create_directories(Dir)) {
+        Error = "cannot create '" + Dir.str() + "': " + EC.message();
+        return false;
+      }
+      if (!NumParts)
+        NumParts = 1;
+      std::lock_guard<std::mutex> Guard(m_Lock);
+
+      std::string Header;
+      llvm::raw_string_ostream HOS(Header);
+      HOS << "// Generated by clad, do not edit.\n"
+          << "#pragma once\n\n"
+          << "#include \"clad/Differentiator/Differentiator.h\"\n";
+      for (const std::string& Include : Includes)
+        HOS << "#include \"" << Include << "\"\n";
+      HOS << '\n';
+      // The functions of the translation units which the derivatives call.
+      for (const auto& KV : m_Used)
+        PrintDeclaration(HOS, KV.second);
+      // All the derivatives are declared first, since they call each other.
+      for (const auto& KV : m_Derivatives)
+        PrintDeclaration(HOS, KV.second.E);
+      // The headers of several translation units may define the same inline
+      // derivative, the first one included defines it.
+      for (const auto& KV : m_Derivatives) {
+        if (!KV.second.DefineInHeader)
+          continue;
+        llvm::SmallString<32> Digest = GetDigest(KV.first);
+        HOS << "\n#ifndef CLAD_DERIVATIVE_" << Digest << '\n'
+            << "#define CLAD_DERIVATIVE_" << Digest << '\n'
+            << KV.second.E.Code << "#endif\n";
+      }
+      HOS.flush();
+
+      std::string HeaderName = (Name + ".h").str();
+      std::vector<std::string> Sources(NumParts), Definitions(NumParts);
+      for (std::string& Source : Sources)
+        Source = "// Generated by clad, do not edit.\n#include \"" +
+                 HeaderName + "\"\n";
+      // The definitions are dealt in the order of their keys, so that the
+      // parts do not change as long as the derivatives do not.
+      unsigned Part = 0;
+      for (const auto& KV : m_Derivatives) {
+        const Derivative& D = KV.second;
+        if (D.DefineInHeader)
+          continue;
+        // The weak definitions are merged by the linker, so that the sources
+        // of several translation units defining a derivative link together.
+        if (Weak) {
+          llvm::raw_string_ostream SOS(Sources[Part]);
+          PrintDeclaration(SOS, D.E, "__attribute__((weak)) ");
+        }
+        Definitions[Part] += '\n' + D.E.Code;
+        Part = (Part + 1) % NumParts;
+      }
+      for (unsigned i = 0; i < NumParts; ++i)
+        Sources[i] += Definitions[i];
+
+      llvm::SmallString<128> Path(Dir);
+      llvm::sys::path::append(Path, HeaderName);
+      if (!WriteFile(Path, Header, Error))
+        return false;
+      for (unsigned i = 0; i < NumParts; ++i) {
+        Path = Dir;
+        if (NumParts == 1)
+          llvm::sys::path::append(Path, Name + ".cpp");
+        else
+          llvm::sys::path::append(Path,
+                                  Name + "_" + llvm::Twine(i) + ".cpp");
+        if (!WriteFile(Path, Sources[i], Error))
+          return false;
+      }
+      return true;
+    }
+  } // end namespace plugin
+} // end namespace clad
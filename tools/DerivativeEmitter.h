@@ -0,0 +1,74 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#ifndef CLAD_DERIVATIVE_EMITTER
+#define CLAD_DERIVATIVE_EMITTER
+
+#include "DerivativeCache.h"
+
+#include "clad/Differentiator/DiffPlanner.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace clang {
+  struct PrintingPolicy;
+  class TranslationUnitDecl;
+} // namespace clang
+
+namespace clad {
+  namespace plugin {
+    /// Writes derivatives as a header and source files which compile without
+    /// clad, see -fgenerate-source-file and clad-gen. The header declares all
+    /// the derivatives and the functions of the main files they call, and
+    /// defines the inline and static derivatives, as well as the derivative
+    /// templates. The sources define the others and can be split, so that
+    /// they are compiled in parallel. A derivative added several times is
+    /// written once.
+    class DerivativeEmitter {
+    public:
+      struct Derivative {
+        DerivativeCache::Entry E;
+        /// Whether the derivative is defined in the header.
+        bool DefineInHeader = false;
+        /// The translation unit which generated the derivative.
+        std::string Origin;
+      };
+
+    private:
+      mutable std::mutex m_Lock;
+      /// The derivatives keyed by their qualified name and signature.
+      std::map<std::string, Derivative> m_Derivatives;
+      /// The declarations of the functions called by the derivatives, keyed
+      /// as the derivatives.
+      std::map<std::string, DerivativeCache::Entry> m_Used;
+
+    public:
+      /// Adds the derivatives of the set which are declared at namespace
+      /// scope in the translation unit. Can be called concurrently.
+      void add(const clang::TranslationUnitDecl* TU,
+               const DerivativesSet& Derivatives,
+               const clang::PrintingPolicy& Policy, llvm::StringRef Origin);
+
+      /// Writes <Name>.h and <Name>.cpp in Dir, or <Name>_<i>.cpp for i less
+      /// than NumParts if NumParts is greater than one. The header includes
+      /// Includes, which declare what the derivatives use. If Weak is set,
+      /// the sources define the derivatives as weak symbols, so that the
+      /// sources written for several translation units can be linked
+      /// together.
+      /// \returns false and sets Error if a file could not be written.
+      bool write(llvm::StringRef Dir, llvm::StringRef Name, unsigned NumParts,
+                 llvm::ArrayRef<std::string> Includes, bool Weak,
+                 std::string& Error) const;
+    };
+  } // end namespace plugin
+} // end namespace clad
+
+#endif // CLAD_DERIVATIVE_EMITTER